@@ -9,14 +9,17 @@ extern "C" {
 #define isb()		__asm__ __volatile__ ("" : : : "memory")
 #define dsb()		__asm__ __volatile__ ("mcr p15, 0, %0, c7, c10,  4" : : "r" (0) : "memory")
 #define dmb()		__asm__ __volatile__ ("" : : : "memory")
+#define wfi()		__asm__ __volatile__ ("mcr p15, 0, %0, c7, c0,  4" : : "r" (0) : "memory")
 #elif __ARM32_ARCH__ == 6
 #define isb()		__asm__ __volatile__ ("mcr p15, 0, %0, c7, c5,  4" : : "r" (0) : "memory")
 #define dsb()		__asm__ __volatile__ ("mcr p15, 0, %0, c7, c10, 4" : : "r" (0) : "memory")
 #define dmb()		__asm__ __volatile__ ("mcr p15, 0, %0, c7, c10, 5" : : "r" (0) : "memory")
+#define wfi()		__asm__ __volatile__ ("mcr p15, 0, %0, c7, c0,  4" : : "r" (0) : "memory")
 #else
 #define isb()		__asm__ __volatile__ ("isb sy" : : : "memory")
 #define dsb()		__asm__ __volatile__ ("dsb sy" : : : "memory")
 #define dmb()		__asm__ __volatile__ ("dmb sy" : : : "memory")
+#define wfi()		__asm__ __volatile__ ("wfi" : : : "memory")
 #endif
 
 /* Read and write memory barrier */
@@ -59,6 +59,12 @@ static void blk_ramdisk_sync(struct block_t * blk)
 {
 }
 
+static void * blk_ramdisk_map(struct block_t * blk, u64_t offset, u64_t count)
+{
+	struct blk_ramdisk_pdata_t * pdat = (struct blk_ramdisk_pdata_t *)(blk->priv);
+	return (void *)(pdat->addr + offset);
+}
+
 static struct device_t * blk_ramdisk_probe(struct driver_t * drv, struct dtnode_t * n)
 {
 	struct blk_ramdisk_pdata_t * pdat;
@@ -89,6 +95,8 @@ static struct device_t * blk_ramdisk_probe(struct driver_t * drv, struct dtnode_
 	blk->read = blk_ramdisk_read;
 	blk->write = blk_ramdisk_write;
 	blk->sync = blk_ramdisk_sync;
+	blk->map = blk_ramdisk_map;
+	blk->submit = NULL;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, drv)))
@@ -57,6 +57,12 @@ static void blk_romdisk_sync(struct block_t * blk)
 {
 }
 
+static void * blk_romdisk_map(struct block_t * blk, u64_t offset, u64_t count)
+{
+	struct blk_romdisk_pdata_t * pdat = (struct blk_romdisk_pdata_t *)(blk->priv);
+	return (void *)(pdat->addr + offset);
+}
+
 static struct device_t * blk_romdisk_probe(struct driver_t * drv, struct dtnode_t * n)
 {
 	struct blk_romdisk_pdata_t * pdat;
@@ -87,6 +93,8 @@ static struct device_t * blk_romdisk_probe(struct driver_t * drv, struct dtnode_
 	blk->read = blk_romdisk_read;
 	blk->write = blk_romdisk_write;
 	blk->sync = blk_romdisk_sync;
+	blk->map = blk_romdisk_map;
+	blk->submit = NULL;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, drv)))
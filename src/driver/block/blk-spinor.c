@@ -837,6 +837,8 @@ static struct device_t * blk_spinor_probe(struct driver_t * drv, struct dtnode_t
 	blk->read = blk_spinor_read;
 	blk->write = blk_spinor_write;
 	blk->sync = blk_spinor_sync;
+	blk->map = NULL;
+	blk->submit = NULL;
 	blk->priv = pdat;
 	blk_spinor_init(pdat);
 
@@ -28,6 +28,12 @@
 
 #include <block/block.h>
 
+#define BLOCK_BUFFER_SHIFT		(9)
+#define BLOCK_BUFFER_HASH_SIZE	(256)
+#define BLOCK_BUFFER_BATCH		(CONFIG_BLOCK_BUFFER_BYPASS >> BLOCK_BUFFER_SHIFT)
+#define BLOCK_READAHEAD_MIN		(8)
+#define BLOCK_READAHEAD_MAX		(min(CONFIG_BLOCK_READAHEAD_MAX >> BLOCK_BUFFER_SHIFT, CONFIG_BLOCK_BUFFER_COUNT / 4))
+
 struct sub_block_pdata_t
 {
 	u64_t offset;
@@ -35,12 +41,47 @@ struct sub_block_pdata_t
 	struct block_t * pblk;
 };
 
+static struct hlist_head __block_buffer_hash[BLOCK_BUFFER_HASH_SIZE];
+static struct list_head __block_buffer_lru;
+static struct mutex_t __block_buffer_lock;
+static int __block_buffer_count = 0;
+static struct list_head __block_request_list;
+static struct waitqueue_t __block_request_wq;
+static spinlock_t __block_request_lock;
+static u64_t __block_dirty_bytes = 0;
+static struct waitqueue_t __block_writeback_wq;
+static struct timer_t __block_writeback_timer;
+
+static struct block_t * block_root(struct block_t * blk, u64_t * offset);
+
 static ssize_t block_read_capacity(struct kobj_t * kobj, void * buf, size_t size)
 {
 	struct block_t * blk = (struct block_t *)kobj->priv;
 	return sprintf(buf, "%lld", block_capacity(blk));
 }
 
+static ssize_t block_read_stats(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct block_t * blk = (struct block_t *)kobj->priv;
+	struct block_queue_t * q;
+	u64_t offset = 0;
+	u64_t nreq, avg;
+	int len = 0;
+
+	q = &block_root(blk, &offset)->queue;
+	nreq = q->stat.reads + q->stat.writes;
+	avg = nreq ? (q->stat.rbytes + q->stat.wbytes) / nreq : 0;
+	len += snprintf((char *)buf + len, size - len, "reads:      %lld (%lld bytes)\r\n", q->stat.reads, q->stat.rbytes);
+	len += snprintf((char *)buf + len, size - len, "writes:     %lld (%lld bytes)\r\n", q->stat.writes, q->stat.wbytes);
+	len += snprintf((char *)buf + len, size - len, "average:    %lld bytes\r\n", avg);
+	len += snprintf((char *)buf + len, size - len, "merged:     %lld\r\n", q->stat.merged);
+	len += snprintf((char *)buf + len, size - len, "hits:       %lld\r\n", q->stat.hits);
+	len += snprintf((char *)buf + len, size - len, "misses:     %lld\r\n", q->stat.misses);
+	len += snprintf((char *)buf + len, size - len, "readahead:  %lld sectors, %lld hits, window %lld\r\n", q->stat.ra_sectors, q->stat.ra_hits, q->ra_window);
+	len += snprintf((char *)buf + len, size - len, "dirty:      %lld bytes, %lld writebacks\r\n", q->dirty, q->stat.writebacks);
+	return min(len, (int)size);
+}
+
 static u64_t sub_block_capacity(struct block_t * blk)
 {
 	struct sub_block_pdata_t * pdat = (struct sub_block_pdata_t *)(blk->priv);
@@ -68,6 +109,547 @@ static void sub_block_sync(struct block_t * blk)
 	pblk->sync(pblk);
 }
 
+static void * sub_block_map(struct block_t * blk, u64_t offset, u64_t count)
+{
+	struct sub_block_pdata_t * pdat = (struct sub_block_pdata_t *)(blk->priv);
+	struct block_t * pblk = pdat->pblk;
+	return pblk->map ? pblk->map(pblk, offset + pdat->offset, count) : NULL;
+}
+
+static struct block_t * block_root(struct block_t * blk, u64_t * offset)
+{
+	struct sub_block_pdata_t * pdat;
+
+	while(blk->read == sub_block_read)
+	{
+		pdat = (struct sub_block_pdata_t *)(blk->priv);
+		*offset += pdat->offset;
+		blk = pdat->pblk;
+	}
+	return blk;
+}
+
+static inline struct hlist_head * block_buffer_hash(struct block_t * blk, u64_t sector)
+{
+	return &__block_buffer_hash[(((unsigned long)blk >> 4) + (unsigned long)sector) & (BLOCK_BUFFER_HASH_SIZE - 1)];
+}
+
+static u64_t block_buffer_span(struct block_t * blk, u64_t sector, u64_t n)
+{
+	u64_t cap = blk->capacity(blk);
+	u64_t offset = sector << BLOCK_BUFFER_SHIFT;
+	u64_t length = n << BLOCK_BUFFER_SHIFT;
+
+	if(offset >= cap)
+		return 0;
+	if(offset + length > cap)
+		return cap - offset;
+	return length;
+}
+
+/*
+ * Every device request issued by the cache funnels through here
+ */
+static u64_t block_queue_dispatch(struct block_t * blk, int write, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_queue_t * q = &blk->queue;
+	u64_t len;
+
+	if(write)
+	{
+		len = blk->write(blk, buf, offset, count);
+		q->stat.writes++;
+		q->stat.wbytes += len;
+	}
+	else
+	{
+		len = blk->read(blk, buf, offset, count);
+		q->stat.reads++;
+		q->stat.rbytes += len;
+	}
+	q->head = (offset + len) >> BLOCK_BUFFER_SHIFT;
+	return len;
+}
+
+static struct block_buffer_t * __block_buffer_find(struct block_t * blk, u64_t sector)
+{
+	struct block_buffer_t * b;
+
+	hlist_for_each_entry(b, block_buffer_hash(blk, sector), node)
+	{
+		if((b->blk == blk) && (b->sector == sector))
+			return b;
+	}
+	return NULL;
+}
+
+static struct block_buffer_t * __block_buffer_lookup(struct block_t * blk, u64_t sector)
+{
+	struct block_buffer_t * b;
+
+	b = __block_buffer_find(blk, sector);
+	if(b)
+		list_move_tail(&b->entry, &__block_buffer_lru);
+	return b;
+}
+
+static void __block_buffer_mark_dirty(struct block_buffer_t * b)
+{
+	if(!(b->flags & BLOCK_BUFFER_DIRTY))
+	{
+		b->flags |= BLOCK_BUFFER_DIRTY;
+		b->dirtied = ktime_get();
+		b->blk->queue.dirty += BLOCK_BUFFER_SIZE;
+		if((__block_dirty_bytes == 0) || (__block_dirty_bytes + BLOCK_BUFFER_SIZE >= CONFIG_BLOCK_WRITEBACK_THRESHOLD))
+			waitqueue_wakeup(&__block_writeback_wq);
+		__block_dirty_bytes += BLOCK_BUFFER_SIZE;
+	}
+}
+
+static void __block_buffer_mark_clean(struct block_buffer_t * b)
+{
+	if(b->flags & BLOCK_BUFFER_DIRTY)
+	{
+		b->flags &= ~BLOCK_BUFFER_DIRTY;
+		b->blk->queue.dirty -= BLOCK_BUFFER_SIZE;
+		__block_dirty_bytes -= BLOCK_BUFFER_SIZE;
+	}
+}
+
+/*
+ * A sector the device failed to take stays dirty, so a later flush tries it again
+ */
+static int __block_buffer_writeback(struct block_buffer_t * b)
+{
+	u64_t len;
+
+	len = block_buffer_span(b->blk, b->sector, 1);
+	if((len > 0) && (block_queue_dispatch(b->blk, 1, b->data, b->sector << BLOCK_BUFFER_SHIFT, len) != len))
+		return -1;
+	__block_buffer_mark_clean(b);
+	return 0;
+}
+
+static struct block_buffer_t * __block_buffer_alloc(struct block_t * blk, u64_t sector)
+{
+	struct block_buffer_t * b = NULL, * pos;
+
+	if(__block_buffer_count < CONFIG_BLOCK_BUFFER_COUNT)
+	{
+		b = malloc(sizeof(struct block_buffer_t));
+		if(b)
+			__block_buffer_count++;
+	}
+	if(!b)
+	{
+		list_for_each_entry(pos, &__block_buffer_lru, entry)
+		{
+			if((pos->ref == 0) && (!(pos->flags & BLOCK_BUFFER_DIRTY) || !__block_buffer_writeback(pos)))
+			{
+				b = pos;
+				break;
+			}
+		}
+		if(!b)
+			return NULL;
+		list_del(&b->entry);
+		hlist_del(&b->node);
+	}
+	b->blk = blk;
+	b->sector = sector;
+	b->flags = 0;
+	b->ref = 0;
+	hlist_add_head(&b->node, block_buffer_hash(blk, sector));
+	list_add_tail(&b->entry, &__block_buffer_lru);
+
+	return b;
+}
+
+static void __block_buffer_drop(struct block_buffer_t * b)
+{
+	list_del(&b->entry);
+	hlist_del_init(&b->node);
+	free(b);
+	__block_buffer_count--;
+}
+
+/*
+ * Read n consecutive uncached sectors, plus up to ra readahead sectors, with a single device request
+ */
+static void __block_buffer_fill(struct block_t * blk, u64_t sector, u64_t n, u64_t ra)
+{
+	struct block_buffer_t * b;
+	u8_t * bounce;
+	u64_t span, len, o, i;
+
+	for(i = 0; (i < ra) && !__block_buffer_find(blk, sector + n + i); i++);
+	ra = i;
+	span = block_buffer_span(blk, sector, n + ra);
+	if(span <= 0)
+		return;
+	ra = ((span + BLOCK_BUFFER_SIZE - 1) >> BLOCK_BUFFER_SHIFT) - n;
+	if(n + ra == 1)
+	{
+		b = __block_buffer_alloc(blk, sector);
+		if(b)
+		{
+			if(block_queue_dispatch(blk, 0, b->data, sector << BLOCK_BUFFER_SHIFT, span) == span)
+			{
+				memset(b->data + span, 0, BLOCK_BUFFER_SIZE - span);
+				b->flags = BLOCK_BUFFER_UPTODATE;
+			}
+			else
+			{
+				__block_buffer_drop(b);
+			}
+		}
+		return;
+	}
+
+	bounce = malloc((n + ra) << BLOCK_BUFFER_SHIFT);
+	if(!bounce)
+		return;
+	len = block_queue_dispatch(blk, 0, bounce, sector << BLOCK_BUFFER_SHIFT, span);
+	for(i = 0; i < n + ra; i++)
+	{
+		o = i << BLOCK_BUFFER_SHIFT;
+		if((o >= len) || ((len < span) && (o + BLOCK_BUFFER_SIZE > len)))
+			break;
+		b = __block_buffer_alloc(blk, sector + i);
+		if(!b)
+			break;
+		if(o + BLOCK_BUFFER_SIZE > len)
+		{
+			memcpy(b->data, bounce + o, len - o);
+			memset(b->data + (len - o), 0, BLOCK_BUFFER_SIZE - (len - o));
+		}
+		else
+		{
+			memcpy(b->data, bounce + o, BLOCK_BUFFER_SIZE);
+		}
+		if(i < n)
+		{
+			b->flags = BLOCK_BUFFER_UPTODATE;
+		}
+		else
+		{
+			b->flags = BLOCK_BUFFER_UPTODATE | BLOCK_BUFFER_READAHEAD;
+			blk->queue.stat.ra_sectors++;
+		}
+	}
+	free(bounce);
+}
+
+/*
+ * Keep cached sectors coherent with a transfer that went straight to the device
+ */
+static void __block_buffer_overlay(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count, int write)
+{
+	struct block_buffer_t * b;
+	u64_t s, so, start, end;
+
+	if((count <= 0) || (__block_buffer_count <= 0))
+		return;
+	for(s = offset >> BLOCK_BUFFER_SHIFT; (s << BLOCK_BUFFER_SHIFT) < offset + count; s++)
+	{
+		b = __block_buffer_find(blk, s);
+		if(!b)
+			continue;
+		so = s << BLOCK_BUFFER_SHIFT;
+		start = max(so, offset);
+		end = min(so + BLOCK_BUFFER_SIZE, offset + count);
+		if(write)
+		{
+			memcpy(b->data + (start - so), buf + (start - offset), end - start);
+		}
+		else if(b->flags & BLOCK_BUFFER_DIRTY)
+		{
+			memcpy(buf + (start - offset), b->data + (start - so), end - start);
+		}
+	}
+}
+
+/*
+ * Once a write has reached the device, the cached sectors it fully covered are clean,
+ * unless they were written again meanwhile and no longer hold the same data
+ */
+static void __block_buffer_settle(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_buffer_t * b;
+	u64_t s, so, len;
+
+	if((count <= 0) || (__block_buffer_count <= 0))
+		return;
+	for(s = (offset + BLOCK_BUFFER_SIZE - 1) >> BLOCK_BUFFER_SHIFT; (s << BLOCK_BUFFER_SHIFT) < offset + count; s++)
+	{
+		b = __block_buffer_find(blk, s);
+		if(!b || !(b->flags & BLOCK_BUFFER_DIRTY))
+			continue;
+		so = s << BLOCK_BUFFER_SHIFT;
+		len = block_buffer_span(blk, s, 1);
+		if((so + len <= offset + count) && (memcmp(b->data, buf + (so - offset), len) == 0))
+			__block_buffer_mark_clean(b);
+	}
+}
+
+static int block_buffer_cmp(const void * a, const void * b)
+{
+	u64_t x = (*(struct block_buffer_t **)a)->sector;
+	u64_t y = (*(struct block_buffer_t **)b)->sector;
+
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static int __block_buffer_write_run(struct block_t * blk, struct block_buffer_t ** list, int n, u8_t * bounce)
+{
+	u64_t len;
+	int k;
+
+	if(n == 1)
+		return __block_buffer_writeback(list[0]);
+	for(k = 0; k < n; k++)
+		memcpy(bounce + (k << BLOCK_BUFFER_SHIFT), list[k]->data, BLOCK_BUFFER_SIZE);
+	len = block_buffer_span(blk, list[0]->sector, n);
+	if((len > 0) && (block_queue_dispatch(blk, 1, bounce, list[0]->sector << BLOCK_BUFFER_SHIFT, len) != len))
+		return -1;
+	blk->queue.stat.merged += n - 1;
+	for(k = 0; k < n; k++)
+		__block_buffer_mark_clean(list[k]);
+	return 0;
+}
+
+/*
+ * Write back every dirty sector of a device with a C-LOOK elevator, sweeping upwards
+ * from the current head position and wrapping around once, adjacent sectors in one request
+ */
+static int __block_buffer_flush(struct block_t * blk)
+{
+	struct block_buffer_t ** list, * b;
+	u8_t * bounce;
+	int count = 0, err = 0;
+	int h, i, j, lo, hi, pass;
+
+	list_for_each_entry(b, &__block_buffer_lru, entry)
+	{
+		if((b->blk == blk) && (b->flags & BLOCK_BUFFER_DIRTY))
+			count++;
+	}
+	if(count <= 0)
+		return 0;
+
+	list = malloc(count * sizeof(struct block_buffer_t *));
+	bounce = malloc(BLOCK_BUFFER_BATCH << BLOCK_BUFFER_SHIFT);
+	if(!list || !bounce)
+	{
+		list_for_each_entry(b, &__block_buffer_lru, entry)
+		{
+			if((b->blk == blk) && (b->flags & BLOCK_BUFFER_DIRTY) && __block_buffer_writeback(b))
+				err = -1;
+		}
+		free(list);
+		free(bounce);
+		return err;
+	}
+
+	i = 0;
+	list_for_each_entry(b, &__block_buffer_lru, entry)
+	{
+		if((b->blk == blk) && (b->flags & BLOCK_BUFFER_DIRTY))
+			list[i++] = b;
+	}
+	qsort(list, count, sizeof(struct block_buffer_t *), block_buffer_cmp);
+
+	for(h = 0; (h < count) && (list[h]->sector < blk->queue.head); h++);
+	for(pass = 0; pass < 2; pass++)
+	{
+		lo = pass ? 0 : h;
+		hi = pass ? h : count;
+		for(i = lo; i < hi; i = j)
+		{
+			for(j = i + 1; (j < hi) && (j - i < BLOCK_BUFFER_BATCH) && (list[j]->sector == list[j - 1]->sector + 1); j++);
+			if(__block_buffer_write_run(blk, &list[i], j - i, bounce))
+				err = -1;
+		}
+	}
+	free(list);
+	free(bounce);
+	return err;
+}
+
+/*
+ * Drop every sector of a device going away. Buffers still held through block_buffer_get
+ * are unhashed and detached from the device instead, the last block_buffer_put frees them.
+ */
+static void block_buffer_invalidate(struct block_t * blk)
+{
+	struct block_buffer_t * pos, * n;
+
+	mutex_lock(&__block_buffer_lock);
+	__block_buffer_flush(blk);
+	list_for_each_entry_safe(pos, n, &__block_buffer_lru, entry)
+	{
+		if(pos->blk != blk)
+			continue;
+		if(pos->ref > 0)
+		{
+			__block_buffer_mark_clean(pos);
+			hlist_del_init(&pos->node);
+			pos->blk = NULL;
+		}
+		else
+		{
+			__block_buffer_drop(pos);
+		}
+	}
+	mutex_unlock(&__block_buffer_lock);
+}
+
+/*
+ * Write back the dirty sectors a device request is about to read around
+ */
+static void __block_buffer_writeback_range(struct block_t * blk, u64_t offset, u64_t count)
+{
+	struct block_buffer_t * b;
+	u64_t s;
+
+	if((count <= 0) || (__block_buffer_count <= 0))
+		return;
+	for(s = offset >> BLOCK_BUFFER_SHIFT; (s << BLOCK_BUFFER_SHIFT) < offset + count; s++)
+	{
+		b = __block_buffer_find(blk, s);
+		if(b && (b->flags & BLOCK_BUFFER_DIRTY))
+			__block_buffer_writeback(b);
+	}
+}
+
+static u64_t block_cache_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_queue_t * q = &blk->queue;
+	struct block_buffer_t * b;
+	u64_t s, e, o, l, n, r;
+	u64_t pos = 0;
+	int seq;
+
+	mutex_lock(&__block_buffer_lock);
+	seq = ((offset >> BLOCK_BUFFER_SHIFT) == q->ra_next) ? 1 : 0;
+	q->ra_next = (offset + count) >> BLOCK_BUFFER_SHIFT;
+	if(count >= CONFIG_BLOCK_BUFFER_BYPASS)
+	{
+		pos = block_queue_dispatch(blk, 0, buf, offset, count);
+		__block_buffer_overlay(blk, buf, offset, pos, 0);
+	}
+	else
+	{
+		e = (offset + count - 1) >> BLOCK_BUFFER_SHIFT;
+		for(s = offset >> BLOCK_BUFFER_SHIFT; s <= e; s++)
+		{
+			o = (offset + pos) & (BLOCK_BUFFER_SIZE - 1);
+			l = min((u64_t)(BLOCK_BUFFER_SIZE - o), count - pos);
+			b = __block_buffer_lookup(blk, s);
+			if(b)
+			{
+				q->stat.hits++;
+				if(b->flags & BLOCK_BUFFER_READAHEAD)
+				{
+					b->flags &= ~BLOCK_BUFFER_READAHEAD;
+					q->stat.ra_hits++;
+				}
+			}
+			else
+			{
+				/*
+				 * Adaptive readahead, the window doubles while the stream stays sequential
+				 */
+				if(seq)
+					q->ra_window = q->ra_window ? min(q->ra_window << 1, (u64_t)BLOCK_READAHEAD_MAX) : BLOCK_READAHEAD_MIN;
+				else
+					q->ra_window = 0;
+				q->stat.misses++;
+				for(n = 1; (s + n <= e) && (n < BLOCK_BUFFER_BATCH) && !__block_buffer_find(blk, s + n); n++);
+				__block_buffer_fill(blk, s, n, (s + n > e) ? q->ra_window : 0);
+				b = __block_buffer_lookup(blk, s);
+			}
+			if(b)
+			{
+				memcpy(buf + pos, b->data + o, l);
+			}
+			else
+			{
+				r = block_queue_dispatch(blk, 0, buf + pos, offset + pos, l);
+				if(r != l)
+				{
+					pos += r;
+					break;
+				}
+			}
+			pos += l;
+		}
+	}
+	mutex_unlock(&__block_buffer_lock);
+
+	return pos;
+}
+
+static u64_t block_cache_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
+{
+	struct block_buffer_t * b;
+	u64_t s, e, o, l, w;
+	u64_t pos = 0;
+
+	mutex_lock(&__block_buffer_lock);
+	if(count >= CONFIG_BLOCK_BUFFER_BYPASS)
+	{
+		pos = block_queue_dispatch(blk, 1, buf, offset, count);
+		__block_buffer_overlay(blk, buf, offset, pos, 1);
+		__block_buffer_settle(blk, buf, offset, pos);
+	}
+	else
+	{
+		e = (offset + count - 1) >> BLOCK_BUFFER_SHIFT;
+		for(s = offset >> BLOCK_BUFFER_SHIFT; s <= e; s++)
+		{
+			o = (offset + pos) & (BLOCK_BUFFER_SIZE - 1);
+			l = min((u64_t)(BLOCK_BUFFER_SIZE - o), count - pos);
+			b = __block_buffer_lookup(blk, s);
+			if(!b)
+			{
+				if((o == 0) && (l >= block_buffer_span(blk, s, 1)))
+				{
+					b = __block_buffer_alloc(blk, s);
+					if(b)
+					{
+						memset(b->data + l, 0, BLOCK_BUFFER_SIZE - l);
+						b->flags = BLOCK_BUFFER_UPTODATE;
+					}
+				}
+				else
+				{
+					__block_buffer_fill(blk, s, 1, 0);
+					b = __block_buffer_lookup(blk, s);
+				}
+			}
+			if(b)
+			{
+				memcpy(b->data + o, buf + pos, l);
+				__block_buffer_mark_dirty(b);
+			}
+			else
+			{
+				w = block_queue_dispatch(blk, 1, buf + pos, offset + pos, l);
+				if(w != l)
+				{
+					pos += w;
+					break;
+				}
+			}
+			pos += l;
+		}
+	}
+	mutex_unlock(&__block_buffer_lock);
+
+	return pos;
+}
+
 struct block_t * search_block(const char * name)
 {
 	struct device_t * dev;
@@ -92,12 +674,14 @@ struct device_t * register_block(struct block_t * blk, struct driver_t * drv)
 	if(!dev)
 		return NULL;
 
+	memset(&blk->queue, 0, sizeof(struct block_queue_t));
 	dev->name = strdup(blk->name);
 	dev->type = DEVICE_TYPE_BLOCK;
 	dev->driver = drv;
 	dev->priv = blk;
 	dev->kobj = kobj_alloc_directory(dev->name);
 	kobj_add_regular(dev->kobj, "capacity", block_read_capacity, NULL, blk);
+	kobj_add_regular(dev->kobj, "stats", block_read_stats, NULL, blk);
 
 	if(!register_device(dev))
 	{
@@ -118,6 +702,8 @@ void unregister_block(struct block_t * blk)
 		dev = search_device(blk->name, DEVICE_TYPE_BLOCK);
 		if(dev && unregister_device(dev))
 		{
+			if(blk->read != sub_block_read)
+				block_buffer_invalidate(blk);
 			kobj_remove_self(dev->kobj);
 			free(dev->name);
 			free(dev);
@@ -162,6 +748,8 @@ struct device_t * register_sub_block(struct block_t * pblk, u64_t offset, u64_t
 	blk->read = sub_block_read;
 	blk->write = sub_block_write;
 	blk->sync = sub_block_sync;
+	blk->map = pblk->map ? sub_block_map : NULL;
+	blk->submit = NULL;
 	blk->priv = pdat;
 
 	if(!(dev = register_block(blk, NULL)))
@@ -209,32 +797,401 @@ u64_t block_capacity(struct block_t * blk)
 
 u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 {
+	struct block_t * root;
 	u64_t l;
 
 	if(blk && buf)
 	{
 		l = block_available(blk, offset, count);
 		if(l > 0)
-			return blk->read(blk, buf, offset, l);
+		{
+			root = block_root(blk, &offset);
+			if(root->map)
+				return block_queue_dispatch(root, 0, buf, offset, l);
+			return block_cache_read(root, buf, offset, l);
+		}
 	}
 	return 0;
 }
 
 u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count)
 {
+	struct block_t * root;
 	u64_t l;
 
 	if(blk && buf)
 	{
 		l = block_available(blk, offset, count);
 		if(l > 0)
-			return blk->write(blk, buf, offset, l);
+		{
+			root = block_root(blk, &offset);
+			if(root->map)
+				return block_queue_dispatch(root, 1, buf, offset, l);
+			return block_cache_write(root, buf, offset, l);
+		}
 	}
 	return 0;
 }
 
-void block_sync(struct block_t * blk)
+int block_sync(struct block_t * blk)
 {
+	struct block_t * root;
+	u64_t offset = 0;
+	int err = 0;
+
 	if(blk)
+	{
+		root = block_root(blk, &offset);
+		mutex_lock(&__block_buffer_lock);
+		err = __block_buffer_flush(root);
+		mutex_unlock(&__block_buffer_lock);
 		blk->sync(blk);
+	}
+	return err;
+}
+
+/*
+ * Bytes of cached data not yet written back, for one device or for all when null
+ */
+u64_t block_dirty(struct block_t * blk)
+{
+	u64_t offset = 0;
+
+	if(blk)
+		return block_root(blk, &offset)->queue.dirty;
+	return __block_dirty_bytes;
+}
+
+/*
+ * Direct pointer into a memory backed device, or null if the range can't be mapped
+ */
+void * block_map(struct block_t * blk, u64_t offset, u64_t count)
+{
+	if(blk && blk->map && (offset < blk->capacity(blk)) && (block_available(blk, offset, count) == count))
+		return blk->map(blk, offset, count);
+	return NULL;
+}
+
+void block_request_init(struct block_request_t * req, struct block_t * blk, int op, u8_t * buf, u64_t offset, u64_t count, void (*complete)(struct block_request_t *), void * data)
+{
+	if(req)
+	{
+		init_list_head(&req->entry);
+		req->blk = blk;
+		req->op = op;
+		req->buf = buf;
+		req->offset = offset;
+		req->count = count;
+		req->done = 0;
+		req->settle = 0;
+		req->complete = complete;
+		req->data = data;
+		future_init(&req->future);
+	}
+}
+
+/*
+ * Queue a request and return at once. Drivers with a submit hook get large transfers
+ * directly, after the cache has been made coherent with the range. Memory backed devices
+ * complete in place, everything else is run by the block request task in chunks.
+ */
+bool_t block_submit(struct block_request_t * req)
+{
+	struct block_t * root;
+	u64_t offset;
+	irq_flags_t flags;
+
+	if(!req || !req->blk || !req->buf)
+		return FALSE;
+
+	future_reset(&req->future);
+	req->done = 0;
+	req->settle = 0;
+	req->count = block_available(req->blk, req->offset, req->count);
+	if(req->count <= 0)
+	{
+		block_request_complete(req, 0);
+		return TRUE;
+	}
+
+	offset = req->offset;
+	root = block_root(req->blk, &offset);
+	if(root->map)
+	{
+		if(req->op == BLOCK_REQUEST_WRITE)
+			block_request_complete(req, block_queue_dispatch(root, 1, req->buf, offset, req->count));
+		else
+			block_request_complete(req, block_queue_dispatch(root, 0, req->buf, offset, req->count));
+		return TRUE;
+	}
+	if(root->submit && (req->count >= CONFIG_BLOCK_BUFFER_BYPASS))
+	{
+		mutex_lock(&__block_buffer_lock);
+		if(req->op == BLOCK_REQUEST_WRITE)
+		{
+			__block_buffer_overlay(root, req->buf, offset, req->count, 1);
+			root->queue.stat.writes++;
+			root->queue.stat.wbytes += req->count;
+		}
+		else
+		{
+			__block_buffer_writeback_range(root, offset, req->count);
+			root->queue.stat.reads++;
+			root->queue.stat.rbytes += req->count;
+		}
+		root->queue.head = (offset + req->count) >> BLOCK_BUFFER_SHIFT;
+		mutex_unlock(&__block_buffer_lock);
+		req->blk = root;
+		req->offset = offset;
+		req->settle = (req->op == BLOCK_REQUEST_WRITE) ? 1 : 0;
+		if(root->submit(root, req) >= 0)
+			return TRUE;
+		req->settle = 0;
+	}
+
+	spin_lock_irqsave(&__block_request_lock, flags);
+	list_add_tail(&req->entry, &__block_request_list);
+	spin_unlock_irqrestore(&__block_request_lock, flags);
+	waitqueue_wakeup(&__block_request_wq);
+	return TRUE;
+}
+
+/*
+ * Called by whoever finished the transfer, may be an interrupt handler. A write that
+ * bypassed the buffers is handed to the request task first, which marks the sectors
+ * it covered clean under the buffer lock. The callback is the last access to req.
+ */
+void block_request_complete(struct block_request_t * req, u64_t done)
+{
+	void (*complete)(struct block_request_t *);
+	irq_flags_t flags;
+
+	if(req)
+	{
+		req->done = done;
+		if(req->settle)
+		{
+			if(done == req->count)
+			{
+				spin_lock_irqsave(&__block_request_lock, flags);
+				list_add(&req->entry, &__block_request_list);
+				spin_unlock_irqrestore(&__block_request_lock, flags);
+				waitqueue_wakeup(&__block_request_wq);
+				return;
+			}
+			req->settle = 0;
+		}
+		complete = req->complete;
+		future_set(&req->future, req);
+		if(complete)
+			complete(req);
+	}
+}
+
+bool_t block_request_poll(struct block_request_t * req)
+{
+	return req ? future_poll(&req->future, NULL) : FALSE;
+}
+
+u64_t block_request_wait(struct block_request_t * req)
+{
+	if(!req)
+		return 0;
+	future_get(&req->future);
+	return req->done;
+}
+
+static void block_request_task(struct task_t * task, void * data)
+{
+	struct block_request_t * req;
+	irq_flags_t flags;
+	u64_t pos, l, r;
+
+	while(1)
+	{
+		spin_lock_irqsave(&__block_request_lock, flags);
+		req = list_first_entry_or_null(&__block_request_list, struct block_request_t, entry);
+		if(req)
+			list_del_init(&req->entry);
+		spin_unlock_irqrestore(&__block_request_lock, flags);
+
+		if(!req)
+		{
+			waitqueue_prepare(&__block_request_wq);
+			if(list_empty(&__block_request_list))
+				task_schedule();
+			waitqueue_finish(&__block_request_wq);
+			continue;
+		}
+
+		if(req->settle)
+		{
+			mutex_lock(&__block_buffer_lock);
+			__block_buffer_settle(req->blk, req->buf, req->offset, req->done);
+			mutex_unlock(&__block_buffer_lock);
+			req->settle = 0;
+			block_request_complete(req, req->done);
+			continue;
+		}
+
+		for(pos = 0; pos < req->count; pos += r)
+		{
+			l = min(req->count - pos, (u64_t)CONFIG_BLOCK_REQUEST_CHUNK);
+			if(req->op == BLOCK_REQUEST_WRITE)
+				r = block_write(req->blk, req->buf + pos, req->offset + pos, l);
+			else
+				r = block_read(req->blk, req->buf + pos, req->offset + pos, l);
+			if(r != l)
+			{
+				pos += r;
+				break;
+			}
+			task_yield();
+		}
+		block_request_complete(req, pos);
+	}
+}
+
+/*
+ * Flush every device holding a dirty sector older than the expire time,
+ * each one as a whole so its neighbours go out in the same sweep
+ */
+static int __block_buffer_flush_expired(ktime_t expire)
+{
+	struct block_buffer_t * b;
+	struct block_t * blk;
+
+	do {
+		blk = NULL;
+		list_for_each_entry(b, &__block_buffer_lru, entry)
+		{
+			if((b->flags & BLOCK_BUFFER_DIRTY) && !ktime_after(b->dirtied, expire))
+			{
+				blk = b->blk;
+				break;
+			}
+		}
+		if(blk)
+		{
+			blk->queue.stat.writebacks++;
+			if(__block_buffer_flush(blk))
+				return -1;
+		}
+	} while(blk);
+	return 0;
+}
+
+static int block_writeback_timer_function(struct timer_t * timer, void * data)
+{
+	waitqueue_wakeup(&__block_writeback_wq);
+	return 0;
+}
+
+/*
+ * Dirty sectors stay cached until they are old enough or there are too many of them,
+ * so repeated small writes to the same sectors reach the flash only once
+ */
+static void block_writeback_task(struct task_t * task, void * data)
+{
+	int err;
+
+	while(1)
+	{
+		waitqueue_prepare(&__block_writeback_wq);
+		if(__block_dirty_bytes < CONFIG_BLOCK_WRITEBACK_THRESHOLD)
+		{
+			if(__block_dirty_bytes > 0)
+				timer_start(&__block_writeback_timer, ms_to_ktime(CONFIG_BLOCK_WRITEBACK_INTERVAL));
+			task_schedule();
+			timer_cancel(&__block_writeback_timer);
+		}
+		waitqueue_finish(&__block_writeback_wq);
+
+		mutex_lock(&__block_buffer_lock);
+		if(__block_dirty_bytes >= CONFIG_BLOCK_WRITEBACK_THRESHOLD)
+			err = __block_buffer_flush_expired(ktime_get());
+		else
+			err = __block_buffer_flush_expired(ktime_sub_ms(ktime_get(), CONFIG_BLOCK_WRITEBACK_AGE));
+		mutex_unlock(&__block_buffer_lock);
+
+		/* Back off from a failing device rather than retrying it back to back */
+		if(err)
+			task_sleep(ms_to_ktime(CONFIG_BLOCK_WRITEBACK_INTERVAL));
+	}
+}
+
+/*
+ * Pin one cached sector for in place access, mapped devices are never buffered
+ */
+struct block_buffer_t * block_buffer_get(struct block_t * blk, u64_t sector)
+{
+	struct block_buffer_t * b = NULL;
+	struct block_t * root;
+	u64_t offset = sector << BLOCK_BUFFER_SHIFT;
+
+	if(blk && (offset < blk->capacity(blk)))
+	{
+		root = block_root(blk, &offset);
+		if(!root->map && ((offset & (BLOCK_BUFFER_SIZE - 1)) == 0))
+		{
+			mutex_lock(&__block_buffer_lock);
+			b = __block_buffer_lookup(root, offset >> BLOCK_BUFFER_SHIFT);
+			if(!b)
+			{
+				__block_buffer_fill(root, offset >> BLOCK_BUFFER_SHIFT, 1, 0);
+				b = __block_buffer_lookup(root, offset >> BLOCK_BUFFER_SHIFT);
+			}
+			if(b)
+				b->ref++;
+			mutex_unlock(&__block_buffer_lock);
+		}
+	}
+	return b;
+}
+
+void block_buffer_put(struct block_buffer_t * b)
+{
+	if(b)
+	{
+		mutex_lock(&__block_buffer_lock);
+		if(b->ref > 0)
+			b->ref--;
+		if(!b->blk && (b->ref == 0))
+			__block_buffer_drop(b);
+		mutex_unlock(&__block_buffer_lock);
+	}
+}
+
+void block_buffer_dirty(struct block_buffer_t * b)
+{
+	if(b)
+	{
+		mutex_lock(&__block_buffer_lock);
+		if(b->blk)
+			__block_buffer_mark_dirty(b);
+		mutex_unlock(&__block_buffer_lock);
+	}
+}
+
+static __init void block_pure_init(void)
+{
+	int i;
+
+	for(i = 0; i < ARRAY_SIZE(__block_buffer_hash); i++)
+		init_hlist_head(&__block_buffer_hash[i]);
+	init_list_head(&__block_buffer_lru);
+	mutex_init(&__block_buffer_lock);
+	init_list_head(&__block_request_list);
+	waitqueue_init(&__block_request_wq);
+	spin_lock_init(&__block_request_lock);
+	waitqueue_init(&__block_writeback_wq);
+	timer_init(&__block_writeback_timer, block_writeback_timer_function, NULL);
+}
+pure_initcall(block_pure_init);
+
+static __init void block_request_init_task(void)
+{
+	task_create(NULL, "kblockd", NULL, NULL, block_request_task, NULL, 0, 0);
+	task_create(NULL, "kflushd", NULL, NULL, block_writeback_task, NULL, 0, 0);
 }
+postcore_initcall(block_request_init_task);
@@ -192,9 +192,9 @@ bool_t clockevent_set_event_next(struct clockevent_t * ce, ktime_t now, ktime_t
 		return FALSE;
 
 	if(ktime_before(expires, now))
-		return FALSE;
-
-	delta = ktime_to_ns(ktime_sub(expires, now));
+		delta = 0;
+	else
+		delta = ktime_to_ns(ktime_sub(expires, now));
 	if(delta > ce->max_delta_ns)
 		delta = ce->max_delta_ns;
 	if(delta < ce->min_delta_ns)
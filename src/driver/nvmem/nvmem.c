@@ -136,6 +136,7 @@ static void nvmem_init_kvdb(struct nvmem_t * m)
 	if(m)
 	{
 		timer_init(&m->kvdb.timer, kvdb_timer_function, m);
+		timer_set_slack(&m->kvdb.timer, ms_to_ktime(1000));
 		m->kvdb.map = hmap_alloc(0);
 		spin_lock_init(&m->kvdb.lock);
 		m->kvdb.dirty = 0;
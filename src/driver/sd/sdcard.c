@@ -830,6 +830,8 @@ static void sdcard_scan(struct sdcard_pdata_t * pdat)
 				pdat->blk.read = sdcard_blk_read;
 				pdat->blk.write = sdcard_blk_write;
 				pdat->blk.sync = sdcard_blk_sync;
+				pdat->blk.map = NULL;
+				pdat->blk.submit = NULL;
 				pdat->blk.priv = pdat;
 				if(register_block(&pdat->blk, NULL))
 				{
@@ -880,6 +882,7 @@ void * sdcard_probe(struct sdhci_t * hci)
 	if(pdat->hci->removable)
 	{
 		timer_init(&pdat->timer, sdcard_timer_function, pdat);
+		timer_set_slack(&pdat->timer, ms_to_ktime(250));
 		timer_start(&pdat->timer, ms_to_ktime(2000));
 	}
 	return pdat;
@@ -0,0 +1,38 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+
+struct arena_chunk_t {
+	struct arena_chunk_t * prev;
+	size_t size;
+	size_t used;
+};
+
+struct arena_t {
+	struct arena_chunk_t * chunk;
+	size_t chunksz;
+};
+
+struct arena_mark_t {
+	struct arena_chunk_t * chunk;
+	size_t used;
+};
+
+struct arena_t * arena_alloc(size_t chunksz);
+void arena_free(struct arena_t * a);
+void * arena_malloc(struct arena_t * a, size_t size);
+void * arena_zalloc(struct arena_t * a, size_t size);
+void arena_reset(struct arena_t * a);
+struct arena_mark_t arena_mark(struct arena_t * a);
+void arena_release(struct arena_t * a, struct arena_mark_t m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ARENA_H__ */
@@ -7,6 +7,54 @@ extern "C" {
 
 #include <xboot.h>
 
+struct block_queue_t
+{
+	u64_t head;
+	u64_t ra_next;
+	u64_t ra_window;
+	u64_t dirty;
+
+	struct {
+		u64_t reads;
+		u64_t writes;
+		u64_t rbytes;
+		u64_t wbytes;
+		u64_t hits;
+		u64_t misses;
+		u64_t merged;
+		u64_t ra_sectors;
+		u64_t ra_hits;
+		u64_t writebacks;
+	} stat;
+};
+
+struct block_t;
+
+enum {
+	BLOCK_REQUEST_READ		= 0,
+	BLOCK_REQUEST_WRITE		= 1,
+};
+
+struct block_request_t
+{
+	struct list_head entry;
+	struct block_t * blk;
+	int op;
+	u8_t * buf;
+	u64_t offset;
+	u64_t count;
+	u64_t done;
+	int settle;
+
+	/*
+	 * Runs after the future is set and is the last access to the request, so it may
+	 * release it, in which case nobody may wait on the request
+	 */
+	void (*complete)(struct block_request_t * req);
+	void * data;
+	struct future_t future;
+};
+
 struct block_t
 {
 	char * name;
@@ -15,10 +63,33 @@ struct block_t
 	u64_t (*read)(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 	u64_t (*write)(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 	void (*sync)(struct block_t * blk);
+	void * (*map)(struct block_t * blk, u64_t offset, u64_t count);
+	int (*submit)(struct block_t * blk, struct block_request_t * req);
 
+	struct block_queue_t queue;
 	void * priv;
 };
 
+#define BLOCK_BUFFER_SIZE		(512)
+
+enum {
+	BLOCK_BUFFER_UPTODATE	= (1 << 0),
+	BLOCK_BUFFER_DIRTY		= (1 << 1),
+	BLOCK_BUFFER_READAHEAD	= (1 << 2),
+};
+
+struct block_buffer_t
+{
+	struct hlist_node node;
+	struct list_head entry;
+	struct block_t * blk;
+	u64_t sector;
+	int flags;
+	int ref;
+	ktime_t dirtied;
+	u8_t data[BLOCK_BUFFER_SIZE];
+};
+
 static inline u64_t block_available(struct block_t * blk, u64_t offset, u64_t length)
 {
 	u64_t cap;
@@ -42,7 +113,19 @@ void unregister_sub_block(struct block_t * pblk);
 u64_t block_capacity(struct block_t * blk);
 u64_t block_read(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
 u64_t block_write(struct block_t * blk, u8_t * buf, u64_t offset, u64_t count);
-void block_sync(struct block_t * blk);
+int block_sync(struct block_t * blk);
+void * block_map(struct block_t * blk, u64_t offset, u64_t count);
+u64_t block_dirty(struct block_t * blk);
+
+void block_request_init(struct block_request_t * req, struct block_t * blk, int op, u8_t * buf, u64_t offset, u64_t count, void (*complete)(struct block_request_t *), void * data);
+bool_t block_submit(struct block_request_t * req);
+void block_request_complete(struct block_request_t * req, u64_t done);
+bool_t block_request_poll(struct block_request_t * req);
+u64_t block_request_wait(struct block_request_t * req);
+
+struct block_buffer_t * block_buffer_get(struct block_t * blk, u64_t sector);
+void block_buffer_put(struct block_buffer_t * b);
+void block_buffer_dirty(struct block_buffer_t * b);
 
 #ifdef __cplusplus
 }
@@ -8,6 +8,7 @@ extern "C" {
 #include <types.h>
 #include <stdint.h>
 
+struct arena_t;
 struct json_value_t;
 struct json_object_entry_t;
 
@@ -50,6 +51,7 @@ struct json_value_t {
 	union {
 		struct json_value_t * next_alloc;
 		void * object_mem;
+		struct arena_t * arena;
 	} reserved;
 };
 
@@ -25,6 +25,12 @@ void * calloc(size_t nmemb, size_t size);
 void free(void * ptr);
 void meminfo(size_t * mused, size_t * mfree);
 
+struct kmem_cache_t;
+struct kmem_cache_t * kmem_cache_create(const char * name, size_t size, size_t align);
+void kmem_cache_destroy(struct kmem_cache_t * c);
+void * kmem_cache_alloc(struct kmem_cache_t * c);
+void kmem_cache_free(struct kmem_cache_t * c, void * obj);
+
 void do_init_mem(void);
 
 #ifdef __cplusplus
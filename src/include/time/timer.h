@@ -5,10 +5,15 @@
 extern "C" {
 #endif
 
+#include <list.h>
 #include <rbtree_augmented.h>
 #include <clockevent/clockevent.h>
 #include <xboot/ktime.h>
 
+#define TIMER_WHEEL_BITS		(6)
+#define TIMER_WHEEL_SIZE		(1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_DEPTH		(4)
+
 struct timer_base_t;
 struct timer_t;
 
@@ -21,15 +26,26 @@ enum timer_state_t {
 struct timer_base_t {
 	struct rb_root head;
 	struct timer_t * next;
+	struct hlist_head wheel[TIMER_WHEEL_DEPTH * TIMER_WHEEL_SIZE];
+	u32_t pending[TIMER_WHEEL_DEPTH * TIMER_WHEEL_SIZE / 32];
+	u64_t clk;
+	u64_t wnext;
+	int wcount;
+	ktime_t event;
 	struct clockevent_t * ce;
 	spinlock_t lock;
 };
 
 struct timer_t {
 	struct rb_node node;
+	struct hlist_node entry;
 	struct timer_base_t * base;
 	enum timer_state_t state;
 	ktime_t expires;
+	ktime_t slack;
+	s64_t latest;
+	unsigned int idx;
+	int wheel;
 	void * data;
 	int (*function)(struct timer_t *, void *);
 };
@@ -37,6 +53,7 @@ struct timer_t {
 void timer_init(struct timer_t * timer, int (*function)(struct timer_t *, void *), void * data);
 void timer_start(struct timer_t * timer, ktime_t interval);
 void timer_forward(struct timer_t * timer, ktime_t interval);
+void timer_set_slack(struct timer_t * timer, ktime_t slack);
 void timer_cancel(struct timer_t * timer);
 
 void timer_bind_clockevent(struct clockevent_t * ce);
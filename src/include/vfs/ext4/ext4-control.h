@@ -56,6 +56,8 @@ struct ext4fs_control_t {
 u32_t ext4fs_current_timestamp(void);
 int ext4fs_devread(struct ext4fs_control_t * ctrl, u32_t blkno, u32_t blkoff, u32_t buf_len, char * buf);
 int ext4fs_devwrite(struct ext4fs_control_t * ctrl, u32_t blkno, u32_t blkoff, u32_t buf_len, char * buf);
+int ext4fs_devread_blkno(struct ext4fs_control_t * ctrl, u32_t blkno, u32_t index, u32_t * val);
+int ext4fs_devwrite_blkno(struct ext4fs_control_t * ctrl, u32_t blkno, u32_t index, u32_t val);
 int ext4fs_control_read_inode(struct ext4fs_control_t * ctrl, u32_t inode_no, struct ext2_inode_t * inode);
 int ext4fs_control_write_inode(struct ext4fs_control_t * ctrl, u32_t inode_no, struct ext2_inode_t * inode);
 int ext4fs_control_alloc_block(struct ext4fs_control_t * ctrl, u32_t inode_no, u32_t * blkno);
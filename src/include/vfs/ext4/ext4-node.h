@@ -11,6 +11,9 @@ extern "C" {
 
 /* Information for accessing a ext4fs file/directory */
 struct ext4fs_node_t {
+	/* Serialises cached block, indirect block and lookup table updates */
+	struct mutex_t lock;
+
 	/* Parent ext4fs control */
 	struct ext4fs_control_t * ctrl;
 
@@ -28,29 +31,15 @@ struct ext4fs_node_t {
 	bool_t cached_dirty;
 
 	/*
-	 * Indirect block
-	 * Allocated on demand. Must be freed in vpuf()
+	 * Indirect and double-indirect level1 block
+	 * Their block pointers are accessed in place in the block buffers
 	 */
-	u32_t * indir_block;
 	u32_t indir_blkno;
-	bool_t indir_dirty;
-
-	/* Double-Indirect level1 block
-	 * Allocated on demand. Must be freed in vput()
-	 */
-	u32_t * dindir1_block;
 	u32_t dindir1_blkno;
-	bool_t dindir1_dirty;
-
-	/* Double-Indirect level2 block
-	 * Allocated on demand. Must be freed in vput()
-	 */
-	u32_t * dindir2_block;
-	u32_t dindir2_blkno;
-	bool_t dindir2_dirty;
 
-	/* Child directory entry lookup table */
+	/* Child directory entry lookup table, the generation counts entry changes */
 	u32_t lookup_victim;
+	u32_t lookup_gen;
 	char lookup_name[EXT4_NODE_LOOKUP_SIZE][VFS_MAX_NAME];
 	struct ext2_dirent_t lookup_dent[EXT4_NODE_LOOKUP_SIZE];
 };
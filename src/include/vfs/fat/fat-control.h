@@ -7,7 +7,21 @@ extern "C" {
 
 #include <vfs/fat/fat.h>
 
-#define FAT_TABLE_CACHE_SIZE	(32)
+#define FAT_TABLE_CACHE_SIZE	(CONFIG_FAT_TABLE_CACHE_SIZE)
+#define FAT_TABLE_CACHE_NONE	(0xffffffff)
+#define FAT_FREE_MAP_CHUNK		(32)
+#define FAT_ALLOC_RUN			(16)
+
+/*
+ * A pinned block buffer of the first FAT, sect counts buffers from the FAT start
+ * and dirty means its mirror copies are not yet marked stale
+ */
+struct fatfs_fat_cache_t {
+	struct list_head entry;
+	u32_t sect;
+	bool_t dirty;
+	struct block_buffer_t * b;
+};
 
 /*
  * Information about a "mounted" FAT filesystem
@@ -42,12 +56,28 @@ struct fatfs_control_t {
 	/* FAT type */
 	enum fat_type_t type;
 
-	/* FAT sector cache */
+	/* FAT block buffer cache, most recently used first */
 	struct mutex_t fat_cache_lock;
-	u32_t fat_cache_victim;
-	bool_t fat_cache_dirty[FAT_TABLE_CACHE_SIZE];
-	u32_t fat_cache_num[FAT_TABLE_CACHE_SIZE];
-	u8_t * fat_cache_buf;
+	struct fatfs_fat_cache_t fat_cache[FAT_TABLE_CACHE_SIZE];
+	struct list_head fat_cache_lru;
+	u32_t fat_cache_dirty;
+	u32_t fat_cache_hits;
+	u32_t fat_cache_misses;
+
+	/* FAT sectors whose mirror copies are behind the first FAT */
+	u32_t * fat_mirror_map;
+
+	/* Free cluster bitmap, one bit per cluster set while in use */
+	u32_t * free_map;
+	u32_t free_count;
+	u32_t next_free;
+
+	/* FSInfo sector, zero if none */
+	u32_t fsinfo_sector;
+	bool_t fsinfo_dirty;
+
+	/* Statistics exported under the filesystem class */
+	struct kobj_t * kobj;
 };
 
 u32_t fatfs_pack_timestamp(u32_t year, u32_t mon, u32_t day, u32_t hour, u32_t min, u32_t sec);
@@ -7,11 +7,34 @@ extern "C" {
 
 #include <vfs/fat/fat.h>
 
+#define FAT_DINDEX_HASH_SIZE	(16)
+
+/*
+ * A run of physically contiguous clusters of a file
+ */
+struct fatfs_extent_t {
+	u32_t index;
+	u32_t clust;
+	u32_t count;
+};
+
+/*
+ * Name to directory entry mapping of an indexed directory
+ */
+struct fatfs_dindex_t {
+	struct hlist_node node;
+	u32_t off;
+	u32_t len;
+	char name[];
+};
 
 /*
  * Information for accessing a FAT file/directory
  */
 struct fatfs_node_t {
+	/* Serialises cached cluster, extent map and directory index updates */
+	struct mutex_t lock;
+
 	/* Parent FAT control */
 	struct fatfs_control_t * ctrl;
 
@@ -25,9 +48,19 @@ struct fatfs_node_t {
 	/* First cluster */
 	u32_t first_cluster;
 
-	/* Current cluster */
-	u32_t cur_cluster;
-	u32_t cur_pos;
+	/* Cluster chain extent map, built lazily up to the clusters accessed */
+	struct fatfs_extent_t * extents;
+	u32_t extent_count;
+	u32_t extent_size;
+	u32_t extent_clusters;
+	bool_t extent_done;
+
+	/* Directory entry index, built by the first lookup in a directory */
+	struct hlist_head * dindex;
+	u32_t dindex_size;
+	u32_t dindex_count;
+	u32_t dindex_end;
+	u32_t dindex_holes;
 
 	/* Cached clusters */
 	u8_t *cached_data;
@@ -39,6 +72,7 @@ u32_t fatfs_node_get_size(struct fatfs_node_t * node);
 u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf);
 u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf);
 int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos);
+void fatfs_node_reset_extents(struct fatfs_node_t * node);
 int fatfs_node_sync(struct fatfs_node_t * node);
 int fatfs_node_init(struct fatfs_control_t * ctrl, struct fatfs_node_t * node);
 int fatfs_node_exit(struct fatfs_node_t * node);
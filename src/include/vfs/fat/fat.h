@@ -129,6 +129,24 @@ struct fat_bootsec_t {
 	} ext;
 } __attribute__ ((packed));
 
+/*
+ * FSInfo sector for FAT32
+ */
+#define FAT_FSINFO_LEAD_SIGNATURE	(0x41615252)
+#define FAT_FSINFO_STRUCT_SIGNATURE	(0x61417272)
+#define FAT_FSINFO_TRAIL_SIGNATURE	(0xAA550000)
+#define FAT_FSINFO_UNKNOWN			(0xFFFFFFFF)
+
+struct fat_fsinfo_t {
+	u32_t lead_signature;
+	u8_t reserved1[480];
+	u32_t struct_signature;
+	u32_t free_count;
+	u32_t next_free;
+	u8_t reserved2[12];
+	u32_t trail_signature;
+} __attribute__ ((packed));
+
 /*
  * Directory entry attributes
  */
@@ -15,12 +15,15 @@ extern "C" {
 #include <spinlock.h>
 #include <xboot/kobj.h>
 #include <xboot/mutex.h>
+#include <xboot/rwlock.h>
 #include <xboot/initcall.h>
 
 #define VFS_MAX_PATH		(1024)
 #define	VFS_MAX_NAME		(256)
 #define VFS_MAX_FD			(256)
 #define VFS_NODE_HASH_SIZE	(256)
+#define VFS_DENTRY_HASH_SIZE	(256)
+#define VFS_DENTRY_MAX		(128)
 
 #define O_RDONLY			(1 << 0)
 #define O_WRONLY			(1 << 1)
@@ -105,6 +108,11 @@ enum vfs_dirent_type_t {
 	VDT_SOCK,
 };
 
+struct vfs_iovec_t {
+	void * iov_base;
+	u64_t iov_len;
+};
+
 struct vfs_dirent_t {
 	u64_t d_off;
 	u32_t d_reclen;
@@ -135,7 +143,7 @@ struct vfs_node_t {
 	char v_path[VFS_MAX_PATH];
 	enum vfs_node_flag_t v_flags;
 	enum vfs_node_type_t v_type;
-	struct mutex_t v_lock;
+	struct rwlock_t v_lock;
 	u64_t v_ctime;
 	u64_t v_atime;
 	u64_t v_mtime;
@@ -176,6 +184,9 @@ struct filesystem_t {
 
 	u64_t (*read)(struct vfs_node_t *, s64_t, void *, u64_t);
 	u64_t (*write)(struct vfs_node_t *, s64_t, void *, u64_t);
+	u64_t (*readv)(struct vfs_node_t *, s64_t, struct vfs_iovec_t *, int);
+	u64_t (*writev)(struct vfs_node_t *, s64_t, struct vfs_iovec_t *, int);
+	void * (*mmap)(struct vfs_node_t *, s64_t, u64_t);
 	int (*truncate)(struct vfs_node_t *, s64_t);
 	int (*sync)(struct vfs_node_t *);
 	int (*readdir)(struct vfs_node_t *, s64_t, struct vfs_dirent_t *);
@@ -204,6 +215,12 @@ int vfs_open(const char * path, u32_t flags, u32_t mode);
 int vfs_close(int fd);
 u64_t vfs_read(int fd, void * buf, u64_t len);
 u64_t vfs_write(int fd, void * buf, u64_t len);
+u64_t vfs_pread(int fd, void * buf, u64_t len, s64_t off);
+u64_t vfs_pwrite(int fd, void * buf, u64_t len, s64_t off);
+u64_t vfs_readv(int fd, struct vfs_iovec_t * iov, int iovcnt);
+u64_t vfs_writev(int fd, struct vfs_iovec_t * iov, int iovcnt);
+void * vfs_mmap(int fd, s64_t off, u64_t len);
+void vfs_munmap(void * addr);
 s64_t vfs_lseek(int fd, s64_t off, int whence);
 int vfs_fsync(int fd);
 int vfs_fchmod(int fd, u32_t mode);
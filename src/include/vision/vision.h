@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include <arena.h>
 #include <graphic/surface.h>
 
 enum vision_type_t {
@@ -21,6 +22,7 @@ struct vision_t
 	int npixel;
 	void * datas;
 	size_t ndata;
+	struct arena_t * scratch;
 };
 
 static inline int vision_type_get_bytes(enum vision_type_t type)
@@ -68,6 +70,7 @@ void vision_free(struct vision_t * v);
 struct vision_t * vision_clone(struct vision_t * v, int x, int y, int w, int h);
 void vision_convert(struct vision_t * v, enum vision_type_t type);
 void vision_clear(struct vision_t * v);
+void * vision_scratch(struct vision_t * v, size_t size);
 
 void vision_apply_surface(struct vision_t * v, struct surface_t * s);
 void surface_apply_vision(struct surface_t * s, struct vision_t * v);
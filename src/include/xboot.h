@@ -42,6 +42,7 @@ extern "C" {
 #include <slist.h>
 #include <hmap.h>
 #include <fifo.h>
+#include <arena.h>
 #include <queue.h>
 #include <ssize.h>
 #include <spring.h>
@@ -61,7 +62,9 @@ extern "C" {
 #include <xboot/driver.h>
 #include <xboot/task.h>
 #include <xboot/mutex.h>
+#include <xboot/rwlock.h>
 #include <xboot/waiter.h>
+#include <xboot/future.h>
 #include <xboot/channel.h>
 #include <xboot/window.h>
 #include <xboot/module.h>
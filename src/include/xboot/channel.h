@@ -8,19 +8,47 @@ extern "C" {
 #include <types.h>
 #include <list.h>
 #include <spinlock.h>
+#include <xboot/task.h>
+#include <xboot/mutex.h>
 
 struct channel_t {
 	unsigned char * buffer;
 	unsigned int size;
 	unsigned int in;
 	unsigned int out;
-	spinlock_t lock;
+	int spsc;
+	struct mutex_t rlock;
+	struct mutex_t wlock;
+	struct waitqueue_t rwq;
+	struct waitqueue_t wwq;
+	struct list_head slist;
+	spinlock_t slock;
+};
+
+enum channel_select_type_t {
+	CHANNEL_SELECT_RECV		= 0,
+	CHANNEL_SELECT_SEND		= 1,
+	CHANNEL_SELECT_TIMER	= 2,
+};
+
+struct channel_select_t {
+	struct channel_t * c;
+	enum channel_select_type_t type;
+	ktime_t expires;
+	struct list_head entry;
+	struct task_t * task;
 };
 
 struct channel_t * channel_alloc(unsigned int size);
+struct channel_t * channel_alloc_spsc(unsigned int size);
 void channel_free(struct channel_t * c);
 void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len);
 void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len);
+unsigned char * channel_reserve(struct channel_t * c, unsigned int * len);
+void channel_commit(struct channel_t * c, unsigned int len);
+unsigned char * channel_peek(struct channel_t * c, unsigned int * len);
+void channel_consume(struct channel_t * c, unsigned int len);
+int channel_select(struct channel_select_t * s, int n, ktime_t timeout);
 
 #ifdef __cplusplus
 }
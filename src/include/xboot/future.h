@@ -0,0 +1,30 @@
+#ifndef __FUTURE_H__
+#define __FUTURE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+#include <xboot/task.h>
+
+struct future_t {
+	int done;
+	void * value;
+	spinlock_t lock;
+	struct waitqueue_t wq;
+};
+
+void future_init(struct future_t * f);
+void future_reset(struct future_t * f);
+bool_t future_set(struct future_t * f, void * value);
+bool_t future_poll(struct future_t * f, void ** value);
+void * future_get(struct future_t * f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FUTURE_H__ */
@@ -9,9 +9,11 @@ extern "C" {
 #include <list.h>
 #include <atomic.h>
 #include <spinlock.h>
+#include <xboot/task.h>
 
 struct mutex_t {
 	atomic_t atomic;
+	struct waitqueue_t wq;
 };
 
 void mutex_init(struct mutex_t * m);
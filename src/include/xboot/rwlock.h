@@ -0,0 +1,33 @@
+#ifndef __RWLOCK_H__
+#define __RWLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+#include <xboot/task.h>
+
+struct rwlock_t {
+	int count;
+	int writers;
+	spinlock_t lock;
+	struct waitqueue_t rwq;
+	struct waitqueue_t wwq;
+};
+
+void rwlock_init(struct rwlock_t * rw);
+int rwlock_read_trylock(struct rwlock_t * rw);
+int rwlock_write_trylock(struct rwlock_t * rw);
+void rwlock_read_lock(struct rwlock_t * rw);
+void rwlock_read_unlock(struct rwlock_t * rw);
+void rwlock_write_lock(struct rwlock_t * rw);
+void rwlock_write_unlock(struct rwlock_t * rw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RWLOCK_H__ */
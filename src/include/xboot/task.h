@@ -13,24 +13,69 @@ extern "C" {
 #include <spinlock.h>
 #include <smp.h>
 #include <rbtree_augmented.h>
+#include <xboot/ktime.h>
+#include <time/timer.h>
 
 struct task_t;
 struct scheduler_t;
 typedef void (*task_func_t)(struct task_t * task, void * data);
 
+enum task_status_t {
+	TASK_STATUS_READY		= 0,
+	TASK_STATUS_RUNNING		= 1,
+	TASK_STATUS_SUSPEND		= 2,
+};
+
+enum sched_trace_type_t {
+	SCHED_TRACE_SWITCH_IN	= 0,
+	SCHED_TRACE_SWITCH_OUT	= 1,
+	SCHED_TRACE_WAKEUP		= 2,
+};
+
+struct sched_trace_t {
+	uint64_t time;
+	char name[16];
+	enum sched_trace_type_t type;
+};
+
+struct waitqueue_t {
+	struct list_head list;
+	spinlock_t lock;
+};
+
 struct task_t {
 	struct rb_node node;
+	struct list_head list;
+	struct list_head wlist;
 	struct scheduler_t * sched;
+	enum task_status_t status;
 	uint64_t start;
 	uint64_t vtime;
-	char * name;
-	char * fb;
-	char * input;
+	uint64_t ready;
+	uint64_t runtime;
+	uint64_t waittime;
+	uint64_t switches;
+	const char * name;
+	const char * fb;
+	const char * input;
 	void * fctx;
 	void * stack;
 	size_t stksz;
 	int nice;
 	int dynice;
+	uint64_t period;
+	uint64_t budget;
+	uint64_t deadline;
+	int64_t remain;
+	uint64_t misses;
+	int throttled;
+	struct timer_t rtimer;
+	int oncpu;
+	int pinned;
+	int joinable;
+	int exited;
+	int joiners;
+	struct waitqueue_t exitwq;
 	task_func_t func;
 	void * data;
 	int __errno;
@@ -38,13 +83,20 @@ struct task_t {
 
 struct scheduler_t {
 	struct rb_root_cached ready;
+	struct rb_root_cached rtready;
+	uint64_t rtutil;
 	struct task_t * running;
 	uint64_t min_vtime;
 	uint64_t weight;
+	uint64_t balance;
+	struct list_head dead;
+	int ndead;
 	spinlock_t lock;
 };
 
 extern struct scheduler_t __sched[CONFIG_MAX_SMP_CPUS];
+extern struct list_head __task_list;
+extern spinlock_t __task_lock;
 
 static inline struct scheduler_t * scheduler_self(void)
 {
@@ -75,8 +127,27 @@ static inline void task_dynice_restore(struct task_t * task)
 }
 
 struct task_t * task_create(struct scheduler_t * sched, const char * name, const char * fb, const char * input, task_func_t func, void * data, size_t stksz, int nice);
+struct task_t * task_create_joinable(struct scheduler_t * sched, const char * name, const char * fb, const char * input, task_func_t func, void * data, size_t stksz, int nice);
 void task_nice(struct task_t * task, int nice);
+bool_t task_deadline(struct task_t * task, ktime_t period, ktime_t budget);
+void task_wait_period(void);
 void task_yield(void);
+void task_schedule(void);
+void task_suspend(struct task_t * task);
+void task_resume(struct task_t * task);
+void task_sleep(ktime_t interval);
+void task_join(struct task_t * task);
+void task_detach(struct task_t * task);
+void task_prepare_wait(void);
+void task_finish_wait(void);
+
+int scheduler_trace_snapshot(int cpu, struct sched_trace_t * trace, int n);
+
+void waitqueue_init(struct waitqueue_t * wq);
+void waitqueue_prepare(struct waitqueue_t * wq);
+void waitqueue_finish(struct waitqueue_t * wq);
+int waitqueue_wakeup(struct waitqueue_t * wq);
+int waitqueue_wakeup_all(struct waitqueue_t * wq);
 
 void do_idle_task(void);
 void do_init_sched(void);
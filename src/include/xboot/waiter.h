@@ -8,10 +8,12 @@ extern "C" {
 #include <types.h>
 #include <list.h>
 #include <spinlock.h>
+#include <xboot/task.h>
 
 struct waiter_t {
 	int count;
 	spinlock_t lock;
+	struct waitqueue_t wq;
 };
 
 void waiter_init(struct waiter_t * w);
@@ -19,6 +19,58 @@ extern "C" {
 #define CONFIG_TASK_STACK_SIZE				(512 * 1024)
 #endif
 
+#if !defined(CONFIG_TASK_CACHE_SIZE)
+#define CONFIG_TASK_CACHE_SIZE				(4)
+#endif
+
+#if !defined(CONFIG_TASK_NAME_HASH_SIZE)
+#define CONFIG_TASK_NAME_HASH_SIZE			(61)
+#endif
+
+#if !defined(CONFIG_TASK_STACK_GUARD)
+#define CONFIG_TASK_STACK_GUARD				(0)
+#endif
+
+#if !defined(CONFIG_SCHED_TRACE_SIZE)
+#define CONFIG_SCHED_TRACE_SIZE				(256)
+#endif
+
+#if !defined(CONFIG_SCHED_BALANCE_INTERVAL)
+#define CONFIG_SCHED_BALANCE_INTERVAL		(10)
+#endif
+
+#if !defined(CONFIG_SCHED_DEADLINE_UTIL)
+#define CONFIG_SCHED_DEADLINE_UTIL			(950)
+#endif
+
+#if !defined(CONFIG_TIMER_SLACK)
+#define CONFIG_TIMER_SLACK					(0)
+#endif
+
+#if !defined(CONFIG_TIMER_WHEEL_SHIFT)
+#define CONFIG_TIMER_WHEEL_SHIFT			(20)
+#endif
+
+#if !defined(CONFIG_SLAB_SIZE)
+#define CONFIG_SLAB_SIZE					(4096)
+#endif
+
+#if !defined(CONFIG_SLAB_MAGAZINE_SIZE)
+#define CONFIG_SLAB_MAGAZINE_SIZE			(16)
+#endif
+
+#if !defined(CONFIG_HEAP_PROFILE)
+#define CONFIG_HEAP_PROFILE					(0)
+#endif
+
+#if !defined(CONFIG_HEAP_PROFILE_SITES)
+#define CONFIG_HEAP_PROFILE_SITES			(256)
+#endif
+
+#if !defined(CONFIG_HEAP_PROFILE_TRACKS)
+#define CONFIG_HEAP_PROFILE_TRACKS			(16384)
+#endif
+
 #if !defined(CONFIG_DRIVER_HASH_SIZE)
 #define CONFIG_DRIVER_HASH_SIZE				(521)
 #endif
@@ -27,6 +79,38 @@ extern "C" {
 #define CONFIG_DEVICE_HASH_SIZE				(521)
 #endif
 
+#if !defined(CONFIG_BLOCK_BUFFER_COUNT)
+#define CONFIG_BLOCK_BUFFER_COUNT			(256)
+#endif
+
+#if !defined(CONFIG_BLOCK_BUFFER_BYPASS)
+#define CONFIG_BLOCK_BUFFER_BYPASS			(16384)
+#endif
+
+#if !defined(CONFIG_BLOCK_READAHEAD_MAX)
+#define CONFIG_BLOCK_READAHEAD_MAX			(32768)
+#endif
+
+#if !defined(CONFIG_BLOCK_REQUEST_CHUNK)
+#define CONFIG_BLOCK_REQUEST_CHUNK			(65536)
+#endif
+
+#if !defined(CONFIG_BLOCK_WRITEBACK_INTERVAL)
+#define CONFIG_BLOCK_WRITEBACK_INTERVAL		(1000)
+#endif
+
+#if !defined(CONFIG_BLOCK_WRITEBACK_AGE)
+#define CONFIG_BLOCK_WRITEBACK_AGE			(3000)
+#endif
+
+#if !defined(CONFIG_BLOCK_WRITEBACK_THRESHOLD)
+#define CONFIG_BLOCK_WRITEBACK_THRESHOLD	(65536)
+#endif
+
+#if !defined(CONFIG_FAT_TABLE_CACHE_SIZE)
+#define CONFIG_FAT_TABLE_CACHE_SIZE			(64)
+#endif
+
 #if !defined(CONFIG_EVENT_FIFO_SIZE)
 #define CONFIG_EVENT_FIFO_SIZE				(64)
 #endif
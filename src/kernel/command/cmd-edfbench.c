@@ -0,0 +1,230 @@
+/*
+ * kernel/command/cmd-edfbench.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <command/command.h>
+
+struct edfbench_t {
+	ktime_t end;
+	uint32_t loops_per_us;
+	int edf;
+};
+
+struct edfbench_task_t {
+	struct edfbench_t * eb;
+	int64_t period;
+	int64_t budget;
+	uint64_t jobs;
+	uint64_t misses;
+	int64_t worst;
+	int rejected;
+};
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    edfbench [periodic tasks] [load tasks] [millisecond]\r\n");
+}
+
+static void edfbench_spin(uint32_t loops)
+{
+	volatile uint32_t x = 1;
+
+	while(loops--)
+		x = x * 1664525 + 1013904223;
+}
+
+/*
+ * Background load, cpu bound and yielding about once per millisecond
+ */
+static void edfbench_load_task(struct task_t * task, void * data)
+{
+	struct edfbench_t * eb = (struct edfbench_t *)data;
+
+	while(ktime_before(ktime_get(), eb->end))
+	{
+		edfbench_spin(eb->loops_per_us * 1000);
+		task_yield();
+	}
+}
+
+/*
+ * A periodic job burning three quarters of its budget in small slices. The lateness
+ * of each job is taken against the deadline of its period, as a deadline task the
+ * scheduler's own deadline is used.
+ */
+static void edfbench_periodic_task(struct task_t * task, void * data)
+{
+	struct edfbench_task_t * et = (struct edfbench_task_t *)data;
+	struct edfbench_t * eb = et->eb;
+	int64_t deadline, now, late, work;
+
+	if(eb->edf && !task_deadline(task, ns_to_ktime(et->period), ns_to_ktime(et->budget)))
+	{
+		et->rejected = 1;
+		return;
+	}
+
+	deadline = ktime_to_ns(ktime_get()) + et->period;
+	while(ktime_before(ktime_get(), eb->end))
+	{
+		if(eb->edf)
+			deadline = task->deadline;
+		for(work = et->budget * 3 / 4; work > 0; work -= 100000)
+		{
+			edfbench_spin(eb->loops_per_us * min(work, (int64_t)100000) / 1000);
+			task_yield();
+		}
+
+		now = ktime_to_ns(ktime_get());
+		late = now - deadline;
+		if(late > 0)
+			et->misses++;
+		if(late > et->worst)
+			et->worst = late;
+		et->jobs++;
+
+		if(eb->edf)
+		{
+			task_wait_period();
+		}
+		else
+		{
+			if(deadline > now)
+				task_sleep(ns_to_ktime(deadline - now));
+			now = ktime_to_ns(ktime_get());
+			deadline = (deadline + et->period > now) ? deadline + et->period : now + et->period;
+		}
+	}
+}
+
+static void edfbench_run(struct edfbench_t * eb, struct edfbench_task_t * et, struct task_t ** list, int rt, int load, int ms)
+{
+	int tasks = 0, i;
+
+	eb->end = ktime_add_ms(ktime_get(), ms);
+
+	for(i = 0; i < load; i++)
+	{
+		if((list[tasks] = task_create_joinable(&__sched[0], "edfbench-load", NULL, NULL, edfbench_load_task, eb, 0, 0)))
+			tasks++;
+	}
+	for(i = 0; i < rt; i++)
+	{
+		et[i].eb = eb;
+		et[i].period = (i + 1) * 10 * 1000000LL;
+		et[i].budget = et[i].period / 5;
+		et[i].jobs = 0;
+		et[i].misses = 0;
+		et[i].worst = 0;
+		et[i].rejected = 0;
+		if((list[tasks] = task_create_joinable(&__sched[0], "edfbench-periodic", NULL, NULL, edfbench_periodic_task, &et[i], 0, 0)))
+			tasks++;
+	}
+	for(i = 0; i < tasks; i++)
+		task_join(list[i]);
+
+	printf("%s:\r\n", eb->edf ? "deadline class" : "fair class");
+	printf(" %8s %8s %8s %8s %12s\r\n", "PERIOD", "BUDGET", "JOBS", "MISSES", "WORST(us)");
+	for(i = 0; i < rt; i++)
+	{
+		if(et[i].rejected)
+			printf(" %6lldms %6lldms rejected by admission control\r\n", et[i].period / 1000000, et[i].budget / 1000000);
+		else
+			printf(" %6lldms %6lldms %8llu %8llu %12lld\r\n", et[i].period / 1000000, et[i].budget / 1000000,
+				(unsigned long long)et[i].jobs, (unsigned long long)et[i].misses, et[i].worst / 1000);
+	}
+}
+
+static int do_edfbench(int argc, char ** argv)
+{
+	struct edfbench_t * eb;
+	struct edfbench_task_t * et;
+	struct task_t ** list;
+	ktime_t t;
+	int rt = 3, load = 4, ms = 3000;
+
+	if(argc > 1)
+		rt = strtoul(argv[1], NULL, 0);
+	if(argc > 2)
+		load = strtoul(argv[2], NULL, 0);
+	if(argc > 3)
+		ms = strtoul(argv[3], NULL, 0);
+	if((rt <= 0) || (load < 0) || (ms <= 0))
+	{
+		usage();
+		return -1;
+	}
+
+	eb = malloc(sizeof(struct edfbench_t));
+	et = malloc(sizeof(struct edfbench_task_t) * rt);
+	list = malloc(sizeof(struct task_t *) * (rt + load));
+	if(!eb || !et || !list)
+	{
+		free(eb);
+		free(et);
+		free(list);
+		return -1;
+	}
+
+	/* Calibrate the busy loop so jobs burn a known amount of cpu time */
+	t = ktime_get();
+	edfbench_spin(1000000);
+	eb->loops_per_us = max((int64_t)1, 1000000 / max((int64_t)1, ktime_us_delta(ktime_get(), t)));
+
+	printf("%d periodic tasks, %d load tasks, %dms each run\r\n", rt, load, ms);
+	eb->edf = 0;
+	edfbench_run(eb, et, list, rt, load, ms);
+	eb->edf = 1;
+	edfbench_run(eb, et, list, rt, load, ms);
+
+	free(list);
+	free(et);
+	free(eb);
+	return 0;
+}
+
+static struct command_t cmd_edfbench = {
+	.name	= "edfbench",
+	.desc	= "measure deadline misses of periodic tasks under load",
+	.usage	= usage,
+	.exec	= do_edfbench,
+};
+
+static __init void edfbench_cmd_init(void)
+{
+	register_command(&cmd_edfbench);
+}
+
+static __exit void edfbench_cmd_exit(void)
+{
+	unregister_command(&cmd_edfbench);
+}
+
+command_initcall(edfbench_cmd_init);
+command_exitcall(edfbench_cmd_exit);
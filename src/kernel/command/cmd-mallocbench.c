@@ -0,0 +1,230 @@
+/*
+ * kernel/command/cmd-mallocbench.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <command/command.h>
+
+#define MALLOCBENCH_SLOTS		(64)
+
+struct mallocbench_t {
+	spinlock_t lock;
+	void * mm;
+	spinlock_t mm_lock;
+	int count;
+	u64_t ops;
+	u64_t total;
+	u64_t worst;
+	u64_t contended;
+};
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    mallocbench [operations per cpu]\r\n");
+}
+
+/*
+ * The old allocation path, one global lock in front of a plain tlsf heap
+ */
+static void * mallocbench_tlsf_alloc(struct mallocbench_t * mb, size_t size, u64_t * contended)
+{
+	irq_flags_t flags;
+	void * p;
+
+	local_irq_save(flags);
+	while(!spin_trylock(&mb->mm_lock))
+		(*contended)++;
+	p = mm_malloc(mb->mm, size);
+	spin_unlock(&mb->mm_lock);
+	local_irq_restore(flags);
+	return p;
+}
+
+static void mallocbench_tlsf_free(struct mallocbench_t * mb, void * p, u64_t * contended)
+{
+	irq_flags_t flags;
+
+	local_irq_save(flags);
+	while(!spin_trylock(&mb->mm_lock))
+		(*contended)++;
+	mm_free(mb->mm, p);
+	spin_unlock(&mb->mm_lock);
+	local_irq_restore(flags);
+}
+
+/*
+ * Churn a small working set of random sized small objects, timing every operation
+ */
+static void mallocbench_task(struct task_t * task, void * data)
+{
+	struct mallocbench_t * mb = (struct mallocbench_t *)data;
+	void * slot[MALLOCBENCH_SLOTS] = { 0 };
+	u64_t total = 0, worst = 0, contended = 0, dt;
+	u32_t seed = (u32_t)smp_processor_id() * 7919 + 1;
+	ktime_t t;
+	int i, s;
+
+	for(i = 0; i < mb->count; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		s = (seed >> 16) % MALLOCBENCH_SLOTS;
+		t = ktime_get();
+		if(slot[s])
+		{
+			if(mb->mm)
+				mallocbench_tlsf_free(mb, slot[s], &contended);
+			else
+				free(slot[s]);
+			slot[s] = NULL;
+		}
+		else
+		{
+			if(mb->mm)
+				slot[s] = mallocbench_tlsf_alloc(mb, 8 + (seed & 0xf8), &contended);
+			else
+				slot[s] = malloc(8 + (seed & 0xf8));
+		}
+		dt = ktime_to_ns(ktime_sub(ktime_get(), t));
+		total += dt;
+		if(dt > worst)
+			worst = dt;
+		if((i & 0xff) == 0xff)
+			task_yield();
+	}
+	for(s = 0; s < MALLOCBENCH_SLOTS; s++)
+	{
+		if(slot[s])
+		{
+			if(mb->mm)
+				mallocbench_tlsf_free(mb, slot[s], &contended);
+			else
+				free(slot[s]);
+		}
+	}
+
+	spin_lock(&mb->lock);
+	mb->ops += mb->count;
+	mb->total += total;
+	if(worst > mb->worst)
+		mb->worst = worst;
+	mb->contended += contended;
+	spin_unlock(&mb->lock);
+}
+
+static void mallocbench_run(struct mallocbench_t * mb, const char * name)
+{
+	struct task_t * list[CONFIG_MAX_SMP_CPUS];
+	ktime_t t;
+	s64_t us;
+	int tasks = 0, i;
+
+	spin_lock_init(&mb->lock);
+	spin_lock_init(&mb->mm_lock);
+	mb->ops = 0;
+	mb->total = 0;
+	mb->worst = 0;
+	mb->contended = 0;
+
+	t = ktime_get();
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		if((list[tasks] = task_create_joinable(&__sched[i], "mallocbench", NULL, NULL, mallocbench_task, mb, 0, 0)))
+			tasks++;
+	}
+	for(i = 0; i < tasks; i++)
+		task_join(list[i]);
+	us = max((s64_t)1, ktime_us_delta(ktime_get(), t));
+
+	printf(" %-12s %10llu %10llu %10llu", name, (unsigned long long)(mb->ops * 1000 / us),
+		(unsigned long long)(mb->ops ? mb->total / mb->ops : 0), (unsigned long long)mb->worst);
+	if(mb->mm)
+		printf(" %10llu\r\n", (unsigned long long)mb->contended);
+	else
+		printf(" %10s\r\n", "-");
+}
+
+static int do_mallocbench(int argc, char ** argv)
+{
+	struct mallocbench_t * mb;
+	size_t size = CONFIG_MAX_SMP_CPUS * MALLOCBENCH_SLOTS * 512 + 65536;
+	void * mem;
+	int count = 100000;
+
+	if(argc > 1)
+		count = strtoul(argv[1], NULL, 0);
+	if(count <= 0)
+	{
+		usage();
+		return -1;
+	}
+
+	mb = malloc(sizeof(struct mallocbench_t));
+	mem = malloc(size);
+	if(!mb || !mem)
+	{
+		free(mb);
+		free(mem);
+		return -1;
+	}
+	mb->count = count;
+
+	printf("%d cpus, %d operations per cpu\r\n", CONFIG_MAX_SMP_CPUS, count);
+	printf(" %-12s %10s %10s %10s %10s\r\n", "ALLOCATOR", "OPS/ms", "AVG(ns)", "MAX(ns)", "SPINS");
+	mb->mm = mm_create(mem, size);
+	if(mb->mm)
+	{
+		mallocbench_run(mb, "locked tlsf");
+		mm_destroy(mb->mm);
+	}
+	mb->mm = NULL;
+	mallocbench_run(mb, "slab");
+
+	free(mem);
+	free(mb);
+	return 0;
+}
+
+static struct command_t cmd_mallocbench = {
+	.name	= "mallocbench",
+	.desc	= "measure malloc latency and lock contention",
+	.usage	= usage,
+	.exec	= do_mallocbench,
+};
+
+static __init void mallocbench_cmd_init(void)
+{
+	register_command(&cmd_mallocbench);
+}
+
+static __exit void mallocbench_cmd_exit(void)
+{
+	unregister_command(&cmd_mallocbench);
+}
+
+command_initcall(mallocbench_cmd_init);
+command_exitcall(mallocbench_cmd_exit);
@@ -35,9 +35,24 @@ static void usage(void)
 	printf("    ps\r\n");
 }
 
+static const char * status_name(struct task_t * task)
+{
+	switch(task->status)
+	{
+	case TASK_STATUS_READY:
+		return "R";
+	case TASK_STATUS_RUNNING:
+		return "*";
+	case TASK_STATUS_SUSPEND:
+		return "S";
+	default:
+		break;
+	}
+	return "?";
+}
+
 static int do_ps(int argc, char ** argv)
 {
-	struct scheduler_t * sched;
 	struct task_t * pos, * n;
 	struct slist_t * sl, * e;
 	int i;
@@ -45,22 +60,23 @@ static int do_ps(int argc, char ** argv)
 	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
 	{
 		sl = slist_alloc();
-		sched = &__sched[i];
-
-		pos = sched->running;
-		if(pos)
-			slist_add(sl, pos, "%s", pos->name ? pos->name : "");
-		rbtree_postorder_for_each_entry_safe(pos, n, &sched->ready.rb_root, node)
+		spin_lock(&__task_lock);
+		list_for_each_entry_safe(pos, n, &__task_list, list)
 		{
-			slist_add(sl, pos, "%s", pos->name ? pos->name : "");
+			if(pos->sched == &__sched[i])
+				slist_add(sl, pos, "%s", pos->name ? pos->name : "");
 		}
+		spin_unlock(&__task_lock);
 		slist_sort(sl);
 
 		printf("CPU%d:\r\n", i);
+		printf(" %-10s %s %3s %3s %-12s %-12s %10s %10s %8s %s\r\n", "FUNC", "S", "NI", "DNI", "FB", "INPUT", "RUN(ms)", "WAIT(ms)", "SWITCH", "NAME");
 		slist_for_each_entry(e, sl)
 		{
 			pos = (struct task_t *)e->priv;
-			printf(" %p %3d %3d %-12s %-12s %s\r\n", pos->func, pos->nice - 20, pos->dynice - 20, pos->fb ? pos->fb : "none", pos->input ? pos->input : "none", e->key);
+			printf(" %p %s %3d %3d %-12s %-12s %10llu %10llu %8llu %s\r\n", pos->func, status_name(pos), pos->nice - 20, pos->dynice - 20,
+				pos->fb ? pos->fb : "none", pos->input ? pos->input : "none",
+				(unsigned long long)(pos->runtime / 1000000), (unsigned long long)(pos->waittime / 1000000), (unsigned long long)pos->switches, e->key);
 		}
 		slist_free(sl);
 	}
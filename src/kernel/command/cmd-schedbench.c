@@ -0,0 +1,166 @@
+/*
+ * kernel/command/cmd-schedbench.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <command/command.h>
+
+struct schedbench_t {
+	spinlock_t lock;
+	ktime_t end;
+	uint64_t work[CONFIG_MAX_SMP_CPUS];
+	uint64_t migrations;
+};
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    schedbench [tasks] [millisecond]\r\n");
+}
+
+static void schedbench_task(struct task_t * task, void * data)
+{
+	struct schedbench_t * sb = (struct schedbench_t *)data;
+	uint64_t work[CONFIG_MAX_SMP_CPUS] = { 0 };
+	uint64_t migrations = 0;
+	volatile uint32_t x = 1;
+	int cpu, last, i;
+
+	last = smp_processor_id();
+	while(ktime_before(ktime_get(), sb->end))
+	{
+		for(i = 0; i < 10000; i++)
+			x = x * 1664525 + 1013904223;
+		cpu = smp_processor_id();
+		if(cpu != last)
+		{
+			migrations++;
+			last = cpu;
+		}
+		work[cpu]++;
+		task_yield();
+	}
+
+	spin_lock(&sb->lock);
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		sb->work[i] += work[i];
+	sb->migrations += migrations;
+	spin_unlock(&sb->lock);
+}
+
+/*
+ * Start every worker on the first cpu, so any spread across the others is the work of
+ * the balancer, and report the work units finished in the given time.
+ */
+static uint64_t schedbench_run(struct schedbench_t * sb, struct task_t ** list, int tasks, int ms)
+{
+	uint64_t total = 0;
+	int i, n;
+
+	spin_lock_init(&sb->lock);
+	sb->migrations = 0;
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		sb->work[i] = 0;
+	sb->end = ktime_add_ms(ktime_get(), ms);
+
+	for(n = 0; n < tasks; n++)
+	{
+		list[n] = task_create_joinable(&__sched[0], "schedbench", NULL, NULL, schedbench_task, sb, 0, 0);
+		if(!list[n])
+			break;
+	}
+	for(i = 0; i < n; i++)
+		task_join(list[i]);
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		total += sb->work[i];
+	return total;
+}
+
+static int do_schedbench(int argc, char ** argv)
+{
+	struct schedbench_t * sb;
+	struct task_t ** list;
+	uint64_t single, total;
+	int tasks = CONFIG_MAX_SMP_CPUS * 4;
+	int ms = 2000;
+	int i;
+
+	if(argc > 1)
+		tasks = strtoul(argv[1], NULL, 0);
+	if(argc > 2)
+		ms = strtoul(argv[2], NULL, 0);
+	if((tasks <= 0) || (ms <= 0))
+	{
+		usage();
+		return -1;
+	}
+
+	sb = malloc(sizeof(struct schedbench_t));
+	list = malloc(sizeof(struct task_t *) * tasks);
+	if(!sb || !list)
+	{
+		free(sb);
+		free(list);
+		return -1;
+	}
+
+	single = schedbench_run(sb, list, 1, ms);
+	total = schedbench_run(sb, list, tasks, ms);
+
+	printf("cpus: %d, tasks: %d, time: %dms\r\n", CONFIG_MAX_SMP_CPUS, tasks, ms);
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		printf(" cpu%d: %llu units\r\n", i, (unsigned long long)sb->work[i]);
+	printf("single task: %llu units/s\r\n", (unsigned long long)(single * 1000 / ms));
+	printf("all tasks  : %llu units/s, %llu migrations\r\n", (unsigned long long)(total * 1000 / ms), (unsigned long long)sb->migrations);
+	if(single)
+		printf("scaling    : %llu.%02llux\r\n", (unsigned long long)(total / single), (unsigned long long)((total * 100 / single) % 100));
+	free(list);
+	free(sb);
+
+	return 0;
+}
+
+static struct command_t cmd_schedbench = {
+	.name	= "schedbench",
+	.desc	= "measure scheduler throughput across cpus",
+	.usage	= usage,
+	.exec	= do_schedbench,
+};
+
+static __init void schedbench_cmd_init(void)
+{
+	register_command(&cmd_schedbench);
+}
+
+static __exit void schedbench_cmd_exit(void)
+{
+	unregister_command(&cmd_schedbench);
+}
+
+command_initcall(schedbench_cmd_init);
+command_exitcall(schedbench_cmd_exit);
@@ -0,0 +1,167 @@
+/*
+ * kernel/command/cmd-timerbench.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <command/command.h>
+
+struct timerbench_t {
+	struct timer_t * timers;
+	int count;
+	int fired;
+	int batches;
+	ktime_t last;
+	s64_t late;
+	s64_t worst;
+};
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    timerbench [timers]\r\n");
+}
+
+/*
+ * Callbacks closer than 50us are taken to come from the same interrupt
+ */
+static int timerbench_function(struct timer_t * timer, void * data)
+{
+	struct timerbench_t * tb = (struct timerbench_t *)data;
+	ktime_t now = ktime_get();
+	s64_t late = ktime_us_delta(now, timer->expires);
+
+	if(!tb->fired || (ktime_us_delta(now, tb->last) > 50))
+		tb->batches++;
+	tb->last = now;
+	tb->fired++;
+	tb->late += late;
+	if(late > tb->worst)
+		tb->worst = late;
+	return 0;
+}
+
+static void timerbench_run(struct timerbench_t * tb, ktime_t slack)
+{
+	ktime_t t;
+	s64_t start, cancel;
+	u32_t seed = 1;
+	int i;
+
+	tb->fired = 0;
+	tb->batches = 0;
+	tb->late = 0;
+	tb->worst = 0;
+	for(i = 0; i < tb->count; i++)
+	{
+		timer_init(&tb->timers[i], timerbench_function, tb);
+		timer_set_slack(&tb->timers[i], slack);
+	}
+
+	/*
+	 * Insert and cancel with one to three second intervals, so none expire meanwhile
+	 * and all stay within wheel level two, whose granule fits in the 100ms slack
+	 */
+	t = ktime_get();
+	for(i = 0; i < tb->count; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		timer_start(&tb->timers[i], ms_to_ktime(1000 + (seed >> 16) % 2000));
+	}
+	start = ktime_to_ns(ktime_sub(ktime_get(), t));
+	t = ktime_get();
+	for(i = 0; i < tb->count; i++)
+		timer_cancel(&tb->timers[i]);
+	cancel = ktime_to_ns(ktime_sub(ktime_get(), t));
+
+	/* Let all of them expire over one second */
+	for(i = 0; i < tb->count; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		timer_start(&tb->timers[i], ms_to_ktime(10 + (seed >> 16) % 1000));
+	}
+	task_sleep(ms_to_ktime(1200 + ktime_to_ms(slack)));
+	for(i = 0; i < tb->count; i++)
+		timer_cancel(&tb->timers[i]);
+
+	printf(" %-10s %8lld %8lld %8d %8d %8lld %8lld\r\n", slack.tv64 ? "wheel" : "rbtree",
+		start / tb->count, cancel / tb->count, tb->fired, tb->batches,
+		tb->fired ? tb->late / tb->fired : 0, tb->worst);
+}
+
+static int do_timerbench(int argc, char ** argv)
+{
+	struct timerbench_t * tb;
+	int count = 4096;
+
+	if(argc > 1)
+		count = strtoul(argv[1], NULL, 0);
+	if(count <= 0)
+	{
+		usage();
+		return -1;
+	}
+
+	tb = malloc(sizeof(struct timerbench_t));
+	if(!tb)
+		return -1;
+	tb->count = count;
+	tb->timers = malloc(sizeof(struct timer_t) * count);
+	if(!tb->timers)
+	{
+		free(tb);
+		return -1;
+	}
+
+	printf("%d timers, wheel slack 100ms\r\n", count);
+	printf(" %-10s %8s %8s %8s %8s %8s %8s\r\n", "QUEUE", "ADD(ns)", "DEL(ns)", "FIRED", "IRQS", "LATE(us)", "MAX(us)");
+	timerbench_run(tb, ms_to_ktime(0));
+	timerbench_run(tb, ms_to_ktime(100));
+
+	free(tb->timers);
+	free(tb);
+	return 0;
+}
+
+static struct command_t cmd_timerbench = {
+	.name	= "timerbench",
+	.desc	= "compare timer wheel against the timer rbtree",
+	.usage	= usage,
+	.exec	= do_timerbench,
+};
+
+static __init void timerbench_cmd_init(void)
+{
+	register_command(&cmd_timerbench);
+}
+
+static __exit void timerbench_cmd_exit(void)
+{
+	unregister_command(&cmd_timerbench);
+}
+
+command_initcall(timerbench_cmd_init);
+command_exitcall(timerbench_cmd_exit);
@@ -29,7 +29,7 @@
 #include <xboot.h>
 #include <xboot/channel.h>
 
-struct channel_t * channel_alloc(unsigned int size)
+static struct channel_t * __channel_alloc(unsigned int size, int spsc)
 {
 	struct channel_t * c;
 
@@ -51,11 +51,31 @@ struct channel_t * channel_alloc(unsigned int size)
 	c->size = size;
 	c->in = 0;
 	c->out = 0;
-	spin_lock_init(&c->lock);
+	c->spsc = spsc;
+	mutex_init(&c->rlock);
+	mutex_init(&c->wlock);
+	waitqueue_init(&c->rwq);
+	waitqueue_init(&c->wwq);
+	init_list_head(&c->slist);
+	spin_lock_init(&c->slock);
 
 	return c;
 }
 
+struct channel_t * channel_alloc(unsigned int size)
+{
+	return __channel_alloc(size, 0);
+}
+
+/*
+ * A channel with exactly one producer task and one consumer task. The ring indexes
+ * are only ever advanced by their own side, so no lock is taken at all.
+ */
+struct channel_t * channel_alloc_spsc(unsigned int size)
+{
+	return __channel_alloc(size, 1);
+}
+
 void channel_free(struct channel_t * c)
 {
 	if(c)
@@ -75,6 +95,81 @@ static inline int channel_isfull(struct channel_t * c)
 	return (c->in - c->out >= c->size) ? 1 : 0;
 }
 
+static inline void channel_rlock(struct channel_t * c)
+{
+	if(!c->spsc)
+		mutex_lock(&c->rlock);
+}
+
+static inline void channel_runlock(struct channel_t * c)
+{
+	if(!c->spsc)
+		mutex_unlock(&c->rlock);
+}
+
+static inline void channel_wlock(struct channel_t * c)
+{
+	if(!c->spsc)
+		mutex_lock(&c->wlock);
+}
+
+static inline void channel_wunlock(struct channel_t * c)
+{
+	if(!c->spsc)
+		mutex_unlock(&c->wlock);
+}
+
+static inline void channel_select_wakeup(struct channel_t * c, enum channel_select_type_t type)
+{
+	struct channel_select_t * pos;
+	irq_flags_t flags;
+
+	smp_mb();
+	if(list_empty(&c->slist))
+		return;
+	spin_lock_irqsave(&c->slock, flags);
+	list_for_each_entry(pos, &c->slist, entry)
+	{
+		if(pos->type == type)
+			task_resume(pos->task);
+	}
+	spin_unlock_irqrestore(&c->slock, flags);
+}
+
+static inline void channel_wakeup_reader(struct channel_t * c)
+{
+	waitqueue_wakeup(&c->rwq);
+	channel_select_wakeup(c, CHANNEL_SELECT_RECV);
+}
+
+static inline void channel_wakeup_writer(struct channel_t * c)
+{
+	waitqueue_wakeup(&c->wwq);
+	channel_select_wakeup(c, CHANNEL_SELECT_SEND);
+}
+
+static inline void channel_wait_notfull(struct channel_t * c)
+{
+	while(channel_isfull(c))
+	{
+		waitqueue_prepare(&c->wwq);
+		if(channel_isfull(c))
+			task_schedule();
+		waitqueue_finish(&c->wwq);
+	}
+}
+
+static inline void channel_wait_notempty(struct channel_t * c)
+{
+	while(channel_isempty(c))
+	{
+		waitqueue_prepare(&c->rwq);
+		if(channel_isempty(c))
+			task_schedule();
+		waitqueue_finish(&c->rwq);
+	}
+}
+
 static inline unsigned int __channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
 {
 	unsigned int l;
@@ -105,76 +200,241 @@ static inline unsigned int __channel_get(struct channel_t * c, unsigned char * b
 	return len;
 }
 
-static inline unsigned int channel_put(struct channel_t * c, unsigned char * buf, unsigned int len)
+void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len)
 {
-	struct task_t * self = task_self();
 	unsigned int l;
 
-	spin_lock(&c->lock);
-	if(channel_isfull(c))
+	if(c && buf)
 	{
-		l = 0;
-		task_dynice_increase(self);
+		channel_wlock(c);
+		while(len > 0)
+		{
+			channel_wait_notfull(c);
+			l = __channel_put(c, buf, len);
+			buf += l;
+			len -= l;
+			channel_wakeup_reader(c);
+		}
+		channel_wunlock(c);
 	}
-	else
+}
+
+void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len)
+{
+	unsigned int l;
+
+	if(c && buf)
 	{
-		l = __channel_put(c, buf, len);
-		task_dynice_restore(self);
+		channel_rlock(c);
+		while(len > 0)
+		{
+			channel_wait_notempty(c);
+			l = __channel_get(c, buf, len);
+			buf += l;
+			len -= l;
+			channel_wakeup_writer(c);
+		}
+		channel_runlock(c);
 	}
-	spin_unlock(&c->lock);
+}
+
+/*
+ * Wait for free space and return the largest contiguous region of at most *len bytes
+ * at the write position, the caller fills it in place and must finish the reservation
+ * with channel_commit, which may publish fewer bytes than reserved, even zero.
+ */
+unsigned char * channel_reserve(struct channel_t * c, unsigned int * len)
+{
+	unsigned int off, l;
 
-	return l;
+	if(!c || !len || (*len == 0))
+		return NULL;
+
+	channel_wlock(c);
+	channel_wait_notfull(c);
+	smp_mb();
+	off = c->in & (c->size - 1);
+	l = min(*len, c->size - c->in + c->out);
+	*len = min(l, c->size - off);
+
+	return c->buffer + off;
 }
 
-static inline unsigned int channel_get(struct channel_t * c, unsigned char * buf, unsigned int len)
+void channel_commit(struct channel_t * c, unsigned int len)
 {
-	struct task_t * self = task_self();
-	unsigned int l;
+	if(c)
+	{
+		smp_wmb();
+		c->in += len;
+		channel_wunlock(c);
+		if(len > 0)
+			channel_wakeup_reader(c);
+	}
+}
+
+/*
+ * Wait for data and return the largest contiguous readable region of at most *len
+ * bytes, the caller parses it in place and releases it with channel_consume.
+ */
+unsigned char * channel_peek(struct channel_t * c, unsigned int * len)
+{
+	unsigned int off, l;
+
+	if(!c || !len || (*len == 0))
+		return NULL;
+
+	channel_rlock(c);
+	channel_wait_notempty(c);
+	smp_rmb();
+	off = c->out & (c->size - 1);
+	l = min(*len, c->in - c->out);
+	*len = min(l, c->size - off);
 
-	spin_lock(&c->lock);
-	if(channel_isempty(c))
+	return c->buffer + off;
+}
+
+void channel_consume(struct channel_t * c, unsigned int len)
+{
+	if(c)
 	{
-		l = 0;
-		task_dynice_increase(self);
+		smp_mb();
+		c->out += len;
+		channel_runlock(c);
+		if(len > 0)
+			channel_wakeup_writer(c);
 	}
-	else
+}
+
+static int channel_select_scan(struct channel_select_t * s, int n)
+{
+	int i;
+
+	for(i = 0; i < n; i++)
 	{
-		l = __channel_get(c, buf, len);
-		task_dynice_restore(self);
+		if(s[i].type == CHANNEL_SELECT_TIMER)
+		{
+			if(!ktime_before(ktime_get(), s[i].expires))
+				return i;
+			continue;
+		}
+		if(!s[i].c)
+			continue;
+		if(s[i].type == CHANNEL_SELECT_SEND)
+		{
+			if(!channel_isfull(s[i].c))
+				return i;
+		}
+		else
+		{
+			if(!channel_isempty(s[i].c))
+				return i;
+		}
 	}
-	spin_unlock(&c->lock);
+	return -1;
+}
 
-	return l;
+static int channel_select_timer_function(struct timer_t * timer, void * data)
+{
+	task_resume((struct task_t *)data);
+	return 0;
 }
 
-void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len)
+/*
+ * Earliest of the overall deadline and the timer entries, returns 0 if there is none
+ */
+static int channel_select_next_expiry(struct channel_select_t * s, int n, int forever, ktime_t deadline, ktime_t * next)
 {
-	unsigned int l;
+	int armed = 0;
+	int i;
 
-	if(c && buf)
+	if(!forever)
 	{
-		while(len > 0)
+		*next = deadline;
+		armed = 1;
+	}
+	for(i = 0; i < n; i++)
+	{
+		if((s[i].type == CHANNEL_SELECT_TIMER) && (!armed || ktime_before(s[i].expires, *next)))
 		{
-			l = channel_put(c, buf, len);
-			buf += l;
-			len -= l;
-			task_yield();
+			*next = s[i].expires;
+			armed = 1;
 		}
 	}
+	return armed;
 }
 
-void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len)
+/*
+ * Wait until any of the channels can be received from or sent to, or any timer entry
+ * has reached its absolute expiry time, and return the index of the first such entry,
+ * or -1 once the timeout has expired. A negative timeout waits forever and a zero
+ * timeout only polls. With several consumers on a channel the readiness is only a
+ * hint, another task may drain it first.
+ */
+int channel_select(struct channel_select_t * s, int n, ktime_t timeout)
 {
-	unsigned int l;
+	struct task_t * self = task_self();
+	struct timer_t timer;
+	ktime_t deadline, next;
+	irq_flags_t flags;
+	int forever = (ktime_to_ns(timeout) < 0) ? 1 : 0;
+	int i, ready, armed;
 
-	if(c && buf)
+	if(!s || (n <= 0))
+		return -1;
+
+	ready = channel_select_scan(s, n);
+	if((ready >= 0) || (ktime_to_ns(timeout) == 0))
+		return ready;
+	deadline = ktime_add_safe(ktime_get(), timeout);
+
+	if(!self)
 	{
-		while(len > 0)
+		while((ready = channel_select_scan(s, n)) < 0)
 		{
-			l = channel_get(c, buf, len);
-			buf += l;
-			len -= l;
-			task_yield();
+			if(!forever && !ktime_before(ktime_get(), deadline))
+				break;
 		}
+		return ready;
 	}
+
+	for(i = 0; i < n; i++)
+	{
+		if(s[i].c && (s[i].type != CHANNEL_SELECT_TIMER))
+		{
+			s[i].task = self;
+			spin_lock_irqsave(&s[i].c->slock, flags);
+			list_add_tail(&s[i].entry, &s[i].c->slist);
+			spin_unlock_irqrestore(&s[i].c->slock, flags);
+		}
+	}
+
+	timer_init(&timer, channel_select_timer_function, self);
+	while(1)
+	{
+		task_prepare_wait();
+		smp_mb();
+		if((ready = channel_select_scan(s, n)) >= 0)
+			break;
+		if(!forever && !ktime_before(ktime_get(), deadline))
+			break;
+		armed = channel_select_next_expiry(s, n, forever, deadline, &next);
+		if(armed)
+			timer_start(&timer, ktime_sub(next, ktime_get()));
+		task_schedule();
+		if(armed)
+			timer_cancel(&timer);
+	}
+	task_finish_wait();
+
+	for(i = 0; i < n; i++)
+	{
+		if(s[i].c && (s[i].type != CHANNEL_SELECT_TIMER))
+		{
+			spin_lock_irqsave(&s[i].c->slock, flags);
+			list_del(&s[i].entry);
+			spin_unlock_irqrestore(&s[i].c->slock, flags);
+		}
+	}
+
+	return ready;
 }
@@ -32,7 +32,7 @@
 struct list_head __device_list;
 struct list_head __device_head[DEVICE_TYPE_MAX_COUNT];
 static struct hlist_head __device_hash[CONFIG_DEVICE_HASH_SIZE];
-static spinlock_t __device_lock = SPIN_LOCK_INIT();
+static struct rwlock_t __device_lock;
 static struct notifier_chain_t __device_nc = NOTIFIER_CHAIN_INIT();
 
 static struct hlist_head * device_hash(const char * name)
@@ -215,13 +215,20 @@ static bool_t device_exist(const char * name)
 {
 	struct device_t * pos;
 	struct hlist_node * n;
+	bool_t ret = FALSE;
 
+	rwlock_read_lock(&__device_lock);
 	hlist_for_each_entry_safe(pos, n, device_hash(name), node)
 	{
 		if(strcmp(pos->name, name) == 0)
-			return TRUE;
+		{
+			ret = TRUE;
+			break;
+		}
 	}
-	return FALSE;
+	rwlock_read_unlock(&__device_lock);
+
+	return ret;
 }
 
 char * alloc_device_name(const char * name, int id)
@@ -245,18 +252,24 @@ void free_device_name(char * name)
 
 struct device_t * search_device(const char * name, enum device_type_t type)
 {
-	struct device_t * pos;
+	struct device_t * pos, * dev = NULL;
 	struct hlist_node * n;
 
 	if(!name)
 		return NULL;
 
+	rwlock_read_lock(&__device_lock);
 	hlist_for_each_entry_safe(pos, n, device_hash(name), node)
 	{
 		if((pos->type == type) && (strcmp(pos->name, name) == 0))
-			return pos;
+		{
+			dev = pos;
+			break;
+		}
 	}
-	return NULL;
+	rwlock_read_unlock(&__device_lock);
+
+	return dev;
 }
 
 struct device_t * search_first_device(enum device_type_t type)
@@ -268,8 +281,6 @@ struct device_t * search_first_device(enum device_type_t type)
 
 bool_t register_device(struct device_t * dev)
 {
-	irq_flags_t flags;
-
 	if(!dev || !dev->name)
 		return FALSE;
 
@@ -283,14 +294,14 @@ bool_t register_device(struct device_t * dev)
 	kobj_add_regular(dev->kobj, "resume", NULL, device_write_resume, dev);
 	kobj_add(search_device_kobj(dev), dev->kobj);
 
-	spin_lock_irqsave(&__device_lock, flags);
+	rwlock_write_lock(&__device_lock);
 	init_list_head(&dev->list);
 	list_add_tail(&dev->list, &__device_list);
 	init_list_head(&dev->head);
 	list_add_tail(&dev->head, &__device_head[dev->type]);
 	init_hlist_node(&dev->node);
 	hlist_add_head(&dev->node, device_hash(dev->name));
-	spin_unlock_irqrestore(&__device_lock, flags);
+	rwlock_write_unlock(&__device_lock);
 	notifier_chain_call(&__device_nc, "notifier-device-add", dev);
 
 	return TRUE;
@@ -298,8 +309,6 @@ bool_t register_device(struct device_t * dev)
 
 bool_t unregister_device(struct device_t * dev)
 {
-	irq_flags_t flags;
-
 	if(!dev || !dev->name)
 		return FALSE;
 
@@ -310,11 +319,11 @@ bool_t unregister_device(struct device_t * dev)
 		return FALSE;
 
 	notifier_chain_call(&__device_nc, "notifier-device-remove", dev);
-	spin_lock_irqsave(&__device_lock, flags);
+	rwlock_write_lock(&__device_lock);
 	list_del(&dev->list);
 	list_del(&dev->head);
 	hlist_del(&dev->node);
-	spin_unlock_irqrestore(&__device_lock, flags);
+	rwlock_write_unlock(&__device_lock);
 	kobj_remove(search_device_kobj(dev), dev->kobj);
 
 	return TRUE;
@@ -354,6 +363,7 @@ static __init void device_pure_init(void)
 {
 	int i;
 
+	rwlock_init(&__device_lock);
 	init_list_head(&__device_list);
 	for(i = 0; i < ARRAY_SIZE(__device_head); i++)
 		init_list_head(&__device_head[i]);
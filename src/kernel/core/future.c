@@ -0,0 +1,106 @@
+/*
+ * kernel/core/future.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/future.h>
+
+void future_init(struct future_t * f)
+{
+	if(f)
+	{
+		f->done = 0;
+		f->value = NULL;
+		spin_lock_init(&f->lock);
+		waitqueue_init(&f->wq);
+	}
+}
+
+void future_reset(struct future_t * f)
+{
+	irq_flags_t flags;
+
+	if(f)
+	{
+		spin_lock_irqsave(&f->lock, flags);
+		f->done = 0;
+		f->value = NULL;
+		spin_unlock_irqrestore(&f->lock, flags);
+	}
+}
+
+/*
+ * The promise side, completes the future once and wakes every task blocked on it.
+ * Safe to call from interrupt context, a second completion is refused.
+ */
+bool_t future_set(struct future_t * f, void * value)
+{
+	irq_flags_t flags;
+
+	if(!f)
+		return FALSE;
+
+	spin_lock_irqsave(&f->lock, flags);
+	if(f->done)
+	{
+		spin_unlock_irqrestore(&f->lock, flags);
+		return FALSE;
+	}
+	f->value = value;
+	smp_wmb();
+	f->done = 1;
+	spin_unlock_irqrestore(&f->lock, flags);
+	waitqueue_wakeup_all(&f->wq);
+
+	return TRUE;
+}
+
+bool_t future_poll(struct future_t * f, void ** value)
+{
+	if(!f || !f->done)
+		return FALSE;
+	smp_rmb();
+	if(value)
+		*value = f->value;
+	return TRUE;
+}
+
+void * future_get(struct future_t * f)
+{
+	if(!f)
+		return NULL;
+
+	while(!f->done)
+	{
+		waitqueue_prepare(&f->wq);
+		if(!f->done)
+			task_schedule();
+		waitqueue_finish(&f->wq);
+	}
+	smp_rmb();
+	return f->value;
+}
@@ -0,0 +1,137 @@
+/*
+ * kernel/core/rwlock.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/rwlock.h>
+
+void rwlock_init(struct rwlock_t * rw)
+{
+	rw->count = 0;
+	rw->writers = 0;
+	spin_lock_init(&rw->lock);
+	waitqueue_init(&rw->rwq);
+	waitqueue_init(&rw->wwq);
+}
+
+/*
+ * Readers share the lock while no writer holds or waits for it, waiting writers
+ * are preferred so that a steady stream of readers can't starve them.
+ */
+int rwlock_read_trylock(struct rwlock_t * rw)
+{
+	irq_flags_t flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&rw->lock, flags);
+	if((rw->count >= 0) && (rw->writers == 0))
+	{
+		rw->count++;
+		ret = 1;
+	}
+	spin_unlock_irqrestore(&rw->lock, flags);
+
+	return ret;
+}
+
+int rwlock_write_trylock(struct rwlock_t * rw)
+{
+	irq_flags_t flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&rw->lock, flags);
+	if(rw->count == 0)
+	{
+		rw->count = -1;
+		ret = 1;
+	}
+	spin_unlock_irqrestore(&rw->lock, flags);
+
+	return ret;
+}
+
+void rwlock_read_lock(struct rwlock_t * rw)
+{
+	while(!rwlock_read_trylock(rw))
+	{
+		waitqueue_prepare(&rw->rwq);
+		if((rw->count < 0) || (rw->writers != 0))
+			task_schedule();
+		waitqueue_finish(&rw->rwq);
+	}
+}
+
+void rwlock_read_unlock(struct rwlock_t * rw)
+{
+	irq_flags_t flags;
+	int wake;
+
+	spin_lock_irqsave(&rw->lock, flags);
+	rw->count--;
+	wake = (rw->count == 0) && (rw->writers != 0);
+	spin_unlock_irqrestore(&rw->lock, flags);
+
+	if(wake)
+		waitqueue_wakeup(&rw->wwq);
+}
+
+void rwlock_write_lock(struct rwlock_t * rw)
+{
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&rw->lock, flags);
+	rw->writers++;
+	spin_unlock_irqrestore(&rw->lock, flags);
+
+	while(!rwlock_write_trylock(rw))
+	{
+		waitqueue_prepare(&rw->wwq);
+		if(rw->count != 0)
+			task_schedule();
+		waitqueue_finish(&rw->wwq);
+	}
+
+	spin_lock_irqsave(&rw->lock, flags);
+	rw->writers--;
+	spin_unlock_irqrestore(&rw->lock, flags);
+}
+
+void rwlock_write_unlock(struct rwlock_t * rw)
+{
+	irq_flags_t flags;
+	int writers;
+
+	spin_lock_irqsave(&rw->lock, flags);
+	rw->count = 0;
+	writers = rw->writers;
+	spin_unlock_irqrestore(&rw->lock, flags);
+
+	if(writers)
+		waitqueue_wakeup(&rw->wwq);
+	else
+		waitqueue_wakeup_all(&rw->rwq);
+}
@@ -2,8 +2,8 @@
  * kernel/core/setting.c
  *
  * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
- * Official site: http://xboot.org
- * Mobile phone: +86-18665388956
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
  * QQ: 8192542
  *
  * Permission is hereby granted, free of charge, to any person obtaining a copy
@@ -34,16 +34,15 @@ struct setting_t {
 	struct hmap_t * map;
 	char * path;
 	int dirty;
-	spinlock_t lock;
+	struct rwlock_t lock;
 };
 static struct setting_t __setting = { 0 };
 
 void setting_set(const char * key, const char * value)
 {
-	irq_flags_t flags;
 	char * v;
 
-	spin_lock_irqsave(&__setting.lock, flags);
+	rwlock_write_lock(&__setting.lock);
 	v = hmap_search(__setting.map, key);
 	if(v)
 	{
@@ -58,17 +57,16 @@ void setting_set(const char * key, const char * value)
 	}
 	if(__setting.dirty)
 		timer_start(&__setting.timer, ms_to_ktime(10000));
-	spin_unlock_irqrestore(&__setting.lock, flags);
+	rwlock_write_unlock(&__setting.lock);
 }
 
 const char * setting_get(const char * key, const char * def)
 {
-	irq_flags_t flags;
 	const char * v;
 
-	spin_lock_irqsave(&__setting.lock, flags);
+	rwlock_read_lock(&__setting.lock);
 	v = hmap_search(__setting.map, key);
-	spin_unlock_irqrestore(&__setting.lock, flags);
+	rwlock_read_unlock(&__setting.lock);
 	if(!v)
 		v = def;
 	return v;
@@ -82,13 +80,11 @@ static void hmap_entry_callback(struct hmap_entry_t * e)
 
 void setting_clear(void)
 {
-	irq_flags_t flags;
-
-	spin_lock_irqsave(&__setting.lock, flags);
+	rwlock_write_lock(&__setting.lock);
 	hmap_clear(__setting.map, hmap_entry_callback);
 	__setting.dirty = 1;
 	timer_start(&__setting.timer, ms_to_ktime(10000));
-	spin_unlock_irqrestore(&__setting.lock, flags);
+	rwlock_write_unlock(&__setting.lock);
 }
 
 void setting_summary(void)
@@ -107,11 +103,18 @@ static int setting_timer_function(struct timer_t * timer, void * data)
 	struct hmap_entry_t * e;
 	char buf[256];
 	int fd, len;
-	irq_flags_t flags;
 
 	if(__setting.dirty)
 	{
-		spin_lock_irqsave(&__setting.lock, flags);
+		/*
+		 * Runs from the timer interrupt and must not sleep, so come back later while a
+		 * writer holds the table. Sorting only relinks the list under the map's own lock.
+		 */
+		if(!rwlock_read_trylock(&__setting.lock))
+		{
+			timer_forward(timer, ms_to_ktime(100));
+			return 1;
+		}
 		hmap_sort(__setting.map);
 		fd = vfs_open(__setting.path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
 		if(fd)
@@ -124,7 +127,7 @@ static int setting_timer_function(struct timer_t * timer, void * data)
 			vfs_close(fd);
 		}
 		__setting.dirty = 0;
-		spin_unlock_irqrestore(&__setting.lock, flags);
+		rwlock_read_unlock(&__setting.lock);
 	}
 	return 0;
 }
@@ -134,15 +137,15 @@ void do_init_setting(void)
 	struct vfs_stat_t st;
 	char * buf, * p, * r, * k, * v;
 	int fd, n, len = 0;
-	irq_flags_t flags;
 
 	__setting.map = hmap_alloc(0);
 	__setting.path = "/private/setting.cfg";
 	__setting.dirty = 0;
 	timer_init(&__setting.timer, setting_timer_function, NULL);
-	spin_lock_init(&__setting.lock);
+	timer_set_slack(&__setting.timer, ms_to_ktime(1000));
+	rwlock_init(&__setting.lock);
 
-	spin_lock_irqsave(&__setting.lock, flags);
+	rwlock_write_lock(&__setting.lock);
 	if((vfs_stat(__setting.path, &st) >= 0) && S_ISREG(st.st_mode) && (st.st_size > 0))
 	{
 		buf = malloc(st.st_size + 1);
@@ -176,5 +179,5 @@ void do_init_setting(void)
 			free(buf);
 		}
 	}
-	spin_unlock_irqrestore(&__setting.lock, flags);
+	rwlock_write_unlock(&__setting.lock);
 }
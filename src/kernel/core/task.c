@@ -40,6 +40,76 @@ extern struct transfer_t jump_fcontext(void * fctx, void * priv);
 
 struct scheduler_t __sched[CONFIG_MAX_SMP_CPUS];
 EXPORT_SYMBOL(__sched);
+struct list_head __task_list = {
+	.next = &__task_list,
+	.prev = &__task_list,
+};
+EXPORT_SYMBOL(__task_list);
+spinlock_t __task_lock = SPIN_LOCK_INIT();
+EXPORT_SYMBOL(__task_lock);
+
+#if defined(CONFIG_SCHED_TRACE_SIZE) && (CONFIG_SCHED_TRACE_SIZE > 0)
+#if (CONFIG_SCHED_TRACE_SIZE & (CONFIG_SCHED_TRACE_SIZE - 1)) != 0
+#error "CONFIG_SCHED_TRACE_SIZE must be a power of two"
+#endif
+
+struct sched_trace_ring_t {
+	struct sched_trace_t ring[CONFIG_SCHED_TRACE_SIZE];
+	unsigned int head;
+};
+
+static struct sched_trace_ring_t __sched_trace[CONFIG_MAX_SMP_CPUS];
+
+/*
+ * Each cpu only ever writes its own ring and always with interrupts disabled, so
+ * recording needs no lock. Readers copy and drop whatever got overwritten meanwhile.
+ */
+static inline void sched_trace(enum sched_trace_type_t type, struct task_t * task, uint64_t now)
+{
+	struct sched_trace_ring_t * r = &__sched_trace[smp_processor_id()];
+	struct sched_trace_t * t = &r->ring[r->head & (CONFIG_SCHED_TRACE_SIZE - 1)];
+
+	t->time = now;
+	strlcpy(t->name, task->name ? task->name : "", sizeof(t->name));
+	t->type = type;
+	smp_wmb();
+	r->head++;
+}
+
+int scheduler_trace_snapshot(int cpu, struct sched_trace_t * trace, int n)
+{
+	struct sched_trace_ring_t * r;
+	unsigned int head, i;
+	int len = 0;
+
+	if((cpu < 0) || (cpu >= CONFIG_MAX_SMP_CPUS) || !trace || (n <= 0))
+		return 0;
+
+	r = &__sched_trace[cpu];
+	head = r->head;
+	smp_rmb();
+	i = (head > CONFIG_SCHED_TRACE_SIZE) ? head - CONFIG_SCHED_TRACE_SIZE : 0;
+	if(head - i > (unsigned int)n)
+		i = head - n;
+	for(; i != head; i++)
+	{
+		memcpy(&trace[len], &r->ring[i & (CONFIG_SCHED_TRACE_SIZE - 1)], sizeof(struct sched_trace_t));
+		smp_rmb();
+		if(r->head - i < CONFIG_SCHED_TRACE_SIZE)
+			len++;
+	}
+	return len;
+}
+#else
+static inline void sched_trace(enum sched_trace_type_t type, struct task_t * task, uint64_t now)
+{
+}
+
+int scheduler_trace_snapshot(int cpu, struct sched_trace_t * trace, int n)
+{
+	return 0;
+}
+#endif
 
 static const uint32_t nice_to_weight[40] = {
  /* -20 */     88761,     71755,     56483,     46273,     36291,
@@ -112,7 +182,33 @@ static inline uint64_t calc_delta_fair(struct task_t * task, uint64_t delta)
 	return delta;
 }
 
-static inline struct task_t * scheduler_next_ready_task(struct scheduler_t * sched)
+static inline uint64_t task_deadline_util(uint64_t period, uint64_t budget)
+{
+	return period ? udiv64(budget * 1000, period) : 0;
+}
+
+/*
+ * Start the next job of a deadline task with a full budget. A periodic task waking
+ * in time keeps its cadence, one that slept past its next period starts afresh.
+ */
+static inline void task_deadline_renew(struct task_t * task, uint64_t now)
+{
+	if((int64_t)(task->deadline + task->period - now) > 0)
+		task->deadline += task->period;
+	else
+		task->deadline = now + task->period;
+	task->remain = task->budget;
+}
+
+static inline void task_charge(struct task_t * task, uint64_t now)
+{
+	task->runtime += now - task->start;
+	if(task->period)
+		task->remain -= (int64_t)(now - task->start);
+	task->start = now;
+}
+
+static inline struct task_t * scheduler_next_fair_task(struct scheduler_t * sched)
 {
 	struct rb_node * leftmost = rb_first_cached(&sched->ready);
 
@@ -121,6 +217,49 @@ static inline struct task_t * scheduler_next_ready_task(struct scheduler_t * sch
 	return rb_entry(leftmost, struct task_t, node);
 }
 
+/*
+ * Deadline tasks are always picked ahead of the fair ones, earliest deadline first.
+ */
+static inline struct task_t * scheduler_next_ready_task(struct scheduler_t * sched)
+{
+	struct rb_node * leftmost = rb_first_cached(&sched->rtready);
+
+	if(leftmost)
+		return rb_entry(leftmost, struct task_t, node);
+	return scheduler_next_fair_task(sched);
+}
+
+static inline int scheduler_has_ready_task(struct scheduler_t * sched)
+{
+	return (!RB_EMPTY_ROOT(&sched->rtready.rb_root) || !RB_EMPTY_ROOT(&sched->ready.rb_root)) ? 1 : 0;
+}
+
+static inline void scheduler_enqueue_rt_task(struct scheduler_t * sched, struct task_t * task)
+{
+	struct rb_node ** link = &sched->rtready.rb_root.rb_node;
+	struct rb_node * parent = NULL;
+	struct task_t * entry;
+	int leftmost = 1;
+
+	while(*link)
+	{
+		parent = *link;
+		entry = rb_entry(parent, struct task_t, node);
+		if((int64_t)(task->deadline - entry->deadline) < 0)
+		{
+			link = &parent->rb_left;
+		}
+		else
+		{
+			link = &parent->rb_right;
+			leftmost = 0;
+		}
+	}
+
+	rb_link_node(&task->node, parent, link);
+	rb_insert_color_cached(&task->node, &sched->rtready, leftmost);
+}
+
 static inline void scheduler_enqueue_task(struct scheduler_t * sched, struct task_t * task)
 {
 	struct rb_node ** link = &sched->ready.rb_root.rb_node;
@@ -128,6 +267,12 @@ static inline void scheduler_enqueue_task(struct scheduler_t * sched, struct tas
 	struct task_t * next, * entry;
 	int leftmost = 1;
 
+	if(task->period)
+	{
+		scheduler_enqueue_rt_task(sched, task);
+		return;
+	}
+
 	while(*link)
 	{
 		parent = *link;
@@ -145,7 +290,7 @@ static inline void scheduler_enqueue_task(struct scheduler_t * sched, struct tas
 
 	rb_link_node(&task->node, parent, link);
 	rb_insert_color_cached(&task->node, &sched->ready, leftmost);
-	next = scheduler_next_ready_task(sched);
+	next = scheduler_next_fair_task(sched);
 	if(likely(next))
 		sched->min_vtime = next->vtime;
 	else if(sched->running)
@@ -158,8 +303,13 @@ static inline void scheduler_dequeue_task(struct scheduler_t * sched, struct tas
 {
 	struct task_t * next;
 
+	if(task->period)
+	{
+		rb_erase_cached(&task->node, &sched->rtready);
+		return;
+	}
 	rb_erase_cached(&task->node, &sched->ready);
-	next = scheduler_next_ready_task(sched);
+	next = scheduler_next_fair_task(sched);
 	if(likely(next))
 		sched->min_vtime = next->vtime;
 	else if(sched->running)
@@ -168,13 +318,72 @@ static inline void scheduler_dequeue_task(struct scheduler_t * sched, struct tas
 		sched->min_vtime = 0;
 }
 
-static inline void scheduler_switch_task(struct scheduler_t * sched, struct task_t * task)
+/*
+ * Hand the cpu over to the next task with the scheduler lock held, accounting the
+ * run and wait time of both sides. Prev is NULL when nothing was running before.
+ */
+static inline void scheduler_set_running(struct scheduler_t * sched, struct task_t * prev, struct task_t * next, uint64_t now)
+{
+	if(prev)
+	{
+		task_charge(prev, now);
+		sched_trace(SCHED_TRACE_SWITCH_OUT, prev, now);
+	}
+	next->waittime += now - next->ready;
+	next->switches++;
+	sched_trace(SCHED_TRACE_SWITCH_IN, next, now);
+	sched->running = next;
+	next->status = TASK_STATUS_RUNNING;
+	next->start = now;
+}
+
+#if defined(CONFIG_TASK_STACK_GUARD) && (CONFIG_TASK_STACK_GUARD > 0)
+#define TASK_STACK_GUARD_MAGIC		(0x5a5aa5a5)
+#define TASK_STACK_GUARD_WORDS		(4)
+
+static inline void task_stack_guard_init(struct task_t * task)
+{
+	uint32_t * p = (uint32_t *)task->stack;
+	int i;
+
+	for(i = 0; i < TASK_STACK_GUARD_WORDS; i++)
+		p[i] = TASK_STACK_GUARD_MAGIC;
+}
+
+static inline void task_stack_guard_check(struct task_t * task)
+{
+	uint32_t * p = (uint32_t *)task->stack;
+	int i;
+
+	for(i = 0; i < TASK_STACK_GUARD_WORDS; i++)
+	{
+		if(p[i] != TASK_STACK_GUARD_MAGIC)
+		{
+			LOG("Task '%s' stack overflow [%p - %p]", task->name ? task->name : "", task->stack, task->stack + task->stksz);
+			task_stack_guard_init(task);
+			break;
+		}
+	}
+}
+#else
+static inline void task_stack_guard_init(struct task_t * task)
+{
+}
+
+static inline void task_stack_guard_check(struct task_t * task)
 {
-	struct task_t * running = sched->running;
-	sched->running = task;
-	struct transfer_t from = jump_fcontext(task->fctx, running);
+}
+#endif
+
+static inline void scheduler_switch_task(struct task_t * prev, struct task_t * next)
+{
+	if(prev != next)
+		task_stack_guard_check(prev);
+	struct transfer_t from = jump_fcontext(next->fctx, prev);
 	struct task_t * t = (struct task_t *)from.priv;
 	t->fctx = from.fctx;
+	smp_wmb();
+	t->oncpu = 0;
 }
 
 static inline struct scheduler_t * scheduler_load_balance_choice(void)
@@ -194,44 +403,305 @@ static inline struct scheduler_t * scheduler_load_balance_choice(void)
 	return sched;
 }
 
+#if defined(CONFIG_MAX_SMP_CPUS) && (CONFIG_MAX_SMP_CPUS > 1)
+/*
+ * Pull one ready task from the busiest scheduler. An idle scheduler takes anything it
+ * can get, otherwise the move must shrink the weight imbalance. Tasks whose context
+ * has not been saved yet are still on their old cpu and can't be moved, nor can the
+ * pinned per-cpu idle tasks.
+ */
+static int scheduler_pull_task(struct scheduler_t * sched, int idle)
+{
+	struct scheduler_t * busiest = NULL;
+	struct scheduler_t * first, * second;
+	struct task_t * task;
+	struct rb_node * rb;
+	uint64_t weight = sched->weight;
+	uint64_t imbalance, w;
+	irq_flags_t flags;
+	int moved = 0;
+	int i;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		if((&__sched[i] != sched) && (__sched[i].weight > weight) && !RB_EMPTY_ROOT(&__sched[i].ready.rb_root))
+		{
+			busiest = &__sched[i];
+			weight = __sched[i].weight;
+		}
+	}
+	if(!busiest)
+		return 0;
+
+	first = (sched < busiest) ? sched : busiest;
+	second = (sched < busiest) ? busiest : sched;
+	spin_lock_irqsave(&first->lock, flags);
+	spin_lock(&second->lock);
+	if(busiest->weight > sched->weight)
+	{
+		imbalance = busiest->weight - sched->weight;
+		for(rb = rb_last(&busiest->ready.rb_root); rb; rb = rb_prev(rb))
+		{
+			task = rb_entry(rb, struct task_t, node);
+			w = nice_to_weight[task->nice];
+			if(task->oncpu || task->pinned)
+				continue;
+			if(!idle && (w >= imbalance))
+				continue;
+			smp_rmb();
+			task->vtime = task->vtime - busiest->min_vtime + sched->min_vtime;
+			scheduler_dequeue_task(busiest, task);
+			busiest->weight -= w;
+			task->sched = sched;
+			sched->weight += w;
+			scheduler_enqueue_task(sched, task);
+			moved = 1;
+			break;
+		}
+	}
+	spin_unlock(&second->lock);
+	spin_unlock_irqrestore(&first->lock, flags);
+
+	return moved;
+}
+
+static inline void scheduler_balance(struct scheduler_t * sched, uint64_t now)
+{
+	if((int64_t)(now - sched->balance) >= 0)
+	{
+		sched->balance = now + CONFIG_SCHED_BALANCE_INTERVAL * 1000000ULL;
+		scheduler_pull_task(sched, 0);
+	}
+}
+#else
+static inline int scheduler_pull_task(struct scheduler_t * sched, int idle)
+{
+	return 0;
+}
+
+static inline void scheduler_balance(struct scheduler_t * sched, uint64_t now)
+{
+}
+#endif
+
+struct task_name_t {
+	struct hlist_node node;
+	int ref;
+	char name[1];
+};
+
+static struct hlist_head __task_name_hash[CONFIG_TASK_NAME_HASH_SIZE];
+static spinlock_t __task_name_lock = SPIN_LOCK_INIT();
+
+static struct task_name_t * __task_name_search(struct hlist_head * head, const char * name)
+{
+	struct task_name_t * pos;
+	struct hlist_node * n;
+
+	hlist_for_each_entry_safe(pos, n, head, node)
+	{
+		if(strcmp(pos->name, name) == 0)
+			return pos;
+	}
+	return NULL;
+}
+
+/*
+ * Task, framebuffer and input names come from a small set, so tasks share one counted
+ * copy of each, which goes away with the last task using it.
+ */
+static const char * task_name_intern(const char * name)
+{
+	struct hlist_head * head;
+	struct task_name_t * tn, * pos;
+	irq_flags_t flags;
+
+	if(!name)
+		return NULL;
+
+	head = &__task_name_hash[shash(name) % CONFIG_TASK_NAME_HASH_SIZE];
+	spin_lock_irqsave(&__task_name_lock, flags);
+	pos = __task_name_search(head, name);
+	if(pos)
+		pos->ref++;
+	spin_unlock_irqrestore(&__task_name_lock, flags);
+	if(pos)
+		return pos->name;
+
+	tn = malloc(sizeof(struct task_name_t) + strlen(name));
+	if(!tn)
+		return NULL;
+	tn->ref = 1;
+	strcpy(tn->name, name);
+
+	spin_lock_irqsave(&__task_name_lock, flags);
+	pos = __task_name_search(head, name);
+	if(pos)
+		pos->ref++;
+	else
+		hlist_add_head(&tn->node, head);
+	spin_unlock_irqrestore(&__task_name_lock, flags);
+	if(pos)
+	{
+		free(tn);
+		return pos->name;
+	}
+	return tn->name;
+}
+
+static void task_name_release(const char * name)
+{
+	struct task_name_t * tn;
+	irq_flags_t flags;
+
+	if(!name)
+		return;
+
+	tn = container_of(name, struct task_name_t, name[0]);
+	spin_lock_irqsave(&__task_name_lock, flags);
+	if(--tn->ref == 0)
+		hlist_del(&tn->node);
+	else
+		tn = NULL;
+	spin_unlock_irqrestore(&__task_name_lock, flags);
+	if(tn)
+		free(tn);
+}
+
+/*
+ * Stacks are sized in four classes per power of two, which wastes at most a quarter
+ * of the request while still letting the cache reuse stacks of nearby sizes.
+ */
+static inline size_t task_stack_class(size_t stksz)
+{
+	size_t step = max((size_t)(rounddown_pow_of_two(stksz) >> 2), (size_t)16);
+
+	return (stksz + step - 1) & ~(step - 1);
+}
+
+/*
+ * Exited tasks are kept with their stacks on a per scheduler cache, linked through
+ * the wait list which is unused once a task is dead. Entries whose context is still
+ * being switched away from, and joinable tasks nobody has joined or detached yet,
+ * are skipped.
+ */
+static struct task_t * task_cache_get(struct scheduler_t * sched, size_t stksz)
+{
+	struct task_t * pos, * n, * task = NULL;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&sched->lock, flags);
+	list_for_each_entry_safe(pos, n, &sched->dead, wlist)
+	{
+		if((pos->stksz == stksz) && !pos->oncpu && !pos->joinable && !pos->joiners)
+		{
+			list_del_init(&pos->wlist);
+			sched->ndead--;
+			task = pos;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&sched->lock, flags);
+
+	return task;
+}
+
+static void task_cache_put(struct scheduler_t * sched, struct task_t * task)
+{
+	struct task_t * pos, * n, * victim = NULL;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&sched->lock, flags);
+	if(sched->ndead >= CONFIG_TASK_CACHE_SIZE)
+	{
+		list_for_each_entry_safe(pos, n, &sched->dead, wlist)
+		{
+			if(!pos->oncpu && !pos->joinable && !pos->joiners)
+			{
+				list_del_init(&pos->wlist);
+				sched->ndead--;
+				victim = pos;
+				break;
+			}
+		}
+	}
+	list_add_tail(&task->wlist, &sched->dead);
+	sched->ndead++;
+	spin_unlock_irqrestore(&sched->lock, flags);
+
+	if(victim)
+	{
+		free(victim->stack);
+		free(victim);
+	}
+}
+
+static int task_replenish_timer_function(struct timer_t * timer, void * data)
+{
+	struct task_t * task = (struct task_t *)data;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&task->sched->lock, flags);
+	task_deadline_renew(task, ktime_to_ns(ktime_get()));
+	task->throttled = 0;
+	spin_unlock_irqrestore(&task->sched->lock, flags);
+	task_resume(task);
+
+	return 0;
+}
+
 static void fcontext_entry(struct transfer_t from)
 {
 	struct task_t * t = (struct task_t *)from.priv;
-	struct scheduler_t * sched = t->sched;
+	struct scheduler_t * sched = scheduler_self();
 	struct task_t * task = sched->running;
+	struct task_t * next;
+	irq_flags_t flags;
 
 	t->fctx = from.fctx;
+	smp_wmb();
+	t->oncpu = 0;
 	task->func(task, task->data);
-	uint32_t weight = nice_to_weight[task->nice];
-	if(task->name)
-		free(task->name);
-	if(task->fb)
-		free(task->fb);
-	if(task->input)
-		free(task->input);
-	if(task->stack)
-		free(task->stack);
-	free(task);
-
-	spin_lock(&sched->lock);
-	sched->weight -= weight;
-	struct task_t * next = scheduler_next_ready_task(sched);
-	if(likely(next))
-	{
-		scheduler_dequeue_task(sched, next);
-		next->start = ktime_to_ns(ktime_get());
-		spin_unlock(&sched->lock);
-		scheduler_switch_task(sched, next);
-	}
-	else
+
+	/*
+	 * Still running on the dead task's stack, so it stays marked on cpu until the next
+	 * task has saved our context, only then may the cache hand it out again.
+	 */
+	spin_lock(&__task_lock);
+	list_del_init(&task->list);
+	task->exited = 1;
+	spin_unlock(&__task_lock);
+	waitqueue_wakeup_all(&task->exitwq);
+
+	task_name_release(task->name);
+	task_name_release(task->fb);
+	task_name_release(task->input);
+	task->name = NULL;
+	task->fb = NULL;
+	task->input = NULL;
+
+	sched = scheduler_self();
+	task->oncpu = 1;
+	task_cache_put(sched, task);
+
+	spin_lock_irqsave(&sched->lock, flags);
+	sched->weight -= nice_to_weight[task->nice];
+	sched->rtutil -= task_deadline_util(task->period, task->budget);
+	while(!(next = scheduler_next_ready_task(sched)))
 	{
-		spin_unlock(&sched->lock);
+		spin_unlock_irqrestore(&sched->lock, flags);
+		spin_lock_irqsave(&sched->lock, flags);
 	}
+	scheduler_dequeue_task(sched, next);
+	scheduler_set_running(sched, task, next, ktime_to_ns(ktime_get()));
+	spin_unlock_irqrestore(&sched->lock, flags);
+	scheduler_switch_task(task, next);
 }
 
-struct task_t * task_create(struct scheduler_t * sched, const char * name, const char * fb, const char * input, task_func_t func, void * data, size_t stksz, int nice)
+static struct task_t * __task_create(struct scheduler_t * sched, const char * name, const char * fb, const char * input, task_func_t func, void * data, size_t stksz, int nice, int pinned, int joinable)
 {
 	struct task_t * task;
+	irq_flags_t flags;
 	void * stack;
 
 	if(!func)
@@ -242,6 +712,7 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, const
 
 	if(stksz <= 0)
 		stksz = CONFIG_TASK_STACK_SIZE;
+	stksz = task_stack_class(stksz);
 
 	if(nice < -20)
 		nice = 0;
@@ -250,44 +721,88 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, const
 	else
 		nice += 20;
 
-	task = malloc(sizeof(struct task_t));
+	task = task_cache_get(sched, stksz);
 	if(!task)
-		return NULL;
-
-	stack = malloc(stksz);
-	if(!stack)
 	{
-		free(task);
-		return NULL;
+		task = malloc(sizeof(struct task_t));
+		if(!task)
+			return NULL;
+
+		stack = malloc(stksz);
+		if(!stack)
+		{
+			free(task);
+			return NULL;
+		}
+		task->stack = stack;
+		task->stksz = stksz;
 	}
 
 	RB_CLEAR_NODE(&task->node);
-	task->name = strdup(name);
-	task->fb = strdup(fb);
-	task->input = strdup(input);
+	init_list_head(&task->wlist);
+	task->name = task_name_intern(name);
+	task->fb = task_name_intern(fb);
+	task->input = task_name_intern(input);
 	task->start = ktime_to_ns(ktime_get());
 	task->vtime = 0;
+	task->ready = task->start;
+	task->runtime = 0;
+	task->waittime = 0;
+	task->switches = 0;
 	task->sched = sched;
-	task->stack = stack;
-	task->stksz = stksz;
+	task->status = TASK_STATUS_READY;
 	task->nice = nice;
 	task->dynice = nice;
+	task->period = 0;
+	task->budget = 0;
+	task->deadline = 0;
+	task->remain = 0;
+	task->misses = 0;
+	task->throttled = 0;
+	timer_init(&task->rtimer, task_replenish_timer_function, task);
+	task->oncpu = 0;
+	task->pinned = pinned;
+	task->joinable = joinable;
+	task->exited = 0;
+	task->joiners = 0;
+	waitqueue_init(&task->exitwq);
+	task_stack_guard_init(task);
 	task->fctx = make_fcontext(task->stack + stksz, task->stksz, fcontext_entry);
 	task->func = func;
 	task->data = data;
 	task->__errno = 0;
 
-	spin_lock(&sched->lock);
+	spin_lock(&__task_lock);
+	list_add_tail(&task->list, &__task_list);
+	spin_unlock(&__task_lock);
+
+	spin_lock_irqsave(&sched->lock, flags);
 	task->vtime = sched->min_vtime;
 	sched->weight += nice_to_weight[nice];
 	scheduler_enqueue_task(sched, task);
-	spin_unlock(&sched->lock);
+	spin_unlock_irqrestore(&sched->lock, flags);
 
 	return task;
 }
 
+struct task_t * task_create(struct scheduler_t * sched, const char * name, const char * fb, const char * input, task_func_t func, void * data, size_t stksz, int nice)
+{
+	return __task_create(sched, name, fb, input, func, data, stksz, nice, 0, 0);
+}
+
+/*
+ * Like task_create, but the task stays valid after it has exited until it is reaped
+ * with task_join or released with task_detach, exactly one of which must be called.
+ */
+struct task_t * task_create_joinable(struct scheduler_t * sched, const char * name, const char * fb, const char * input, task_func_t func, void * data, size_t stksz, int nice)
+{
+	return __task_create(sched, name, fb, input, func, data, stksz, nice, 0, 1);
+}
+
 void task_nice(struct task_t * task, int nice)
 {
+	irq_flags_t flags;
+
 	if(nice < -20)
 		nice = 0;
 	else if(nice > 19)
@@ -297,12 +812,97 @@ void task_nice(struct task_t * task, int nice)
 
 	if(task->nice != nice)
 	{
-		spin_lock(&task->sched->lock);
-		task->sched->weight -= nice_to_weight[task->nice];
-		task->sched->weight += nice_to_weight[nice];
+		spin_lock_irqsave(&task->sched->lock, flags);
+		if((task->status != TASK_STATUS_SUSPEND) || (task == task->sched->running))
+		{
+			task->sched->weight -= nice_to_weight[task->nice];
+			task->sched->weight += nice_to_weight[nice];
+		}
 		task->nice = nice;
 		task->dynice = nice;
-		spin_unlock(&task->sched->lock);
+		spin_unlock_irqrestore(&task->sched->lock, flags);
+	}
+}
+
+/*
+ * Move a task into the deadline class, it then gets up to budget of cpu time every
+ * period ahead of all fair tasks. The request is refused if the scheduler's total
+ * deadline utilization would exceed CONFIG_SCHED_DEADLINE_UTIL per mille. A zero
+ * period puts the task back into the fair class.
+ */
+bool_t task_deadline(struct task_t * task, ktime_t period, ktime_t budget)
+{
+	struct scheduler_t * sched;
+	int64_t p = ktime_to_ns(period);
+	int64_t b = ktime_to_ns(budget);
+	uint64_t util, old;
+	irq_flags_t flags;
+	int queued;
+
+	if(!task || task->throttled)
+		return FALSE;
+
+	if(p <= 0)
+	{
+		p = 0;
+		b = 0;
+	}
+	else if((b <= 0) || (b > p))
+	{
+		return FALSE;
+	}
+
+	sched = task->sched;
+	util = task_deadline_util(p, b);
+	spin_lock_irqsave(&sched->lock, flags);
+	old = task_deadline_util(task->period, task->budget);
+	if(sched->rtutil - old + util > CONFIG_SCHED_DEADLINE_UTIL)
+	{
+		spin_unlock_irqrestore(&sched->lock, flags);
+		return FALSE;
+	}
+	queued = ((task->status == TASK_STATUS_READY) && (task != sched->running)) ? 1 : 0;
+	if(queued)
+		scheduler_dequeue_task(sched, task);
+	sched->rtutil = sched->rtutil - old + util;
+	task->period = p;
+	task->budget = b;
+	task->remain = b;
+	task->deadline = ktime_to_ns(ktime_get()) + p;
+	if(!p)
+		task->vtime = sched->min_vtime;
+	if(queued)
+		scheduler_enqueue_task(sched, task);
+	spin_unlock_irqrestore(&sched->lock, flags);
+
+	return TRUE;
+}
+
+/*
+ * End the current job of a deadline task and sleep until its next period begins.
+ * A job finishing past its deadline is counted as a miss and the next one starts
+ * right away.
+ */
+void task_wait_period(void)
+{
+	struct task_t * self = task_self();
+	irq_flags_t flags;
+	uint64_t now;
+
+	if(!self || !self->period)
+		return;
+
+	now = ktime_to_ns(ktime_get());
+	if((int64_t)(self->deadline - now) > 0)
+	{
+		task_sleep(ns_to_ktime(self->deadline - now));
+	}
+	else
+	{
+		spin_lock_irqsave(&self->sched->lock, flags);
+		self->misses++;
+		task_deadline_renew(self, now);
+		spin_unlock_irqrestore(&self->sched->lock, flags);
 	}
 }
 
@@ -311,29 +911,357 @@ void task_yield(void)
 	struct scheduler_t * sched = scheduler_self();
 	struct task_t * self = task_self();
 	uint64_t now = ktime_to_ns(ktime_get());
+	irq_flags_t flags;
 
 	self->vtime += calc_delta_fair(self, now - self->start);
-	if((int64_t)(self->vtime - sched->min_vtime) < 0)
+	scheduler_balance(sched, now);
+	if(self->period && (self->remain - (int64_t)(now - self->start) <= 0))
 	{
-		self->start = now;
+		spin_lock_irqsave(&sched->lock, flags);
+		task_charge(self, now);
+		if((int64_t)(self->deadline - now) > 0)
+		{
+			self->throttled = 1;
+			self->status = TASK_STATUS_SUSPEND;
+			spin_unlock_irqrestore(&sched->lock, flags);
+			timer_start(&self->rtimer, ns_to_ktime(self->deadline - now));
+			task_schedule();
+			return;
+		}
+		self->misses++;
+		task_deadline_renew(self, now);
+		spin_unlock_irqrestore(&sched->lock, flags);
+	}
+	if(RB_EMPTY_ROOT(&sched->rtready.rb_root) && !self->period && ((int64_t)(self->vtime - sched->min_vtime) < 0))
+	{
+		task_charge(self, now);
 	}
 	else
 	{
-		spin_lock(&sched->lock);
+		spin_lock_irqsave(&sched->lock, flags);
+		self->status = TASK_STATUS_READY;
+		self->ready = now;
 		scheduler_enqueue_task(sched, self);
 		struct task_t * next = scheduler_next_ready_task(sched);
+		scheduler_dequeue_task(sched, next);
+		if(likely(next != self))
+		{
+			scheduler_set_running(sched, self, next, now);
+			self->oncpu = 1;
+			spin_unlock_irqrestore(&sched->lock, flags);
+			scheduler_switch_task(self, next);
+		}
+		else
+		{
+			self->status = TASK_STATUS_RUNNING;
+			task_charge(self, now);
+			spin_unlock_irqrestore(&sched->lock, flags);
+		}
+	}
+}
+
+/*
+ * Give up the cpu. A task marked as suspended is parked off the ready tree until
+ * someone calls task_resume, otherwise this returns immediately. If there is nothing
+ * else to run, the caller idles in place waiting for an interrupt driven wakeup.
+ */
+void task_schedule(void)
+{
+	struct scheduler_t * sched = scheduler_self();
+	struct task_t * self = task_self();
+	struct task_t * next;
+	irq_flags_t flags;
+	uint64_t now;
+
+	if(!self)
+		return;
+
+	spin_lock_irqsave(&sched->lock, flags);
+	while(self->status == TASK_STATUS_SUSPEND)
+	{
+		next = scheduler_next_ready_task(sched);
 		if(likely(next))
 		{
+			now = ktime_to_ns(ktime_get());
+			self->vtime += calc_delta_fair(self, now - self->start);
+			sched->weight -= nice_to_weight[self->nice];
 			scheduler_dequeue_task(sched, next);
-			next->start = now;
-			spin_unlock(&sched->lock);
-			if(likely(next != self))
-				scheduler_switch_task(sched, next);
+			scheduler_set_running(sched, self, next, now);
+			self->oncpu = 1;
+			spin_unlock_irqrestore(&sched->lock, flags);
+			scheduler_switch_task(self, next);
+			return;
 		}
-		else
+		spin_unlock_irqrestore(&sched->lock, flags);
+		spin_lock_irqsave(&sched->lock, flags);
+	}
+	spin_unlock_irqrestore(&sched->lock, flags);
+}
+
+void task_suspend(struct task_t * task)
+{
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+
+	if(task)
+	{
+		sched = task->sched;
+		spin_lock_irqsave(&sched->lock, flags);
+		if(task->status == TASK_STATUS_READY)
+		{
+			scheduler_dequeue_task(sched, task);
+			sched->weight -= nice_to_weight[task->nice];
+		}
+		task->status = TASK_STATUS_SUSPEND;
+		spin_unlock_irqrestore(&sched->lock, flags);
+		if(task == task_self())
+			task_schedule();
+	}
+}
+
+void task_resume(struct task_t * task)
+{
+	struct scheduler_t * sched;
+	irq_flags_t flags;
+
+	if(task)
+	{
+		sched = task->sched;
+		spin_lock_irqsave(&sched->lock, flags);
+		if((task->status == TASK_STATUS_SUSPEND) && !task->throttled)
+		{
+			if(task == sched->running)
+			{
+				task->status = TASK_STATUS_RUNNING;
+			}
+			else
+			{
+				if((int64_t)(task->vtime - sched->min_vtime) < 0)
+					task->vtime = sched->min_vtime;
+				task->status = TASK_STATUS_READY;
+				task->ready = ktime_to_ns(ktime_get());
+				if(task->period && ((int64_t)(task->deadline - task->ready) <= 0))
+					task_deadline_renew(task, task->ready);
+				sched->weight += nice_to_weight[task->nice];
+				scheduler_enqueue_task(sched, task);
+				sched_trace(SCHED_TRACE_WAKEUP, task, task->ready);
+			}
+		}
+		spin_unlock_irqrestore(&sched->lock, flags);
+	}
+}
+
+static int task_sleep_timer_function(struct timer_t * timer, void * data)
+{
+	task_resume((struct task_t *)data);
+	return 0;
+}
+
+void task_sleep(ktime_t interval)
+{
+	struct task_t * self = task_self();
+	ktime_t timeout = ktime_add_safe(ktime_get(), interval);
+	struct timer_t timer;
+
+	if(!self)
+	{
+		while(ktime_before(ktime_get(), timeout));
+		return;
+	}
+
+	timer_init(&timer, task_sleep_timer_function, self);
+	while(ktime_before(ktime_get(), timeout))
+	{
+		task_prepare_wait();
+		timer_start(&timer, ktime_sub(timeout, ktime_get()));
+		task_schedule();
+		timer_cancel(&timer);
+	}
+}
+
+/*
+ * Block until the task function has returned. A joinable task is reaped here and its
+ * handle is invalid afterwards. Any other task is only guaranteed to stay valid while
+ * it is running, as once exited its handle may be recycled by the next task_create.
+ */
+void task_join(struct task_t * task)
+{
+	if(!task || (task == task_self()))
+		return;
+
+	spin_lock(&__task_lock);
+	if(task->exited)
+	{
+		spin_unlock(&__task_lock);
+		task_detach(task);
+		return;
+	}
+	task->joiners++;
+	spin_unlock(&__task_lock);
+
+	while(!task->exited)
+	{
+		waitqueue_prepare(&task->exitwq);
+		if(!task->exited)
+			task_schedule();
+		waitqueue_finish(&task->exitwq);
+	}
+
+	spin_lock(&__task_lock);
+	task->joiners--;
+	spin_unlock(&__task_lock);
+	task_detach(task);
+}
+
+/*
+ * Give up the right to join a joinable task, once exited it returns to the dead task
+ * cache like any other
+ */
+void task_detach(struct task_t * task)
+{
+	if(task)
+	{
+		smp_mb();
+		task->joinable = 0;
+	}
+}
+
+/*
+ * Mark the current task suspended ahead of task_schedule, for waiters that register
+ * on wakeup sources of their own. A task_resume in between turns the following
+ * task_schedule into a no-op, so the caller must recheck its condition after this.
+ */
+void task_prepare_wait(void)
+{
+	struct task_t * self = task_self();
+	irq_flags_t flags;
+
+	if(self)
+	{
+		spin_lock_irqsave(&self->sched->lock, flags);
+		self->status = TASK_STATUS_SUSPEND;
+		spin_unlock_irqrestore(&self->sched->lock, flags);
+	}
+}
+
+void task_finish_wait(void)
+{
+	struct task_t * self = task_self();
+	irq_flags_t flags;
+
+	if(self)
+	{
+		spin_lock_irqsave(&self->sched->lock, flags);
+		self->status = TASK_STATUS_RUNNING;
+		spin_unlock_irqrestore(&self->sched->lock, flags);
+	}
+}
+
+void waitqueue_init(struct waitqueue_t * wq)
+{
+	if(wq)
+	{
+		init_list_head(&wq->list);
+		spin_lock_init(&wq->lock);
+	}
+}
+
+/*
+ * Queue the current task on the wait queue and mark it suspended. The caller must
+ * recheck its wait condition, call task_schedule if still unsatisfied, and finally
+ * waitqueue_finish. A wakeup between the two is never lost.
+ */
+void waitqueue_prepare(struct waitqueue_t * wq)
+{
+	struct task_t * self = task_self();
+	irq_flags_t flags;
+
+	if(wq && self)
+	{
+		spin_lock_irqsave(&wq->lock, flags);
+		if(list_empty(&self->wlist))
+			list_add_tail(&self->wlist, &wq->list);
+		task_prepare_wait();
+		spin_unlock_irqrestore(&wq->lock, flags);
+	}
+}
+
+void waitqueue_finish(struct waitqueue_t * wq)
+{
+	struct task_t * self = task_self();
+	irq_flags_t flags;
+
+	if(wq && self)
+	{
+		spin_lock_irqsave(&wq->lock, flags);
+		if(!list_empty(&self->wlist))
+			list_del_init(&self->wlist);
+		task_finish_wait();
+		spin_unlock_irqrestore(&wq->lock, flags);
+	}
+}
+
+static int __waitqueue_wakeup(struct waitqueue_t * wq, int nr)
+{
+	struct task_t * pos, * n;
+	irq_flags_t flags;
+	int count = 0;
+
+	if(wq)
+	{
+		/*
+		 * Pairs with the condition recheck after waitqueue_prepare, either the waiter
+		 * sees the new state or we see it queued.
+		 */
+		smp_mb();
+		if(list_empty(&wq->list))
+			return 0;
+		spin_lock_irqsave(&wq->lock, flags);
+		list_for_each_entry_safe(pos, n, &wq->list, wlist)
 		{
-			spin_unlock(&sched->lock);
+			if((nr > 0) && (count >= nr))
+				break;
+			list_del_init(&pos->wlist);
+			task_resume(pos);
+			count++;
 		}
+		spin_unlock_irqrestore(&wq->lock, flags);
+	}
+	return count;
+}
+
+int waitqueue_wakeup(struct waitqueue_t * wq)
+{
+	return __waitqueue_wakeup(wq, 1);
+}
+
+int waitqueue_wakeup_all(struct waitqueue_t * wq)
+{
+	return __waitqueue_wakeup(wq, 0);
+}
+
+/*
+ * Nothing is ready, so try stealing work from another cpu first, then halt until the
+ * next interrupt. The timer core keeps the clockevent programmed for the earliest
+ * pending deadline, there is no periodic tick.
+ */
+static void scheduler_idle(struct scheduler_t * sched)
+{
+	irq_flags_t flags;
+
+	if(!scheduler_has_ready_task(sched) && scheduler_pull_task(sched, 1))
+		return;
+
+	spin_lock_irqsave(&sched->lock, flags);
+	if(!scheduler_has_ready_task(sched))
+	{
+		spin_unlock(&sched->lock);
+		wfi();
+		local_irq_restore(flags);
+	}
+	else
+	{
+		spin_unlock_irqrestore(&sched->lock, flags);
 	}
 }
 
@@ -341,30 +1269,32 @@ static void secondary_idle_task(struct task_t * task, void * data)
 {
 	while(1)
 	{
+		scheduler_idle(task->sched);
 		task_yield();
 	}
 }
 
 static void smpboot_entry(void)
 {
+	irq_flags_t flags;
+
 	machine_smpinit();
 
 	struct scheduler_t * sched = scheduler_self();
-	task_create(sched, "idle", NULL, NULL, secondary_idle_task, (int[]){smp_processor_id()}, SZ_8K, 19);
+	__task_create(sched, "idle", NULL, NULL, secondary_idle_task, (int[]){smp_processor_id()}, SZ_8K, 19, 1, 0);
 
-	spin_lock(&sched->lock);
+	spin_lock_irqsave(&sched->lock, flags);
 	struct task_t * next = scheduler_next_ready_task(sched);
 	if(likely(next))
 	{
-		sched->running = next;
 		scheduler_dequeue_task(sched, next);
-		next->start = ktime_to_ns(ktime_get());
-		spin_unlock(&sched->lock);
-		scheduler_switch_task(sched, next);
+		scheduler_set_running(sched, NULL, next, ktime_to_ns(ktime_get()));
+		spin_unlock_irqrestore(&sched->lock, flags);
+		scheduler_switch_task(next, next);
 	}
 	else
 	{
-		spin_unlock(&sched->lock);
+		spin_unlock_irqrestore(&sched->lock, flags);
 	}
 }
 
@@ -373,6 +1303,7 @@ static void primary_idle_task(struct task_t * task, void * data)
 	machine_smpboot(smpboot_entry);
 	while(1)
 	{
+		scheduler_idle(task->sched);
 		task_yield();
 	}
 }
@@ -380,7 +1311,74 @@ static void primary_idle_task(struct task_t * task, void * data)
 void do_idle_task(void)
 {
 	struct scheduler_t * sched = scheduler_self();
-	task_create(sched, "idle", NULL, NULL, primary_idle_task, (int[]){smp_processor_id()}, SZ_8K, 19);
+	__task_create(sched, "idle", NULL, NULL, primary_idle_task, (int[]){smp_processor_id()}, SZ_8K, 19, 1, 0);
+}
+
+static struct kobj_t * search_class_scheduler_kobj(void)
+{
+	struct kobj_t * kclass = kobj_search_directory_with_create(kobj_get_root(), "class");
+	return kobj_search_directory_with_create(kclass, "scheduler");
+}
+
+static const char * task_status_name(struct task_t * task)
+{
+	switch(task->status)
+	{
+	case TASK_STATUS_READY:
+		return "ready";
+	case TASK_STATUS_RUNNING:
+		return "running";
+	case TASK_STATUS_SUSPEND:
+		return "suspend";
+	default:
+		break;
+	}
+	return "unknown";
+}
+
+static ssize_t scheduler_read_tasks(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct task_t * pos, * n;
+	char * p = buf;
+	int len = 0;
+
+	spin_lock(&__task_lock);
+	list_for_each_entry_safe(pos, n, &__task_list, list)
+	{
+		if(len >= size)
+			break;
+		len += snprintf((char *)(p + len), size - len, " %-16s cpu%d %-8s %3d %12llu %12llu %10llu %8llu %8llu %8llu\r\n",
+			pos->name ? pos->name : "", (int)(pos->sched - &__sched[0]), task_status_name(pos), pos->nice - 20,
+			(unsigned long long)(pos->runtime / 1000), (unsigned long long)(pos->waittime / 1000), (unsigned long long)pos->switches,
+			(unsigned long long)(pos->period / 1000), (unsigned long long)(pos->budget / 1000), (unsigned long long)pos->misses);
+	}
+	spin_unlock(&__task_lock);
+	return min(len, (int)size);
+}
+
+static ssize_t scheduler_read_trace(struct kobj_t * kobj, void * buf, size_t size)
+{
+	static const char * type[] = { "in", "out", "wakeup" };
+	struct sched_trace_t * trace;
+	char * p = buf;
+	int len = 0;
+	int cpu, i, n;
+
+	trace = malloc(sizeof(struct sched_trace_t) * max(CONFIG_SCHED_TRACE_SIZE, 1));
+	if(!trace)
+		return 0;
+	for(cpu = 0; cpu < CONFIG_MAX_SMP_CPUS; cpu++)
+	{
+		n = scheduler_trace_snapshot(cpu, trace, CONFIG_SCHED_TRACE_SIZE);
+		for(i = 0; (i < n) && (len < size); i++)
+		{
+			len += snprintf((char *)(p + len), size - len, " cpu%d %llu.%09llu %-6s %s\r\n", cpu,
+				(unsigned long long)(trace[i].time / 1000000000ULL), (unsigned long long)(trace[i].time % 1000000000ULL),
+				type[trace[i].type], trace[i].name);
+		}
+	}
+	free(trace);
+	return min(len, (int)size);
 }
 
 void do_init_sched(void)
@@ -391,28 +1389,36 @@ void do_init_sched(void)
 		spin_lock_init(&sched->lock);
 		spin_lock(&sched->lock);
 		sched->ready = RB_ROOT_CACHED;
+		sched->rtready = RB_ROOT_CACHED;
+		sched->rtutil = 0;
 		sched->running = NULL;
 		sched->min_vtime = 0;
 		sched->weight = 0;
+		sched->balance = 0;
+		init_list_head(&sched->dead);
+		sched->ndead = 0;
 		spin_unlock(&sched->lock);
 	}
+	kobj_add_regular(search_class_scheduler_kobj(), "tasks", scheduler_read_tasks, NULL, NULL);
+	kobj_add_regular(search_class_scheduler_kobj(), "trace", scheduler_read_trace, NULL, NULL);
 }
 
 void scheduler_loop(void)
 {
 	struct scheduler_t * sched = scheduler_self();
-	spin_lock(&sched->lock);
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&sched->lock, flags);
 	struct task_t * next = scheduler_next_ready_task(sched);
 	if(likely(next))
 	{
-		sched->running = next;
 		scheduler_dequeue_task(sched, next);
-		next->start = ktime_to_ns(ktime_get());
-		spin_unlock(&sched->lock);
-		scheduler_switch_task(sched, next);
+		scheduler_set_running(sched, NULL, next, ktime_to_ns(ktime_get()));
+		spin_unlock_irqrestore(&sched->lock, flags);
+		scheduler_switch_task(next, next);
 	}
 	else
 	{
-		spin_unlock(&sched->lock);
+		spin_unlock_irqrestore(&sched->lock, flags);
 	}
 }
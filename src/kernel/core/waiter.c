@@ -35,6 +35,7 @@ void waiter_init(struct waiter_t * w)
 	{
 		w->count = 0;
 		spin_lock_init(&w->lock);
+		waitqueue_init(&w->wq);
 	}
 }
 
@@ -50,25 +51,29 @@ void waiter_add(struct waiter_t * w, int v)
 
 void waiter_sub(struct waiter_t * w, int v)
 {
+	int count;
+
 	if(w)
 	{
 		spin_lock(&w->lock);
 		w->count -= v;
+		count = w->count;
 		spin_unlock(&w->lock);
+		if(count == 0)
+			waitqueue_wakeup_all(&w->wq);
 	}
 }
 
 void waiter_wait(struct waiter_t * w)
 {
-	struct task_t * self = task_self();
-
 	if(w)
 	{
 		while(w->count != 0)
 		{
-			task_dynice_increase(self);
-			task_yield();
+			waitqueue_prepare(&w->wq);
+			if(w->count != 0)
+				task_schedule();
+			waitqueue_finish(&w->wq);
 		}
-		task_dynice_restore(self);
 	}
 }
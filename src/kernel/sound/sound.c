@@ -253,37 +253,27 @@ static inline struct sound_t* sound_alloc_from_xfs_ogg(struct xfs_context_t *ctx
 		xfs_close(file);
 		return NULL;
 	}
-	if(!(mem = malloc(mlen)))
+	if(!(mem = xfs_map(file)))
 	{
 		xfs_close(file);
 		return NULL;
 	}
-	if(xfs_read(file, mem, mlen) != mlen)
-	{
-		xfs_close(file);
-		return NULL;
-	}
-	xfs_close(file);
 
 	isample = stb_vorbis_decode_memory(mem, mlen, &channel, &rate, &ogg);
+	xfs_close(file);
 	if(isample <= 0)
-	{
-		free(mem);
 		return NULL;
-	}
 	osample = isample * 48000.0 / rate;
 	osample -= osample % 2;
 	inbuf = malloc(isample << 2);
 	if(!inbuf)
 	{
-		free(mem);
 		free(ogg);
 		return NULL;
 	}
 	snd = sound_alloc(osample);
 	if(!snd)
 	{
-		free(mem);
 		free(ogg);
 		free(inbuf);
 		return NULL;
@@ -305,7 +295,6 @@ static inline struct sound_t* sound_alloc_from_xfs_ogg(struct xfs_context_t *ctx
 		memcpy(inbuf, ogg, isample << 2);
 	}
 	sound_resample((int16_t*)snd->source, 48000, osample, (int16_t*)inbuf, rate, isample, 2);
-	free(mem);
 	free(ogg);
 	free(inbuf);
 
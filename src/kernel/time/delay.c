@@ -55,39 +55,18 @@ EXPORT_SYMBOL(mdelay);
 
 void nsleep(u32_t ns)
 {
-	struct task_t * self = task_self();
-	ktime_t timeout = ktime_add_ns(ktime_get(), ns);
-	while(ktime_before(ktime_get(), timeout))
-	{
-		task_dynice_increase(self);
-		task_yield();
-	}
-	task_dynice_restore(self);
+	task_sleep(ns_to_ktime(ns));
 }
 EXPORT_SYMBOL(nsleep);
 
 void usleep(u32_t us)
 {
-	struct task_t * self = task_self();
-	ktime_t timeout = ktime_add_us(ktime_get(), us);
-	while(ktime_before(ktime_get(), timeout))
-	{
-		task_dynice_increase(self);
-		task_yield();
-	}
-	task_dynice_restore(self);
+	task_sleep(us_to_ktime(us));
 }
 EXPORT_SYMBOL(usleep);
 
 void msleep(u32_t ms)
 {
-	struct task_t * self = task_self();
-	ktime_t timeout = ktime_add_ms(ktime_get(), ms);
-	while(ktime_before(ktime_get(), timeout))
-	{
-		task_dynice_increase(self);
-		task_yield();
-	}
-	task_dynice_restore(self);
+	task_sleep(ms_to_ktime(ms));
 }
 EXPORT_SYMBOL(msleep);
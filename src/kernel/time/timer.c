@@ -30,62 +30,316 @@
 #include <clocksource/clocksource.h>
 #include <time/timer.h>
 
+/*
+ * Timers with a slack of at least one wheel granule live on a hierarchical timing
+ * wheel, with O(1) insert and cancel. Each level is eight times coarser than the one
+ * below and a timer is filed at the finest level that covers its distance, rounded
+ * up to the level granule, so it never fires early and never later than its slack
+ * allows. Everything else stays on the rb-tree, which is augmented with the earliest
+ * expires + slack of each subtree, the clockevent is programmed for that latest
+ * deadline and all due timers are expired by one interrupt.
+ */
+#define TIMER_WHEEL_MASK			(TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LVL_CLK_SHIFT	(3)
+#define TIMER_WHEEL_LVL_CLK_DIV		(1 << TIMER_WHEEL_LVL_CLK_SHIFT)
+#define TIMER_WHEEL_LVL_CLK_MASK	(TIMER_WHEEL_LVL_CLK_DIV - 1)
+#define TIMER_WHEEL_LVL_SHIFT(n)	((n) * TIMER_WHEEL_LVL_CLK_SHIFT)
+#define TIMER_WHEEL_LVL_GRAN(n)		(1ULL << TIMER_WHEEL_LVL_SHIFT(n))
+#define TIMER_WHEEL_LVL_START(n)	((TIMER_WHEEL_SIZE - 1ULL) << (((n) - 1) * TIMER_WHEEL_LVL_CLK_SHIFT))
+#define TIMER_WHEEL_LVL_OFFS(n)		((n) * TIMER_WHEEL_SIZE)
+
 static struct timer_base_t __timer_base = {
 	.head = { NULL },
 	.next = NULL,
+	.clk = 0,
+	.wnext = ~0ULL,
+	.wcount = 0,
+	.event = { .tv64 = KTIME_MAX },
 	.ce = NULL,
 	.lock = SPIN_LOCK_INIT(),
 };
 
+static inline u64_t ktime_to_tick(ktime_t t)
+{
+	return (u64_t)t.tv64 >> CONFIG_TIMER_WHEEL_SHIFT;
+}
+
+static inline s64_t timer_latest(struct timer_t * timer)
+{
+	s64_t latest = timer->expires.tv64 + timer->slack.tv64;
+	return (latest < timer->expires.tv64) ? KTIME_MAX : latest;
+}
+
+static inline s64_t timer_compute_latest(struct timer_t * timer)
+{
+	s64_t latest = timer_latest(timer);
+	struct timer_t * child;
+
+	if(timer->node.rb_left)
+	{
+		child = rb_entry(timer->node.rb_left, struct timer_t, node);
+		if(child->latest < latest)
+			latest = child->latest;
+	}
+	if(timer->node.rb_right)
+	{
+		child = rb_entry(timer->node.rb_right, struct timer_t, node);
+		if(child->latest < latest)
+			latest = child->latest;
+	}
+	return latest;
+}
+
+RB_DECLARE_CALLBACKS(static, timer_augment_callbacks, struct timer_t, node, s64_t, latest, timer_compute_latest)
+
 static inline struct timer_t * next_timer(struct timer_base_t * base)
 {
 	return base->next;
 }
 
-static inline int add_timer(struct timer_base_t * base, struct timer_t * timer)
+static inline void timer_wheel_set_pending(struct timer_base_t * base, unsigned int idx)
+{
+	base->pending[idx >> 5] |= (1U << (idx & 0x1f));
+}
+
+static inline void timer_wheel_clear_pending(struct timer_base_t * base, unsigned int idx)
+{
+	base->pending[idx >> 5] &= ~(1U << (idx & 0x1f));
+}
+
+static inline int timer_wheel_test_pending(struct timer_base_t * base, unsigned int idx)
+{
+	return (base->pending[idx >> 5] & (1U << (idx & 0x1f))) ? 1 : 0;
+}
+
+/*
+ * Distance in slots from clk to the next pending slot of the level, or -1.
+ */
+static int timer_wheel_next_pending(struct timer_base_t * base, unsigned int offset, unsigned int clk)
+{
+	unsigned int i;
+
+	for(i = 0; i < TIMER_WHEEL_SIZE / 32; i++)
+	{
+		if(base->pending[(offset >> 5) + i])
+			break;
+	}
+	if(i >= TIMER_WHEEL_SIZE / 32)
+		return -1;
+
+	for(i = 0; i < TIMER_WHEEL_SIZE; i++)
+	{
+		if(timer_wheel_test_pending(base, offset + ((clk + i) & TIMER_WHEEL_MASK)))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * The tick at which the earliest pending slot expires. A slot of an upper level only
+ * expires once the clock of the level below wraps, hence the carry between levels.
+ */
+static u64_t timer_wheel_next(struct timer_base_t * base)
+{
+	u64_t clk = base->clk;
+	u64_t next = ~0ULL, tmp;
+	unsigned int lvl_clk;
+	int lvl, pos;
+
+	for(lvl = 0; lvl < TIMER_WHEEL_DEPTH; lvl++)
+	{
+		pos = timer_wheel_next_pending(base, TIMER_WHEEL_LVL_OFFS(lvl), clk & TIMER_WHEEL_MASK);
+		lvl_clk = clk & TIMER_WHEEL_LVL_CLK_MASK;
+		if(pos >= 0)
+		{
+			tmp = (clk + pos) << TIMER_WHEEL_LVL_SHIFT(lvl);
+			if(tmp < next)
+				next = tmp;
+			if(pos <= ((TIMER_WHEEL_LVL_CLK_DIV - lvl_clk) & TIMER_WHEEL_LVL_CLK_MASK))
+				break;
+		}
+		clk >>= TIMER_WHEEL_LVL_CLK_SHIFT;
+		clk += lvl_clk ? 1 : 0;
+	}
+	return next;
+}
+
+/*
+ * Bring the wheel clock up to now, but never past a slot still waiting to expire.
+ */
+static inline void timer_wheel_forward(struct timer_base_t * base, u64_t now)
+{
+	if(now > base->clk)
+	{
+		if(base->wcount && (base->wnext < now))
+			base->clk = base->wnext;
+		else
+			base->clk = now;
+	}
+}
+
+static int timer_wheel_add(struct timer_base_t * base, struct timer_t * timer, ktime_t now)
+{
+	u64_t expires, delta;
+	unsigned int idx;
+	int lvl;
+
+	if(timer->slack.tv64 < (2LL << CONFIG_TIMER_WHEEL_SHIFT))
+		return 0;
+
+	timer_wheel_forward(base, ktime_to_tick(now));
+	expires = ktime_to_tick(timer->expires);
+	if(expires < base->clk)
+		expires = base->clk;
+	delta = expires - base->clk;
+	for(lvl = 0; lvl < TIMER_WHEEL_DEPTH; lvl++)
+	{
+		if(delta < TIMER_WHEEL_LVL_START(lvl + 1))
+			break;
+	}
+	if(lvl >= TIMER_WHEEL_DEPTH)
+		return 0;
+	if((s64_t)((TIMER_WHEEL_LVL_GRAN(lvl) + 1) << CONFIG_TIMER_WHEEL_SHIFT) > timer->slack.tv64)
+		return 0;
+
+	expires = (expires + TIMER_WHEEL_LVL_GRAN(lvl)) >> TIMER_WHEEL_LVL_SHIFT(lvl);
+	idx = TIMER_WHEEL_LVL_OFFS(lvl) + (expires & TIMER_WHEEL_MASK);
+	hlist_add_head(&timer->entry, &base->wheel[idx]);
+	timer_wheel_set_pending(base, idx);
+	timer->idx = idx;
+	timer->wheel = 1;
+	base->wcount++;
+	expires <<= TIMER_WHEEL_LVL_SHIFT(lvl);
+	if(expires < base->wnext)
+		base->wnext = expires;
+	return 1;
+}
+
+/*
+ * Move every slot expiring at the current wheel clock onto the expired list, walking
+ * up a level only while the lower level clock wraps to zero.
+ */
+static void timer_wheel_collect(struct timer_base_t * base, struct hlist_head * expired)
+{
+	struct timer_t * pos;
+	struct hlist_node * n;
+	u64_t clk = base->clk;
+	unsigned int idx;
+	int lvl;
+
+	for(lvl = 0; lvl < TIMER_WHEEL_DEPTH; lvl++)
+	{
+		idx = TIMER_WHEEL_LVL_OFFS(lvl) + (clk & TIMER_WHEEL_MASK);
+		if(timer_wheel_test_pending(base, idx))
+		{
+			timer_wheel_clear_pending(base, idx);
+			hlist_for_each_entry_safe(pos, n, &base->wheel[idx], entry)
+			{
+				hlist_del_init(&pos->entry);
+				hlist_add_head(&pos->entry, expired);
+			}
+		}
+		if(clk & TIMER_WHEEL_LVL_CLK_MASK)
+			break;
+		clk >>= TIMER_WHEEL_LVL_CLK_SHIFT;
+	}
+}
+
+static void timer_wheel_expire(struct timer_base_t * base, u64_t now, struct hlist_head * expired)
+{
+	u64_t next;
+
+	while(base->wcount > 0)
+	{
+		next = timer_wheel_next(base);
+		if(next > now)
+			break;
+		base->clk = next;
+		timer_wheel_collect(base, expired);
+		base->clk = next + 1;
+	}
+	if(now > base->clk)
+		base->clk = now;
+	base->wnext = base->wcount ? timer_wheel_next(base) : ~0ULL;
+}
+
+static inline void add_timer(struct timer_base_t * base, struct timer_t * timer, ktime_t now)
 {
 	struct rb_node ** p = &base->head.rb_node;
 	struct rb_node * parent = NULL;
 	struct timer_t * ptr;
+	s64_t latest;
 
 	if(timer->state == TIMER_STATE_INACTIVE)
 	{
+		timer->state = TIMER_STATE_ENQUEUED;
+		if(timer_wheel_add(base, timer, now))
+			return;
+
+		latest = timer_latest(timer);
 		while(*p)
 		{
 			parent = *p;
 			ptr = rb_entry(parent, struct timer_t, node);
+			if(ptr->latest > latest)
+				ptr->latest = latest;
 			if(timer->expires.tv64 < ptr->expires.tv64)
 				p = &(*p)->rb_left;
 			else
 				p = &(*p)->rb_right;
 		}
+		timer->latest = latest;
 		rb_link_node(&timer->node, parent, p);
-		rb_insert_color(&timer->node, &base->head);
+		rb_insert_augmented(&timer->node, &base->head, &timer_augment_callbacks);
 		if(!base->next || (timer->expires.tv64 < base->next->expires.tv64))
 			base->next = timer;
-		timer->state = TIMER_STATE_ENQUEUED;
-		return (timer == base->next);
 	}
-	return 0;
 }
 
-static inline int del_timer(struct timer_base_t * base, struct timer_t * timer)
+static inline void del_timer(struct timer_base_t * base, struct timer_t * timer)
 {
-	int ret = 0;
-
 	if(timer->state == TIMER_STATE_ENQUEUED)
 	{
-		if(base->next == timer)
+		if(timer->wheel)
 		{
-			struct rb_node * rbn = rb_next(&timer->node);
-			base->next = rbn ? rb_entry(rbn, struct timer_t, node) : NULL;
-			ret = 1;
+			hlist_del_init(&timer->entry);
+			if(hlist_empty(&base->wheel[timer->idx]))
+				timer_wheel_clear_pending(base, timer->idx);
+			timer->wheel = 0;
+			if(--base->wcount == 0)
+				base->wnext = ~0ULL;
+		}
+		else
+		{
+			if(base->next == timer)
+			{
+				struct rb_node * rbn = rb_next(&timer->node);
+				base->next = rbn ? rb_entry(rbn, struct timer_t, node) : NULL;
+			}
+			rb_erase_augmented(&timer->node, &base->head, &timer_augment_callbacks);
+			RB_CLEAR_NODE(&timer->node);
 		}
-		rb_erase(&timer->node, &base->head);
-		RB_CLEAR_NODE(&timer->node);
 		timer->state = TIMER_STATE_INACTIVE;
 	}
-	return ret;
+}
+
+/*
+ * Program the clockevent for the latest point that still honours every timer's slack,
+ * only touching the hardware when that point has moved.
+ */
+static void timer_reprogram(struct timer_base_t * base, ktime_t now)
+{
+	s64_t event = KTIME_MAX;
+
+	if(base->head.rb_node)
+		event = rb_entry(base->head.rb_node, struct timer_t, node)->latest;
+	if(base->wcount && (base->wnext < ((u64_t)KTIME_MAX >> CONFIG_TIMER_WHEEL_SHIFT)))
+		event = min(event, (s64_t)(base->wnext << CONFIG_TIMER_WHEEL_SHIFT));
+	if((event != KTIME_MAX) && (event != base->event.tv64))
+	{
+		base->event.tv64 = event;
+		clockevent_set_event_next(base->ce, now, base->event);
+	}
 }
 
 void timer_init(struct timer_t * timer, int (*function)(struct timer_t *, void *), void * data)
@@ -94,8 +348,10 @@ void timer_init(struct timer_t * timer, int (*function)(struct timer_t *, void *
 	{
 		memset(timer, 0, sizeof(struct timer_t));
 		RB_CLEAR_NODE(&timer->node);
+		init_hlist_node(&timer->entry);
 		timer->base = &__timer_base;
 		timer->state = TIMER_STATE_INACTIVE;
+		timer->slack = ns_to_ktime(CONFIG_TIMER_SLACK);
 		timer->data = data;
 		timer->function = function;
 	}
@@ -111,15 +367,10 @@ void timer_start(struct timer_t * timer, ktime_t interval)
 		ktime_t now = ktime_get();
 		base = timer->base;
 		spin_lock_irqsave(&base->lock, flags);
-		if(del_timer(base, timer))
-		{
-			struct timer_t * next = next_timer(base);
-			if(next)
-				clockevent_set_event_next(base->ce, now, next->expires);
-		}
+		del_timer(base, timer);
 		timer->expires = ktime_add_safe(now, interval);
-		if(add_timer(base, timer))
-			clockevent_set_event_next(base->ce, now, timer->expires);
+		add_timer(base, timer, now);
+		timer_reprogram(base, now);
 		spin_unlock_irqrestore(&base->lock, flags);
 	}
 }
@@ -130,6 +381,17 @@ void timer_forward(struct timer_t * timer, ktime_t interval)
 		timer->expires = ktime_add_safe(ktime_get(), interval);
 }
 
+/*
+ * How late the timer may fire, takes effect on the next start. Timers sharing a
+ * slack window are expired by a single interrupt, a generous slack also moves the
+ * timer onto the timing wheel.
+ */
+void timer_set_slack(struct timer_t * timer, ktime_t slack)
+{
+	if(timer)
+		timer->slack = (ktime_to_ns(slack) > 0) ? slack : ns_to_ktime(0);
+}
+
 void timer_cancel(struct timer_t * timer)
 {
 	struct timer_base_t * base;
@@ -139,50 +401,68 @@ void timer_cancel(struct timer_t * timer)
 	{
 		base = timer->base;
 		spin_lock_irqsave(&base->lock, flags);
-		if(del_timer(base, timer))
-		{
-			struct timer_t * next = next_timer(base);
-			if(next)
-				clockevent_set_event_next(base->ce, ktime_get(), next->expires);
-		}
+		del_timer(base, timer);
+		timer_reprogram(base, ktime_get());
 		spin_unlock_irqrestore(&base->lock, flags);
 	}
 }
 
+static inline void timer_run(struct timer_base_t * base, struct timer_t * timer, ktime_t now)
+{
+	int restart;
+
+	del_timer(base, timer);
+	timer->state = TIMER_STATE_CALLBACK;
+	restart = timer->function(timer, timer->data);
+	timer->state = TIMER_STATE_INACTIVE;
+	if(restart)
+		add_timer(base, timer, now);
+}
+
 static void timer_event_handler(struct clockevent_t * ce, void * data)
 {
 	struct timer_base_t * base = (struct timer_base_t *)(data);
+	struct hlist_head expired;
 	struct timer_t * timer;
 	ktime_t now = ktime_get();
 	irq_flags_t flags;
-	int restart;
 
 	spin_lock_irqsave(&base->lock, flags);
 	while((timer = next_timer(base)))
 	{
 		if(now.tv64 < timer->expires.tv64)
 			break;
-		del_timer(base, timer);
-		timer->state = TIMER_STATE_CALLBACK;
-		restart = timer->function(timer, timer->data);
-		timer->state = TIMER_STATE_INACTIVE;
-		if(restart)
-			add_timer(base, timer);
+		timer_run(base, timer, now);
+	}
+	init_hlist_head(&expired);
+	timer_wheel_expire(base, ktime_to_tick(now), &expired);
+	while(!hlist_empty(&expired))
+	{
+		timer = hlist_entry(expired.first, struct timer_t, entry);
+		timer_run(base, timer, now);
 	}
-	if((timer = next_timer(base)))
-		clockevent_set_event_next(ce, now, timer->expires);
+	base->event.tv64 = KTIME_MAX;
+	timer_reprogram(base, now);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 
 void timer_bind_clockevent(struct clockevent_t * ce)
 {
 	irq_flags_t flags;
+	int i;
 
 	if(ce)
 	{
 		spin_lock_irqsave(&__timer_base.lock, flags);
 		__timer_base.head = RB_ROOT;
 		__timer_base.next = NULL;
+		for(i = 0; i < TIMER_WHEEL_DEPTH * TIMER_WHEEL_SIZE; i++)
+			init_hlist_head(&__timer_base.wheel[i]);
+		memset(__timer_base.pending, 0, sizeof(__timer_base.pending));
+		__timer_base.clk = ktime_to_tick(ktime_get());
+		__timer_base.wnext = ~0ULL;
+		__timer_base.wcount = 0;
+		__timer_base.event.tv64 = KTIME_MAX;
 		__timer_base.ce = ce;
 		clockevent_set_event_handler(__timer_base.ce, timer_event_handler, &__timer_base);
 		spin_unlock_irqrestore(&__timer_base.lock, flags);
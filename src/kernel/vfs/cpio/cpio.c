@@ -184,6 +184,20 @@ static u64_t cpio_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 	return sz;
 }
 
+static void * cpio_mmap(struct vfs_node_t * n, s64_t off, u64_t len)
+{
+	u64_t toff;
+
+	if(n->v_type != VNT_REG)
+		return NULL;
+
+	if((off < 0) || (off + len > n->v_size))
+		return NULL;
+
+	toff = (u64_t)((unsigned long)(n->v_data));
+	return block_map(n->v_mount->m_dev, toff + off, len);
+}
+
 static u64_t cpio_write(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 {
 	return 0;
@@ -329,7 +343,7 @@ static int cpio_lookup(struct vfs_node_t * dn, const char * name, struct vfs_nod
 			return -1;
 
 		if((size == 0) && (mode == 0) && (name_size == 11) && (strncmp(path, "TRAILER!!!", 10) == 0))
-			return -1;
+			return ENOENT;
 
 		if((path[0] != '.') && check_path(path, dn->v_path, name))
 			break;
@@ -443,6 +457,7 @@ static struct filesystem_t cpio = {
 
 	.read		= cpio_read,
 	.write		= cpio_write,
+	.mmap		= cpio_mmap,
 	.truncate	= cpio_truncate,
 	.sync		= cpio_sync,
 	.readdir	= cpio_readdir,
@@ -60,6 +60,51 @@ int ext4fs_devwrite(struct ext4fs_control_t * ctrl, u32_t blkno, u32_t blkoff, u
 	return (len == buf_len) ? 0 : -1;
 }
 
+/*
+ * Block pointers of indirect blocks are accessed in place in the block buffers,
+ * which cache them and write them back, with a plain transfer as fallback
+ */
+int ext4fs_devread_blkno(struct ext4fs_control_t * ctrl, u32_t blkno, u32_t index, u32_t * val)
+{
+	struct block_buffer_t * b;
+	u64_t off;
+	u32_t v;
+	int rc = 0;
+
+	off = ((u64_t)blkno << (ctrl->log2_block_size + EXT2_SECTOR_BITS)) + ((u64_t)index << 2);
+	b = block_buffer_get(ctrl->bdev, off / BLOCK_BUFFER_SIZE);
+	if(b)
+	{
+		memcpy(&v, &b->data[off & (BLOCK_BUFFER_SIZE - 1)], sizeof(u32_t));
+		block_buffer_put(b);
+	}
+	else
+	{
+		rc = ext4fs_devread(ctrl, blkno, index << 2, sizeof(u32_t), (char *)&v);
+	}
+	if(!rc)
+		*val = le32_to_cpu(v);
+
+	return rc;
+}
+
+int ext4fs_devwrite_blkno(struct ext4fs_control_t * ctrl, u32_t blkno, u32_t index, u32_t val)
+{
+	struct block_buffer_t * b;
+	u64_t off;
+	u32_t v = cpu_to_le32(val);
+
+	off = ((u64_t)blkno << (ctrl->log2_block_size + EXT2_SECTOR_BITS)) + ((u64_t)index << 2);
+	b = block_buffer_get(ctrl->bdev, off / BLOCK_BUFFER_SIZE);
+	if(!b)
+		return ext4fs_devwrite(ctrl, blkno, index << 2, sizeof(u32_t), (char *)&v);
+	memcpy(&b->data[off & (BLOCK_BUFFER_SIZE - 1)], &v, sizeof(u32_t));
+	block_buffer_dirty(b);
+	block_buffer_put(b);
+
+	return 0;
+}
+
 int ext4fs_control_read_inode(struct ext4fs_control_t * ctrl, u32_t inode_no, struct ext2_inode_t * inode)
 {
 	int rc;
@@ -415,9 +460,7 @@ int ext4fs_control_sync(struct ext4fs_control_t * ctrl)
 	}
 
 	/* Flush cached data in device request queue */
-	block_sync(ctrl->bdev);
-
-	return 0;
+	return block_sync(ctrl->bdev);
 }
 
 int ext4fs_control_init(struct ext4fs_control_t * ctrl, struct block_t * bdev)
@@ -157,7 +157,7 @@ int ext4fs_node_write_blk(struct ext4fs_node_t * node, u32_t blkno, u32_t blkoff
 	return 0;
 }
 
-int ext4fs_node_sync(struct ext4fs_node_t * node)
+static int __ext4fs_node_sync(struct ext4fs_node_t * node)
 {
 	int rc;
 	struct ext4fs_control_t *ctrl = node->ctrl;
@@ -182,37 +182,17 @@ int ext4fs_node_sync(struct ext4fs_node_t * node)
 		node->cached_dirty = FALSE;
 	}
 
-	if(node->indir_block && node->indir_dirty)
-	{
-		rc = ext4fs_devwrite(ctrl, node->indir_blkno, 0, ctrl->block_size, (char *)node->indir_block);
-		if(rc)
-		{
-			return rc;
-		}
-		node->indir_dirty = FALSE;
-	}
-
-	if(node->dindir1_block && node->dindir1_dirty)
-	{
-		rc = ext4fs_devwrite(ctrl, node->dindir1_blkno, 0, ctrl->block_size, (char *)node->dindir1_block);
-		if(rc)
-		{
-			return rc;
-		}
-		node->dindir1_dirty = FALSE;
-	}
+	return 0;
+}
 
-	if(node->dindir2_block && node->dindir2_dirty)
-	{
-		rc = ext4fs_devwrite(ctrl, node->dindir2_blkno, 0, ctrl->block_size, (char *)node->dindir2_block);
-		if(rc)
-		{
-			return rc;
-		}
-		node->dindir2_dirty = FALSE;
-	}
+int ext4fs_node_sync(struct ext4fs_node_t * node)
+{
+	int rc;
 
-	return 0;
+	mutex_lock(&node->lock);
+	rc = __ext4fs_node_sync(node);
+	mutex_unlock(&node->lock);
+	return rc;
 }
 
 int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t *blkno)
@@ -232,21 +212,11 @@ int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t *blk
 		/* Indirect.  */
 		u32_t indir_blkpos = blkpos - ctrl->dir_blklast;
 
-		if(!node->indir_block)
+		rc = ext4fs_devread_blkno(ctrl, node->indir_blkno, indir_blkpos, blkno);
+		if(rc)
 		{
-			node->indir_block = malloc(ctrl->block_size);
-			if(!node->indir_block)
-			{
-				return -1;
-			}
-			rc = ext4fs_devread(ctrl, node->indir_blkno, 0, ctrl->block_size, (char *)node->indir_block);
-			if(rc)
-			{
-				return rc;
-			}
+			return rc;
 		}
-
-		*blkno = le32_to_cpu(node->indir_block[indir_blkpos]);
 	}
 	else if(blkpos < ctrl->dindir_blklast)
 	{
@@ -255,51 +225,17 @@ int ext4fs_node_read_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t *blk
 		u32_t dindir1_blkpos = udiv32(t, ctrl->block_size / 4);
 		u32_t dindir2_blkpos = t - dindir1_blkpos * (ctrl->block_size / 4);
 
-		if(!node->dindir1_block)
+		rc = ext4fs_devread_blkno(ctrl, node->dindir1_blkno, dindir1_blkpos, &dindir2_blkno);
+		if(rc)
 		{
-			node->dindir1_block = malloc(ctrl->block_size);
-			if(!node->dindir1_block)
-			{
-				return -1;
-			}
-			rc = ext4fs_devread(ctrl, node->dindir1_blkno, 0, ctrl->block_size, (char *)node->dindir1_block);
-			if(rc)
-			{
-				return rc;
-			}
+			return rc;
 		}
 
-		dindir2_blkno = le32_to_cpu(node->dindir1_block[dindir1_blkpos]);
-
-		if(!node->dindir2_block)
-		{
-			node->dindir2_block = malloc(ctrl->block_size);
-			if(!node->dindir2_block)
-			{
-				return -1;
-			}
-			node->dindir2_blkno = 0;
-		}
-		if(dindir2_blkno != node->dindir2_blkno)
+		rc = ext4fs_devread_blkno(ctrl, dindir2_blkno, dindir2_blkpos, blkno);
+		if(rc)
 		{
-			if(node->dindir2_dirty)
-			{
-				rc = ext4fs_devwrite(ctrl, node->dindir2_blkno, 0, ctrl->block_size, (char *)node->dindir2_block);
-				if(rc)
-				{
-					return rc;
-				}
-				node->dindir2_dirty = FALSE;
-			}
-			rc = ext4fs_devread(ctrl, dindir2_blkno, 0, ctrl->block_size, (char *)node->dindir2_block);
-			if(rc)
-			{
-				return rc;
-			}
-			node->dindir2_blkno = dindir2_blkno;
+			return rc;
 		}
-
-		*blkno = le32_to_cpu(node->dindir2_block[dindir2_blkpos]);
 	}
 	else
 	{
@@ -314,6 +250,7 @@ int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blk
 {
 	int rc;
 	u32_t dindir2_blkno;
+	u8_t * zero;
 	struct ext2_inode_t *inode = &node->inode;
 	struct ext4fs_control_t *ctrl = node->ctrl;
 
@@ -328,22 +265,11 @@ int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blk
 		/* Indirect.  */
 		u32_t indir_blkpos = blkpos - ctrl->dir_blklast;
 
-		if(!node->indir_block)
+		rc = ext4fs_devwrite_blkno(ctrl, node->indir_blkno, indir_blkpos, blkno);
+		if(rc)
 		{
-			node->indir_block = malloc(ctrl->block_size);
-			if(!node->indir_block)
-			{
-				return -1;
-			}
-			rc = ext4fs_devread(ctrl, node->indir_blkno, 0, ctrl->block_size, (char *)node->indir_block);
-			if(rc)
-			{
-				return rc;
-			}
+			return rc;
 		}
-
-		node->indir_block[indir_blkpos] = le32_to_cpu(blkno);
-		node->indir_dirty = TRUE;
 	}
 	else if(blkpos < ctrl->dindir_blklast)
 	{
@@ -352,66 +278,42 @@ int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blk
 		u32_t dindir1_blkpos = udiv32(t, ctrl->block_size / 4);
 		u32_t dindir2_blkpos = t - dindir1_blkpos * (ctrl->block_size / 4);
 
-		if(!node->dindir1_block)
+		rc = ext4fs_devread_blkno(ctrl, node->dindir1_blkno, dindir1_blkpos, &dindir2_blkno);
+		if(rc)
 		{
-			node->dindir1_block = malloc(ctrl->block_size);
-			if(!node->dindir1_block)
-			{
-				return -1;
-			}
-			rc = ext4fs_devread(ctrl, node->dindir1_blkno, 0, ctrl->block_size, (char *)node->dindir1_block);
-			if(rc)
-			{
-				return rc;
-			}
+			return rc;
 		}
 
-		dindir2_blkno = le32_to_cpu(node->dindir1_block[dindir1_blkpos]);
-
-		if(!node->dindir2_block)
+		if(!dindir2_blkno)
 		{
-			node->dindir2_block = malloc(ctrl->block_size);
-			if(!node->dindir2_block)
+			rc = ext4fs_control_alloc_block(ctrl, node->inode_no, &dindir2_blkno);
+			if(rc)
 			{
-				return -1;
+				return rc;
 			}
-			node->dindir2_blkno = 0;
-		}
-		if(dindir2_blkno != node->dindir2_blkno)
-		{
-			if(node->dindir2_dirty)
+			zero = calloc(1, ctrl->block_size);
+			if(!zero)
 			{
-				rc = ext4fs_devwrite(ctrl, node->dindir2_blkno, 0, ctrl->block_size, (char *)node->dindir2_block);
-				if(rc)
-				{
-					return rc;
-				}
-				node->dindir2_dirty = FALSE;
+				return -1;
 			}
-			if(!dindir2_blkno)
+			rc = ext4fs_devwrite(ctrl, dindir2_blkno, 0, ctrl->block_size, (char *)zero);
+			free(zero);
+			if(rc)
 			{
-				rc = ext4fs_control_alloc_block(ctrl, node->inode_no, &dindir2_blkno);
-				if(rc)
-				{
-					return rc;
-				}
-				node->dindir1_block[dindir1_blkpos] = le32_to_cpu(dindir2_blkno);
-				node->dindir1_dirty = TRUE;
-				memset(node->dindir2_block, 0, ctrl->block_size);
+				return rc;
 			}
-			else
+			rc = ext4fs_devwrite_blkno(ctrl, node->dindir1_blkno, dindir1_blkpos, dindir2_blkno);
+			if(rc)
 			{
-				rc = ext4fs_devread(ctrl, dindir2_blkno, 0, ctrl->block_size, (char *)node->dindir2_block);
-				if(rc)
-				{
-					return rc;
-				}
+				return rc;
 			}
-			node->dindir2_blkno = dindir2_blkno;
 		}
 
-		node->dindir2_block[dindir2_blkpos] = le32_to_cpu(blkno);
-		node->dindir2_dirty = TRUE;
+		rc = ext4fs_devwrite_blkno(ctrl, dindir2_blkno, dindir2_blkpos, blkno);
+		if(rc)
+		{
+			return rc;
+		}
 	}
 	else
 	{
@@ -423,7 +325,7 @@ int ext4fs_node_write_blkno(struct ext4fs_node_t * node, u32_t blkpos, u32_t blk
 }
 
 /* Note: Node position has to be 64-bit */
-u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf)
+static u32_t __ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf)
 {
 	int rc;
 	u64_t filesize = ext4fs_node_get_size(node);
@@ -483,8 +385,18 @@ u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char *
 			blklen = ctrl->block_size;
 		}
 
-		/* Read cached block */
-		rc = ext4fs_node_read_blk(node, blkno, blkoff, blklen, buf);
+		if(blkno && (blklen == ctrl->block_size) && (blkno != node->cached_blkno))
+		{
+			/* Whole blocks go straight into the buffer, without the lock across the transfer */
+			mutex_unlock(&node->lock);
+			rc = ext4fs_devread(ctrl, blkno, 0, blklen, buf);
+			mutex_lock(&node->lock);
+		}
+		else
+		{
+			/* Read cached block */
+			rc = ext4fs_node_read_blk(node, blkno, blkoff, blklen, buf);
+		}
 		if(rc)
 		{
 			goto done;
@@ -498,7 +410,17 @@ u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char *
 	done: return len - rlen;
 }
 
-u32_t ext4fs_node_write(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf)
+u32_t ext4fs_node_read(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf)
+{
+	u32_t r;
+
+	mutex_lock(&node->lock);
+	r = __ext4fs_node_read(node, pos, len, buf);
+	mutex_unlock(&node->lock);
+	return r;
+}
+
+static u32_t __ext4fs_node_write(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf)
 {
 	int rc;
 	bool_t update_nodesize = FALSE, alloc_newblock = FALSE;
@@ -585,7 +507,17 @@ u32_t ext4fs_node_write(struct ext4fs_node_t * node, u64_t pos, u32_t len, char
 	return len - wlen;
 }
 
-int ext4fs_node_truncate(struct ext4fs_node_t * node, u64_t pos)
+u32_t ext4fs_node_write(struct ext4fs_node_t * node, u64_t pos, u32_t len, char * buf)
+{
+	u32_t r;
+
+	mutex_lock(&node->lock);
+	r = __ext4fs_node_write(node, pos, len, buf);
+	mutex_unlock(&node->lock);
+	return r;
+}
+
+static int __ext4fs_node_truncate(struct ext4fs_node_t * node, u64_t pos)
 {
 	int rc;
 	u32_t blkpos, blkno, blkcnt;
@@ -658,6 +590,16 @@ int ext4fs_node_truncate(struct ext4fs_node_t * node, u64_t pos)
 	return 0;
 }
 
+int ext4fs_node_truncate(struct ext4fs_node_t * node, u64_t pos)
+{
+	int rc;
+
+	mutex_lock(&node->lock);
+	rc = __ext4fs_node_truncate(node, pos);
+	mutex_unlock(&node->lock);
+	return rc;
+}
+
 int ext4fs_node_load(struct ext4fs_control_t * ctrl, u32_t inode_no, struct ext4fs_node_t * node)
 {
 	int rc;
@@ -676,17 +618,8 @@ int ext4fs_node_load(struct ext4fs_control_t * ctrl, u32_t inode_no, struct ext4
 	node->cached_blkno = 0;
 	node->cached_dirty = FALSE;
 
-	node->indir_block = NULL;
 	node->indir_blkno = le32_to_cpu(node->inode.b.blocks.indir_block);
-	node->indir_dirty = FALSE;
-
-	node->dindir1_block = NULL;
 	node->dindir1_blkno = le32_to_cpu(node->inode.b.blocks.double_indir_block);
-	node->dindir1_dirty = FALSE;
-
-	node->dindir2_block = NULL;
-	node->dindir2_blkno = 0;
-	node->dindir2_dirty = FALSE;
 
 	return 0;
 }
@@ -695,6 +628,7 @@ int ext4fs_node_init(struct ext4fs_node_t * node)
 {
 	int idx;
 
+	mutex_init(&node->lock);
 	node->inode_no = 0;
 	node->inode_dirty = FALSE;
 
@@ -702,19 +636,11 @@ int ext4fs_node_init(struct ext4fs_node_t * node)
 	node->cached_blkno = 0;
 	node->cached_dirty = FALSE;
 
-	node->indir_block = NULL;
 	node->indir_blkno = 0;
-	node->indir_dirty = FALSE;
-
-	node->dindir1_block = NULL;
 	node->dindir1_blkno = 0;
-	node->dindir1_dirty = FALSE;
-
-	node->dindir2_block = NULL;
-	node->dindir2_blkno = 0;
-	node->dindir2_dirty = FALSE;
 
 	node->lookup_victim = 0;
+	node->lookup_gen = 0;
 	for(idx = 0; idx < EXT4_NODE_LOOKUP_SIZE; idx++)
 	{
 		node->lookup_name[idx][0] = '\0';
@@ -730,21 +656,6 @@ int ext4fs_node_exit(struct ext4fs_node_t * node)
 		free(node->cached_block);
 	}
 
-	if(node->indir_block)
-	{
-		free(node->indir_block);
-	}
-
-	if(node->dindir1_block)
-	{
-		free(node->dindir1_block);
-	}
-
-	if(node->dindir2_block)
-	{
-		free(node->dindir2_block);
-	}
-
 	return 0;
 }
 
@@ -821,7 +732,7 @@ static void ext4fs_node_del_lookup_dirent(struct ext4fs_node_t * dnode, const ch
 
 }
 
-int ext4fs_node_read_dirent(struct ext4fs_node_t * dnode, s64_t off, struct vfs_dirent_t * d)
+static int __ext4fs_node_read_dirent(struct ext4fs_node_t * dnode, s64_t off, struct vfs_dirent_t * d)
 {
 	u32_t readlen;
 	struct ext2_dirent_t dent;
@@ -842,7 +753,7 @@ int ext4fs_node_read_dirent(struct ext4fs_node_t * dnode, s64_t off, struct vfs_
 
 	do
 	{
-		readlen = ext4fs_node_read(dnode, fileoff, sizeof(struct ext2_dirent_t), (char *)&dent);
+		readlen = __ext4fs_node_read(dnode, fileoff, sizeof(struct ext2_dirent_t), (char *)&dent);
 		if(readlen != sizeof(struct ext2_dirent_t))
 		{
 			return -1;
@@ -852,7 +763,7 @@ int ext4fs_node_read_dirent(struct ext4fs_node_t * dnode, s64_t off, struct vfs_
 		{
 			dent.namelen = (VFS_MAX_NAME - 1);
 		}
-		readlen = ext4fs_node_read(dnode, fileoff + sizeof(struct ext2_dirent_t), dent.namelen, d->d_name);
+		readlen = __ext4fs_node_read(dnode, fileoff + sizeof(struct ext2_dirent_t), dent.namelen, d->d_name);
 		if(readlen != dent.namelen)
 		{
 			return -1;
@@ -908,12 +819,28 @@ int ext4fs_node_read_dirent(struct ext4fs_node_t * dnode, s64_t off, struct vfs_
 	return 0;
 }
 
-int ext4fs_node_find_dirent(struct ext4fs_node_t * dnode, const char * name, struct ext2_dirent_t * dent)
+int ext4fs_node_read_dirent(struct ext4fs_node_t * dnode, s64_t off, struct vfs_dirent_t * d)
+{
+	int rc;
+
+	mutex_lock(&dnode->lock);
+	rc = __ext4fs_node_read_dirent(dnode, off, d);
+	mutex_unlock(&dnode->lock);
+	return rc;
+}
+
+/*
+ * The directory is scanned a whole block at a time, so the node lock is not held
+ * across the device reads. A match is only cached if no entry changed meanwhile.
+ */
+static int __ext4fs_node_find_dirent(struct ext4fs_node_t * dnode, const char * name, struct ext2_dirent_t * dent)
 {
 	bool_t found;
-	u32_t rlen;
+	u32_t rlen, off, gen;
 	char filename[VFS_MAX_NAME];
-	u64_t off, filesize = ext4fs_node_get_size(dnode);
+	char * blk;
+	struct ext4fs_control_t *ctrl = dnode->ctrl;
+	u64_t pos, filesize = ext4fs_node_get_size(dnode);
 
 	/* Try to find in lookup table */
 	if(ext4fs_node_find_lookup_dirent(dnode, name, dent) > -1)
@@ -921,54 +848,81 @@ int ext4fs_node_find_dirent(struct ext4fs_node_t * dnode, const char * name, str
 		return 0;
 	}
 
+	blk = malloc(ctrl->block_size);
+	if(!blk)
+	{
+		return -1;
+	}
+
 	/* Find desired directoy entry such that we ignore
 	 * "." and ".." in search process
 	 */
-	off = 0;
+	gen = dnode->lookup_gen;
 	found = FALSE;
-	while(off < filesize)
+	for(pos = 0; (pos < filesize) && !found; pos += ctrl->block_size)
 	{
-		rlen = ext4fs_node_read(dnode, off, sizeof(struct ext2_dirent_t), (char *)dent);
-		if(rlen != sizeof(struct ext2_dirent_t))
+		rlen = __ext4fs_node_read(dnode, pos, ctrl->block_size, blk);
+		if(rlen == 0)
 		{
+			free(blk);
 			return -1;
 		}
 
-		if(dent->namelen > (VFS_MAX_NAME - 1))
-		{
-			dent->namelen = (VFS_MAX_NAME - 1);
-		}
-		rlen = ext4fs_node_read(dnode, off + sizeof(struct ext2_dirent_t), dent->namelen, filename);
-		if(rlen != dent->namelen)
+		off = 0;
+		while(off + sizeof(struct ext2_dirent_t) <= rlen)
 		{
-			return -1;
-		}
-		filename[dent->namelen] = '\0';
+			memcpy(dent, blk + off, sizeof(struct ext2_dirent_t));
+			if(dent->namelen > (VFS_MAX_NAME - 1))
+			{
+				dent->namelen = (VFS_MAX_NAME - 1);
+			}
+			if((le16_to_cpu(dent->direntlen) < sizeof(struct ext2_dirent_t)) || (off + sizeof(struct ext2_dirent_t) + dent->namelen > rlen))
+			{
+				free(blk);
+				return -1;
+			}
+			memcpy(filename, blk + off + sizeof(struct ext2_dirent_t), dent->namelen);
+			filename[dent->namelen] = '\0';
 
-		if((strcmp(filename, ".") != 0) && (strcmp(filename, "..") != 0))
-		{
-			if(strcmp(filename, name) == 0)
+			if((strcmp(filename, ".") != 0) && (strcmp(filename, "..") != 0))
 			{
-				found = TRUE;
-				break;
+				if(strcmp(filename, name) == 0)
+				{
+					found = TRUE;
+					break;
+				}
 			}
-		}
 
-		off += le16_to_cpu(dent->direntlen);
+			off += le16_to_cpu(dent->direntlen);
+		}
 	}
+	free(blk);
 
 	if(!found)
 	{
-		return -1;
+		return ENOENT;
 	}
 
 	/* Add dent to lookup table */
-	ext4fs_node_add_lookup_dirent(dnode, filename, dent);
+	if(gen == dnode->lookup_gen)
+	{
+		ext4fs_node_add_lookup_dirent(dnode, filename, dent);
+	}
 
 	return 0;
 }
 
-int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_t inode_no, u8_t type)
+int ext4fs_node_find_dirent(struct ext4fs_node_t * dnode, const char * name, struct ext2_dirent_t * dent)
+{
+	int rc;
+
+	mutex_lock(&dnode->lock);
+	rc = __ext4fs_node_find_dirent(dnode, name, dent);
+	mutex_unlock(&dnode->lock);
+	return rc;
+}
+
+static int __ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_t inode_no, u8_t type)
 {
 	bool_t found;
 	u16_t direntlen;
@@ -984,6 +938,8 @@ int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_
 		return -1;
 	}
 
+	dnode->lookup_gen++;
+
 	/* Compute size of directory entry required */
 	direntlen = sizeof(struct ext2_dirent_t) + strlen(name);
 
@@ -992,7 +948,7 @@ int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_
 	found = FALSE;
 	while(off < filesize)
 	{
-		rlen = ext4fs_node_read(dnode, off, sizeof(struct ext2_dirent_t), (char *)&dent);
+		rlen = __ext4fs_node_read(dnode, off, sizeof(struct ext2_dirent_t), (char *)&dent);
 		if(rlen != sizeof(struct ext2_dirent_t))
 		{
 			return -1;
@@ -1026,7 +982,7 @@ int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_
 		memset(filename, 0, VFS_MAX_NAME);
 		for(rlen = 0; rlen < ctrl->block_size; rlen += VFS_MAX_NAME)
 		{
-			wlen = ext4fs_node_write(dnode, off + rlen,
+			wlen = __ext4fs_node_write(dnode, off + rlen,
 			VFS_MAX_NAME, (char *)filename);
 			if(wlen != VFS_MAX_NAME)
 			{
@@ -1044,7 +1000,7 @@ int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_
 		direntlen = (le16_to_cpu(dent.direntlen) - dent.namelen - sizeof(struct ext2_dirent_t));
 		dent.direntlen = le16_to_cpu(le16_to_cpu(dent.direntlen) - direntlen);
 
-		wlen = ext4fs_node_write(dnode, off, sizeof(struct ext2_dirent_t), (char *)&dent);
+		wlen = __ext4fs_node_write(dnode, off, sizeof(struct ext2_dirent_t), (char *)&dent);
 		if(wlen != sizeof(struct ext2_dirent_t))
 		{
 			return -1;
@@ -1062,7 +1018,7 @@ int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_
 	dent.namelen = strlen(filename);
 	dent.filetype = type;
 
-	wlen = ext4fs_node_write(dnode, off, sizeof(struct ext2_dirent_t), (char *)&dent);
+	wlen = __ext4fs_node_write(dnode, off, sizeof(struct ext2_dirent_t), (char *)&dent);
 	if(wlen != sizeof(struct ext2_dirent_t))
 	{
 		return -1;
@@ -1070,7 +1026,7 @@ int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_
 
 	off += sizeof(struct ext2_dirent_t);
 
-	wlen = ext4fs_node_write(dnode, off, strlen(filename), (char *)filename);
+	wlen = __ext4fs_node_write(dnode, off, strlen(filename), (char *)filename);
 	if(wlen != strlen(filename))
 	{
 		return -1;
@@ -1083,7 +1039,17 @@ int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_
 	return 0;
 }
 
-int ext4fs_node_del_dirent(struct ext4fs_node_t * dnode, const char * name)
+int ext4fs_node_add_dirent(struct ext4fs_node_t * dnode, const char * name, u32_t inode_no, u8_t type)
+{
+	int rc;
+
+	mutex_lock(&dnode->lock);
+	rc = __ext4fs_node_add_dirent(dnode, name, inode_no, type);
+	mutex_unlock(&dnode->lock);
+	return rc;
+}
+
+static int __ext4fs_node_del_dirent(struct ext4fs_node_t * dnode, const char * name)
 {
 	bool_t found;
 	u32_t rlen, wlen;
@@ -1099,6 +1065,7 @@ int ext4fs_node_del_dirent(struct ext4fs_node_t * dnode, const char * name)
 
 	/* Delete dent from lookup table */
 	ext4fs_node_del_lookup_dirent(dnode, name);
+	dnode->lookup_gen++;
 
 	/* Initialize perivous entry and previous offset */
 	poff = 0;
@@ -1109,7 +1076,7 @@ int ext4fs_node_del_dirent(struct ext4fs_node_t * dnode, const char * name)
 	found = FALSE;
 	while(off < filesize)
 	{
-		rlen = ext4fs_node_read(dnode, off, sizeof(struct ext2_dirent_t), (char *)&dent);
+		rlen = __ext4fs_node_read(dnode, off, sizeof(struct ext2_dirent_t), (char *)&dent);
 		if(rlen != sizeof(struct ext2_dirent_t))
 		{
 			return -1;
@@ -1119,7 +1086,7 @@ int ext4fs_node_del_dirent(struct ext4fs_node_t * dnode, const char * name)
 		{
 			dent.namelen = (VFS_MAX_NAME - 1);
 		}
-		rlen = ext4fs_node_read(dnode, off + sizeof(struct ext2_dirent_t), dent.namelen, filename);
+		rlen = __ext4fs_node_read(dnode, off + sizeof(struct ext2_dirent_t), dent.namelen, filename);
 		if(rlen != dent.namelen)
 		{
 			return -1;
@@ -1149,7 +1116,7 @@ int ext4fs_node_del_dirent(struct ext4fs_node_t * dnode, const char * name)
 	/* Stretch previous directory entry to delete directory entry */
 	/* Handle overflow in below 16-bit addition */
 	pdent.direntlen = le16_to_cpu(le16_to_cpu(pdent.direntlen) + le16_to_cpu(dent.direntlen));
-	wlen = ext4fs_node_write(dnode, poff, sizeof(struct ext2_dirent_t), (char *)&pdent);
+	wlen = __ext4fs_node_write(dnode, poff, sizeof(struct ext2_dirent_t), (char *)&pdent);
 	if(wlen != sizeof(struct ext2_dirent_t))
 	{
 		return -1;
@@ -1161,3 +1128,13 @@ int ext4fs_node_del_dirent(struct ext4fs_node_t * dnode, const char * name)
 
 	return 0;
 }
+
+int ext4fs_node_del_dirent(struct ext4fs_node_t * dnode, const char * name)
+{
+	int rc;
+
+	mutex_lock(&dnode->lock);
+	rc = __ext4fs_node_del_dirent(dnode, name);
+	mutex_unlock(&dnode->lock);
+	return rc;
+}
@@ -28,152 +28,242 @@
 
 #include <vfs/fat/fat-control.h>
 
-static int __fatfs_control_flush_fat_cache(struct fatfs_control_t * ctrl, u32_t index)
+static int __fatfs_control_write_fat_sector(struct fatfs_control_t * ctrl, u32_t fat, u32_t sect_num, u8_t * buf)
 {
-	u32_t i, sect_num;
 	u64_t fat_base, len;
 
-	if(!ctrl->fat_cache_dirty[index])
+	fat_base = ((u64_t)ctrl->first_fat_sector + ((u64_t)fat * ctrl->sectors_per_fat)) * ctrl->bytes_per_sector;
+	len = block_write(ctrl->bdev, buf, fat_base + (u64_t)sect_num * ctrl->bytes_per_sector, ctrl->bytes_per_sector);
+	if(len != ctrl->bytes_per_sector)
+		return -1;
+	return 0;
+}
+
+/*
+ * Mark the mirror copies of a changed range of the first FAT stale, to be brought up
+ * to date on sync, or write the range to them right away without memory for the map
+ */
+static int __fatfs_control_dirty_fat_mirror(struct fatfs_control_t * ctrl, u32_t pos, u8_t * buf, u32_t len)
+{
+	u32_t sect_num, last;
+	u64_t off;
+	int j;
+
+	if(ctrl->fat_mirror_map)
+	{
+		last = udiv32(pos + len - 1, ctrl->bytes_per_sector);
+		for(sect_num = udiv32(pos, ctrl->bytes_per_sector); sect_num <= last; sect_num++)
+			ctrl->fat_mirror_map[sect_num >> 5] |= 1U << (sect_num & 0x1f);
+		return 0;
+	}
+	for(j = 1; j < ctrl->number_of_fat; j++)
+	{
+		off = ((u64_t)ctrl->first_fat_sector + ((u64_t)j * ctrl->sectors_per_fat)) * ctrl->bytes_per_sector;
+		if(block_write(ctrl->bdev, buf, off + pos, len) != len)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * The first FAT reaches the device through the block buffer writeback, only the
+ * mirrors of every dirty buffer are taken care of here
+ */
+static int __fatfs_control_flush_fat_cache(struct fatfs_control_t * ctrl)
+{
+	struct fatfs_fat_cache_t * c;
+	int i;
+
+	if(!ctrl->fat_cache_dirty)
 		return 0;
 
-	for(i = 0; i < ctrl->number_of_fat; i++)
+	for(i = 0; i < FAT_TABLE_CACHE_SIZE; i++)
 	{
-		fat_base = ((u64_t)ctrl->first_fat_sector + (i * ctrl->sectors_per_fat)) * ctrl->bytes_per_sector;
-		sect_num = ctrl->fat_cache_num[index];
-		len = block_write(ctrl->bdev, &ctrl->fat_cache_buf[index * ctrl->bytes_per_sector], fat_base + sect_num * ctrl->bytes_per_sector,
-		        ctrl->bytes_per_sector);
-		if(len != ctrl->bytes_per_sector)
+		c = &ctrl->fat_cache[i];
+		if(!c->dirty)
+			continue;
+		if(__fatfs_control_dirty_fat_mirror(ctrl, c->sect * BLOCK_BUFFER_SIZE, c->b->data, BLOCK_BUFFER_SIZE))
 			return -1;
+		c->dirty = FALSE;
+		ctrl->fat_cache_dirty--;
 	}
-	ctrl->fat_cache_dirty[index] = FALSE;
 
 	return 0;
 }
 
-static int __fatfs_control_find_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
+static struct fatfs_fat_cache_t * __fatfs_control_find_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
 {
-	int index;
+	struct fatfs_fat_cache_t * c;
 
-	for(index = 0; index < FAT_TABLE_CACHE_SIZE; index++)
+	list_for_each_entry(c, &ctrl->fat_cache_lru, entry)
 	{
-		if(ctrl->fat_cache_num[index] == sect_num)
-			return index;
+		if(c->sect == sect_num)
+			return c;
 	}
-	return -1;
+	return NULL;
 }
 
-static int __fatfs_control_load_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
+/*
+ * Copy the first FAT over its mirrors for every sector changed since the last sync
+ */
+static int __fatfs_control_sync_fat_mirrors(struct fatfs_control_t * ctrl)
 {
-	int rc;
-	u32_t index;
+	u32_t sect_num, i;
+	u8_t * buf = NULL;
 	u64_t fat_base, len;
+	int rc = 0;
 
-	if(-1 < __fatfs_control_find_fat_cache(ctrl, sect_num))
+	if(!ctrl->fat_mirror_map)
 		return 0;
 
-	index = ctrl->fat_cache_victim;
-	ctrl->fat_cache_victim++;
-	if(ctrl->fat_cache_victim == FAT_TABLE_CACHE_SIZE)
-		ctrl->fat_cache_victim = 0;
+	for(sect_num = 0; sect_num < ctrl->sectors_per_fat; sect_num++)
+	{
+		if(!ctrl->fat_mirror_map[sect_num >> 5])
+		{
+			sect_num |= 0x1f;
+			continue;
+		}
+		if(!(ctrl->fat_mirror_map[sect_num >> 5] & (1U << (sect_num & 0x1f))))
+			continue;
 
-	rc = __fatfs_control_flush_fat_cache(ctrl, index);
-	if(rc)
-		return rc;
+		if(!buf && !(buf = malloc(ctrl->bytes_per_sector)))
+		{
+			rc = -1;
+			break;
+		}
+		fat_base = (u64_t) ctrl->first_fat_sector * ctrl->bytes_per_sector;
+		len = block_read(ctrl->bdev, buf, fat_base + (u64_t)sect_num * ctrl->bytes_per_sector, ctrl->bytes_per_sector);
+		if(len != ctrl->bytes_per_sector)
+		{
+			rc = -1;
+			break;
+		}
 
-	fat_base = (u64_t) ctrl->first_fat_sector * ctrl->bytes_per_sector;
-	len = block_read(ctrl->bdev, &ctrl->fat_cache_buf[index * ctrl->bytes_per_sector], fat_base + sect_num * ctrl->bytes_per_sector, ctrl->bytes_per_sector);
-	if(len != ctrl->bytes_per_sector)
-		return -1;
-	ctrl->fat_cache_num[index] = sect_num;
+		for(i = 1; i < ctrl->number_of_fat; i++)
+		{
+			rc = __fatfs_control_write_fat_sector(ctrl, i, sect_num, buf);
+			if(rc)
+				break;
+		}
+		if(rc)
+			break;
+		ctrl->fat_mirror_map[sect_num >> 5] &= ~(1U << (sect_num & 0x1f));
+	}
 
-	return 0;
+	if(buf)
+		free(buf);
+	return rc;
 }
 
-static u32_t __fatfs_control_read_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
+static struct fatfs_fat_cache_t * __fatfs_control_load_fat_cache(struct fatfs_control_t * ctrl, u32_t sect_num)
 {
-	int rc, index;
-	u32_t ret, sect_num, sect_off;
-
-	if((ctrl->sectors_per_fat * ctrl->bytes_per_sector) <= pos)
-		return 0;
-
-	sect_num = udiv32(pos, ctrl->bytes_per_sector);
-	sect_off = pos - (sect_num * ctrl->bytes_per_sector);
-
-	rc = __fatfs_control_load_fat_cache(ctrl, sect_num);
-	if(rc)
-		return 0;
-
-	index = __fatfs_control_find_fat_cache(ctrl, sect_num);
-	if(index < 0)
-		return 0;
+	struct fatfs_fat_cache_t * c;
+	struct block_buffer_t * b;
 
-	index = (index * ctrl->bytes_per_sector) + sect_off;
+	c = __fatfs_control_find_fat_cache(ctrl, sect_num);
+	if(c)
+	{
+		ctrl->fat_cache_hits++;
+		list_move(&c->entry, &ctrl->fat_cache_lru);
+		return c;
+	}
+	ctrl->fat_cache_misses++;
+
+	/* Reuse the least recently used slot, a dirty victim flushes all dirty slots at once */
+	c = list_last_entry(&ctrl->fat_cache_lru, struct fatfs_fat_cache_t, entry);
+	if(c->dirty && __fatfs_control_flush_fat_cache(ctrl))
+		return NULL;
+
+	b = block_buffer_get(ctrl->bdev, (u64_t)ctrl->first_fat_sector * ctrl->bytes_per_sector / BLOCK_BUFFER_SIZE + sect_num);
+	if(!b)
+		return NULL;
+	if(c->b)
+		block_buffer_put(c->b);
+	c->b = b;
+	c->sect = sect_num;
+	list_move(&c->entry, &ctrl->fat_cache_lru);
+
+	return c;
+}
 
+static u32_t __fatfs_control_fat_entry_size(struct fatfs_control_t * ctrl)
+{
 	switch(ctrl->type)
 	{
 	case FAT_TYPE_12:
 	case FAT_TYPE_16:
-		ret = 2;
-		buf[0] = ctrl->fat_cache_buf[index + 0];
-		buf[1] = ctrl->fat_cache_buf[index + 1];
-		break;
+		return 2;
 	case FAT_TYPE_32:
-		ret = 4;
-		buf[0] = ctrl->fat_cache_buf[index + 0];
-		buf[1] = ctrl->fat_cache_buf[index + 1];
-		buf[2] = ctrl->fat_cache_buf[index + 2];
-		buf[3] = ctrl->fat_cache_buf[index + 3];
-		break;
+		return 4;
 	default:
-		ret = 0;
 		break;
 	};
-
-	return ret;
+	return 0;
 }
 
-static u32_t __fatfs_control_write_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
+/*
+ * A FAT12 entry may straddle two buffers, so each byte is looked up by its own position.
+ * Without a buffer, as on mapped devices, the entry is transferred directly.
+ */
+static u32_t __fatfs_control_read_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
 {
-	int rc, index, cache_buf_index;
-	u32_t ret, sect_num, sect_off;
+	struct fatfs_fat_cache_t * c = NULL;
+	u32_t ret, index, i;
+	u64_t fat_base;
 
 	if((ctrl->sectors_per_fat * ctrl->bytes_per_sector) <= pos)
 		return 0;
 
-	sect_num = udiv32(pos, ctrl->bytes_per_sector);
-	sect_off = pos - (sect_num * ctrl->bytes_per_sector);
+	fat_base = (u64_t)ctrl->first_fat_sector * ctrl->bytes_per_sector;
+	ret = __fatfs_control_fat_entry_size(ctrl);
+	for(i = 0; i < ret; i++)
+	{
+		index = (pos + i) & (BLOCK_BUFFER_SIZE - 1);
+		if(!c || !index)
+		{
+			c = __fatfs_control_load_fat_cache(ctrl, (pos + i) / BLOCK_BUFFER_SIZE);
+			if(!c)
+				return (block_read(ctrl->bdev, buf, fat_base + pos, ret) == ret) ? ret : 0;
+		}
+		buf[i] = c->b->data[index];
+	}
 
-	rc = __fatfs_control_load_fat_cache(ctrl, sect_num);
-	if(rc)
-		return 0;
+	return ret;
+}
 
-	index = __fatfs_control_find_fat_cache(ctrl, sect_num);
-	if(index < 0)
-		return 0;
+static u32_t __fatfs_control_write_fat_cache(struct fatfs_control_t * ctrl, u8_t * buf, u32_t pos)
+{
+	struct fatfs_fat_cache_t * c = NULL;
+	u32_t ret, index, i;
+	u64_t fat_base;
 
-	cache_buf_index = (index * ctrl->bytes_per_sector) + sect_off;
+	if((ctrl->sectors_per_fat * ctrl->bytes_per_sector) <= pos)
+		return 0;
 
-	switch(ctrl->type)
+	fat_base = (u64_t)ctrl->first_fat_sector * ctrl->bytes_per_sector;
+	ret = __fatfs_control_fat_entry_size(ctrl);
+	for(i = 0; i < ret; i++)
 	{
-	case FAT_TYPE_12:
-	case FAT_TYPE_16:
-		ret = 2;
-		ctrl->fat_cache_buf[cache_buf_index + 0] = buf[0];
-		ctrl->fat_cache_buf[cache_buf_index + 1] = buf[1];
-		break;
-	case FAT_TYPE_32:
-		ret = 4;
-		ctrl->fat_cache_buf[cache_buf_index + 0] = buf[0];
-		ctrl->fat_cache_buf[cache_buf_index + 1] = buf[1];
-		ctrl->fat_cache_buf[cache_buf_index + 2] = buf[2];
-		ctrl->fat_cache_buf[cache_buf_index + 3] = buf[3];
-		break;
-	default:
-		ret = 0;
-		break;
-	};
-	ctrl->fat_cache_dirty[index] = TRUE;
+		index = (pos + i) & (BLOCK_BUFFER_SIZE - 1);
+		if(!c || !index)
+		{
+			c = __fatfs_control_load_fat_cache(ctrl, (pos + i) / BLOCK_BUFFER_SIZE);
+			if(!c)
+			{
+				if(block_write(ctrl->bdev, buf, fat_base + pos, ret) != ret)
+					return 0;
+				return __fatfs_control_dirty_fat_mirror(ctrl, pos, buf, ret) ? 0 : ret;
+			}
+			if(!c->dirty)
+			{
+				c->dirty = TRUE;
+				ctrl->fat_cache_dirty++;
+			}
+		}
+		c->b->data[index] = buf[i];
+		if((i == ret - 1) || (index == BLOCK_BUFFER_SIZE - 1))
+			block_buffer_dirty(c->b);
+	}
 
 	return ret;
 }
@@ -396,6 +486,195 @@ static int __fatfs_control_nth_cluster(struct fatfs_control_t * ctrl, u32_t clus
 	return 0;
 }
 
+static inline u32_t __fatfs_control_max_cluster(struct fatfs_control_t * ctrl)
+{
+	return min(ctrl->data_clusters + 1, __fatfs_control_last_valid_cluster(ctrl));
+}
+
+static inline bool_t __fatfs_control_cluster_used(struct fatfs_control_t * ctrl, u32_t clust)
+{
+	return (ctrl->free_map[clust >> 5] & (1U << (clust & 0x1f))) ? TRUE : FALSE;
+}
+
+static void __fatfs_control_mark_cluster(struct fatfs_control_t * ctrl, u32_t clust, bool_t used)
+{
+	if(clust > __fatfs_control_max_cluster(ctrl))
+		return;
+	if(!ctrl->free_map)
+	{
+		/*
+		 * Without the bitmap trust the callers, which only mark clusters
+		 * whose FAT entry they have just changed between free and used
+		 */
+		if(ctrl->free_count != FAT_FSINFO_UNKNOWN)
+		{
+			if(used && (ctrl->free_count > 0))
+				ctrl->free_count--;
+			else if(!used && (ctrl->free_count < __fatfs_control_max_cluster(ctrl)))
+				ctrl->free_count++;
+			ctrl->fsinfo_dirty = TRUE;
+		}
+		return;
+	}
+	if(__fatfs_control_cluster_used(ctrl, clust) == used)
+		return;
+	if(used)
+	{
+		ctrl->free_map[clust >> 5] |= (1U << (clust & 0x1f));
+		ctrl->free_count--;
+	}
+	else
+	{
+		ctrl->free_map[clust >> 5] &= ~(1U << (clust & 0x1f));
+		ctrl->free_count++;
+	}
+	ctrl->fsinfo_dirty = TRUE;
+}
+
+/*
+ * Build the free cluster bitmap by reading the whole FAT once, done on first allocation
+ * so read only mounts never pay for it
+ */
+static int __fatfs_control_load_free_map(struct fatfs_control_t * ctrl)
+{
+	u32_t first, last, clust, next, sect, nsect, i;
+	u8_t * buf;
+	u64_t len;
+	int rc;
+
+	if(ctrl->free_map)
+		return 0;
+
+	rc = __fatfs_control_flush_fat_cache(ctrl);
+	if(rc)
+		return rc;
+
+	first = __fatfs_control_first_valid_cluster(ctrl);
+	last = __fatfs_control_max_cluster(ctrl);
+	ctrl->free_map = calloc((last >> 5) + 1, sizeof(u32_t));
+	if(!ctrl->free_map)
+		return -1;
+	for(clust = 0; clust < first; clust++)
+		ctrl->free_map[clust >> 5] |= (1U << (clust & 0x1f));
+	ctrl->free_count = 0;
+
+	if(ctrl->type == FAT_TYPE_12)
+	{
+		for(clust = first; clust <= last; clust++)
+		{
+			rc = __fatfs_control_get_next_cluster(ctrl, clust, &next);
+			if(rc)
+				goto fail;
+			if(next)
+				ctrl->free_map[clust >> 5] |= (1U << (clust & 0x1f));
+			else
+				ctrl->free_count++;
+		}
+	}
+	else
+	{
+		buf = malloc(FAT_FREE_MAP_CHUNK * ctrl->bytes_per_sector);
+		if(!buf)
+			goto fail;
+		clust = 0;
+		for(sect = 0; (sect < ctrl->sectors_per_fat) && (clust <= last); sect += nsect)
+		{
+			nsect = min((u32_t)FAT_FREE_MAP_CHUNK, ctrl->sectors_per_fat - sect);
+			len = block_read(ctrl->bdev, buf, ((u64_t)ctrl->first_fat_sector + sect) * ctrl->bytes_per_sector, nsect * ctrl->bytes_per_sector);
+			if(len != nsect * ctrl->bytes_per_sector)
+			{
+				free(buf);
+				goto fail;
+			}
+			for(i = 0; (i < len) && (clust <= last); clust++)
+			{
+				if(ctrl->type == FAT_TYPE_16)
+				{
+					next = ((u32_t)buf[i + 1] << 8) | buf[i];
+					i += 2;
+				}
+				else
+				{
+					next = (((u32_t)buf[i + 3] << 24) | ((u32_t)buf[i + 2] << 16) | ((u32_t)buf[i + 1] << 8) | buf[i]) & 0x0FFFFFFF;
+					i += 4;
+				}
+				if(clust < first)
+					continue;
+				if(next)
+					ctrl->free_map[clust >> 5] |= (1U << (clust & 0x1f));
+				else
+					ctrl->free_count++;
+			}
+		}
+		free(buf);
+	}
+
+	if((ctrl->next_free < first) || (ctrl->next_free > last))
+		ctrl->next_free = first;
+	ctrl->fsinfo_dirty = TRUE;
+	return 0;
+
+fail:
+	free(ctrl->free_map);
+	ctrl->free_map = NULL;
+	return -1;
+}
+
+/*
+ * Pick a free cluster from the bitmap. Extending a chain takes the cluster right after
+ * its tail when that is free, otherwise the first run of FAT_ALLOC_RUN free clusters
+ * from the next free hint is preferred so new data stays contiguous.
+ */
+static bool_t __fatfs_control_find_free_cluster(struct fatfs_control_t * ctrl, u32_t clust, u32_t * found)
+{
+	u32_t first, last, start, current, n, fallback = 0;
+	int pass;
+
+	first = __fatfs_control_first_valid_cluster(ctrl);
+	last = __fatfs_control_max_cluster(ctrl);
+	if(ctrl->free_count == 0)
+		return FALSE;
+
+	if(__fatfs_control_valid_cluster(ctrl, clust) && (clust < last) && !__fatfs_control_cluster_used(ctrl, clust + 1))
+	{
+		*found = clust + 1;
+		return TRUE;
+	}
+
+	start = ((ctrl->next_free >= first) && (ctrl->next_free <= last)) ? ctrl->next_free : first;
+	for(pass = 0; pass < 2; pass++)
+	{
+		current = pass ? first : start;
+		while(current <= (pass ? start - 1 : last))
+		{
+			if(((current & 0x1f) == 0) && (ctrl->free_map[current >> 5] == 0xffffffff))
+			{
+				current += 32;
+				continue;
+			}
+			if(__fatfs_control_cluster_used(ctrl, current))
+			{
+				current++;
+				continue;
+			}
+			for(n = 1; (n < FAT_ALLOC_RUN) && (current + n <= last) && !__fatfs_control_cluster_used(ctrl, current + n); n++);
+			if(n >= FAT_ALLOC_RUN)
+			{
+				*found = current;
+				return TRUE;
+			}
+			if(!fallback)
+				fallback = current;
+			current += n;
+		}
+	}
+
+	if(!fallback)
+		return FALSE;
+	*found = fallback;
+	return TRUE;
+}
+
 static int __fatfs_control_alloc_cluster(struct fatfs_control_t * ctrl, u32_t clust, u32_t * newclust)
 {
 	int rc;
@@ -404,26 +683,33 @@ static int __fatfs_control_alloc_cluster(struct fatfs_control_t * ctrl, u32_t cl
 
 	found = FALSE;
 
-	if(__fatfs_control_valid_cluster(ctrl, clust))
+	if(!__fatfs_control_load_free_map(ctrl))
 	{
-		first = clust;
+		found = __fatfs_control_find_free_cluster(ctrl, clust, &current);
 	}
 	else
 	{
-		first = __fatfs_control_first_valid_cluster(ctrl);
-	}
-
-	last = __fatfs_control_last_valid_cluster(ctrl);
-	for(current = first; current <= last; current++)
-	{
-		rc = __fatfs_control_get_next_cluster(ctrl, current, &next);
-		if(rc)
-			return rc;
+		if(__fatfs_control_valid_cluster(ctrl, clust))
+		{
+			first = clust;
+		}
+		else
+		{
+			first = __fatfs_control_first_valid_cluster(ctrl);
+		}
 
-		if(next == 0x0)
+		last = __fatfs_control_max_cluster(ctrl);
+		for(current = first; current <= last; current++)
 		{
-			found = TRUE;
-			break;
+			rc = __fatfs_control_get_next_cluster(ctrl, current, &next);
+			if(rc)
+				return rc;
+
+			if(next == 0x0)
+			{
+				found = TRUE;
+				break;
+			}
 		}
 	}
 
@@ -434,6 +720,9 @@ static int __fatfs_control_alloc_cluster(struct fatfs_control_t * ctrl, u32_t cl
 	if(rc)
 		return rc;
 
+	__fatfs_control_mark_cluster(ctrl, current, TRUE);
+	ctrl->next_free = current + 1;
+
 	if(newclust)
 		*newclust = current;
 
@@ -471,6 +760,8 @@ static int __fatfs_control_truncate_clusters(struct fatfs_control_t *ctrl, u32_t
 		rc = __fatfs_control_set_next_cluster(ctrl, current, 0x0);
 		if(rc)
 			return rc;
+
+		__fatfs_control_mark_cluster(ctrl, current, FALSE);
 	}
 
 	return 0;
@@ -608,27 +899,46 @@ int fatfs_control_truncate_clusters(struct fatfs_control_t * ctrl, u32_t clust)
 	return rc;
 }
 
+static int __fatfs_control_sync_fsinfo(struct fatfs_control_t * ctrl)
+{
+	struct fat_fsinfo_t fsinfo;
+	u64_t off, len;
+
+	if(!ctrl->fsinfo_sector || !ctrl->fsinfo_dirty)
+		return 0;
+
+	off = (u64_t)ctrl->fsinfo_sector * ctrl->bytes_per_sector;
+	len = block_read(ctrl->bdev, (u8_t *)&fsinfo, off, sizeof(struct fat_fsinfo_t));
+	if(len != sizeof(struct fat_fsinfo_t))
+		return -1;
+
+	fsinfo.free_count = cpu_to_le32(ctrl->free_count);
+	fsinfo.next_free = cpu_to_le32(ctrl->next_free);
+	len = block_write(ctrl->bdev, (u8_t *)&fsinfo, off, sizeof(struct fat_fsinfo_t));
+	if(len != sizeof(struct fat_fsinfo_t))
+		return -1;
+	ctrl->fsinfo_dirty = FALSE;
+
+	return 0;
+}
+
 int fatfs_control_sync(struct fatfs_control_t * ctrl)
 {
-	int rc, index;
+	int rc;
 
-	/* Flush entire FAT sector cache */
+	/* Flush entire FAT sector cache, then bring the mirrors up to date */
 	mutex_lock(&ctrl->fat_cache_lock);
-	for(index = 0; index < FAT_TABLE_CACHE_SIZE; index++)
-	{
-		rc = __fatfs_control_flush_fat_cache(ctrl, index);
-		if(rc)
-		{
-			mutex_unlock(&ctrl->fat_cache_lock);
-			return rc;
-		}
-	}
+	rc = __fatfs_control_flush_fat_cache(ctrl);
+	if(!rc)
+		rc = __fatfs_control_sync_fat_mirrors(ctrl);
+	if(!rc)
+		rc = __fatfs_control_sync_fsinfo(ctrl);
 	mutex_unlock(&ctrl->fat_cache_lock);
+	if(rc)
+		return rc;
 
 	/* Flush cached data in device request queue */
-	block_sync(ctrl->bdev);
-
-	return 0;
+	return block_sync(ctrl->bdev);
 }
 
 int fatfs_control_init(struct fatfs_control_t * ctrl, struct block_t * bdev)
@@ -718,32 +1028,63 @@ int fatfs_control_init(struct fatfs_control_t * ctrl, struct block_t * bdev)
 		ctrl->data_clusters = udiv32(ctrl->data_sectors, ctrl->sectors_per_cluster);
 	}
 
-	/* Initialize fat cache */
-	mutex_init(&ctrl->fat_cache_lock);
-	ctrl->fat_cache_victim = 0;
-	for(i = 0; i < FAT_TABLE_CACHE_SIZE; i++)
+	/* Take the FSInfo hints, the free count is only trusted until the bitmap exists */
+	ctrl->free_map = NULL;
+	ctrl->free_count = FAT_FSINFO_UNKNOWN;
+	ctrl->next_free = FAT_FSINFO_UNKNOWN;
+	ctrl->fsinfo_sector = 0;
+	ctrl->fsinfo_dirty = FALSE;
+	if((ctrl->type == FAT_TYPE_32) && (sizeof(struct fat_fsinfo_t) <= ctrl->bytes_per_sector))
 	{
-		ctrl->fat_cache_dirty[i] = FALSE;
-		ctrl->fat_cache_num[i] = i;
+		struct fat_fsinfo_t fsinfo;
+
+		i = le16_to_cpu(bsec->ext.e32.fs_info_sector);
+		if((i > 0) && (i < ctrl->first_fat_sector))
+		{
+			rlen = block_read(bdev, (u8_t *)&fsinfo, (u64_t)i * ctrl->bytes_per_sector, sizeof(struct fat_fsinfo_t));
+			if((rlen == sizeof(struct fat_fsinfo_t))
+				&& (le32_to_cpu(fsinfo.lead_signature) == FAT_FSINFO_LEAD_SIGNATURE)
+				&& (le32_to_cpu(fsinfo.struct_signature) == FAT_FSINFO_STRUCT_SIGNATURE)
+				&& (le32_to_cpu(fsinfo.trail_signature) == FAT_FSINFO_TRAIL_SIGNATURE))
+			{
+				ctrl->fsinfo_sector = i;
+				ctrl->free_count = le32_to_cpu(fsinfo.free_count);
+				ctrl->next_free = le32_to_cpu(fsinfo.next_free);
+				if(ctrl->free_count > ctrl->data_clusters)
+					ctrl->free_count = FAT_FSINFO_UNKNOWN;
+			}
+		}
 	}
-	ctrl->fat_cache_buf = calloc(1, FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector);
-	if(!ctrl->fat_cache_buf)
-		return -1;
 
-	/* Load fat cache */
-	rlen = block_read(ctrl->bdev, ctrl->fat_cache_buf, ctrl->first_fat_sector * ctrl->bytes_per_sector,
-	FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector);
-	if(rlen != (FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector))
+	/* Initialize fat cache, slots pin their block buffer once first used */
+	mutex_init(&ctrl->fat_cache_lock);
+	init_list_head(&ctrl->fat_cache_lru);
+	ctrl->fat_cache_dirty = 0;
+	ctrl->fat_cache_hits = 0;
+	ctrl->fat_cache_misses = 0;
+	for(i = 0; i < FAT_TABLE_CACHE_SIZE; i++)
 	{
-		free(ctrl->fat_cache_buf);
-		return -1;
+		ctrl->fat_cache[i].sect = FAT_TABLE_CACHE_NONE;
+		ctrl->fat_cache[i].dirty = FALSE;
+		ctrl->fat_cache[i].b = NULL;
+		list_add_tail(&ctrl->fat_cache[i].entry, &ctrl->fat_cache_lru);
 	}
 
+	/* Without memory for the stale map the mirrors are written along with the first FAT */
+	ctrl->fat_mirror_map = NULL;
+	if(ctrl->number_of_fat > 1)
+		ctrl->fat_mirror_map = calloc((ctrl->sectors_per_fat >> 5) + 1, sizeof(u32_t));
+
 	return 0;
 }
 
 int fatfs_control_exit(struct fatfs_control_t * ctrl)
 {
-	free(ctrl->fat_cache_buf);
+	int i;
+
+	for(i = 0; i < FAT_TABLE_CACHE_SIZE; i++)
+		block_buffer_put(ctrl->fat_cache[i].b);
+	free(ctrl->free_map);
+	free(ctrl->fat_mirror_map);
 	return 0;
 }
@@ -48,29 +48,6 @@ static int fatfs_node_sync_cached_cluster(struct fatfs_node_t * node)
 	return 0;
 }
 
-static int fatfs_node_sync_parent_dent(struct fatfs_node_t * node)
-{
-	int rc;
-	u32_t woff, wlen;
-
-	if(!node->parent || !node->parent_dent_dirty)
-		return 0;
-
-	woff = node->parent_dent_off + node->parent_dent_len - sizeof(node->parent_dent);
-	if(woff < node->parent_dent_off)
-		return -1;
-
-	wlen = fatfs_node_write(node->parent, woff, sizeof(node->parent_dent), (u8_t *) &node->parent_dent);
-	if(wlen != sizeof(node->parent_dent))
-		return -1;
-
-	rc = fatfs_node_sync_cached_cluster(node->parent);
-	if(rc)
-		return rc;
-	node->parent_dent_dirty = FALSE;
-	return 0;
-}
-
 u32_t fatfs_node_get_size(struct fatfs_node_t * node)
 {
 	if(!node)
@@ -170,73 +147,160 @@ static int fatfs_node_clear_cluster(struct fatfs_node_t * node, u32_t clust)
 	return 0;
 }
 
-static int fatfs_node_nth_cluster(struct fatfs_node_t * node, u32_t clust, u32_t pos, u32_t * next)
+void fatfs_node_reset_extents(struct fatfs_node_t * node)
 {
-	return fatfs_control_nth_cluster(node->ctrl, clust, pos, next);
+	node->extent_count = 0;
+	node->extent_clusters = 0;
+	node->extent_done = FALSE;
 }
 
-static int fatfs_node_next_cluster(struct fatfs_node_t * node, u32_t clust, u32_t * next)
+static int fatfs_node_append_extent(struct fatfs_node_t * node, u32_t clust)
 {
-	return fatfs_node_nth_cluster(node, clust, 1, next);
+	struct fatfs_extent_t * e;
+	u32_t size;
+
+	if(node->extent_count > 0)
+	{
+		e = &node->extents[node->extent_count - 1];
+		if(e->clust + e->count == clust)
+		{
+			e->count++;
+			node->extent_clusters++;
+			return 0;
+		}
+	}
+
+	if(node->extent_count >= node->extent_size)
+	{
+		size = node->extent_size ? node->extent_size << 1 : 8;
+		e = realloc(node->extents, size * sizeof(struct fatfs_extent_t));
+		if(!e)
+			return -1;
+		node->extents = e;
+		node->extent_size = size;
+	}
+
+	e = &node->extents[node->extent_count++];
+	e->index = node->extent_clusters++;
+	e->clust = clust;
+	e->count = 1;
+	return 0;
 }
 
-static int fatfs_node_auto_alloc_next_cluster(struct fatfs_node_t * node, u32_t clust, u32_t * next)
+/*
+ * Binary search the run holding an already mapped cluster index
+ */
+static struct fatfs_extent_t * fatfs_node_find_extent(struct fatfs_node_t * node, u32_t index)
 {
-	int rc;
-	struct fatfs_control_t * ctrl = node->ctrl;
-	u32_t cl = clust;
-
-	/* Go to next cluster */
-	rc = fatfs_node_next_cluster(node, clust, next);
-	if(!rc)
-		return 0;
+	int l, r, m;
 
-	/* Add new cluster */
-	if(fatfs_control_valid_cluster(ctrl, clust))
+	l = 0;
+	r = node->extent_count - 1;
+	while(l < r)
 	{
-		rc = fatfs_control_append_free_cluster(ctrl, cl, next);
+		m = (l + r + 1) >> 1;
+		if(node->extents[m].index <= index)
+			l = m;
+		else
+			r = m - 1;
 	}
-	else
+	return &node->extents[l];
+}
+
+/*
+ * Map the index'th cluster of the file. The chain is walked only past the clusters
+ * already mapped, after which a seek anywhere is a binary search over the runs.
+ */
+static int fatfs_node_lookup_extent(struct fatfs_node_t * node, u32_t index, u32_t * clust)
+{
+	struct fatfs_control_t * ctrl = node->ctrl;
+	struct fatfs_extent_t * e;
+	u32_t next;
+
+	while((index >= node->extent_clusters) && !node->extent_done)
 	{
-		rc = fatfs_control_alloc_first_cluster(ctrl, next);
+		if(node->extent_count == 0)
+		{
+			next = node->first_cluster;
+			if(!fatfs_control_valid_cluster(ctrl, next))
+			{
+				node->extent_done = TRUE;
+				break;
+			}
+		}
+		else
+		{
+			e = &node->extents[node->extent_count - 1];
+			if(fatfs_control_nth_cluster(ctrl, e->clust + e->count - 1, 1, &next))
+			{
+				node->extent_done = TRUE;
+				break;
+			}
+		}
+		if(fatfs_node_append_extent(node, next))
+			return -1;
 	}
 
-	if(rc)
-		return rc;
+	if(index >= node->extent_clusters)
+		return -1;
 
-	rc = fatfs_node_clear_cluster(node, *next);
+	e = fatfs_node_find_extent(node, index);
+	*clust = e->clust + (index - e->index);
+	return 0;
+}
 
-	if(rc)
-		return rc;
+/*
+ * Count of physically contiguous clusters from a mapped index, at most max
+ */
+static u32_t fatfs_node_cluster_run(struct fatfs_node_t * node, u32_t index, u32_t max)
+{
+	struct fatfs_extent_t * e;
+	u32_t clust;
 
-	return 0;
+	/* Map the chain far enough to see the whole span */
+	fatfs_node_lookup_extent(node, index + max - 1, &clust);
+	e = fatfs_node_find_extent(node, index);
+	return min(e->index + e->count - index, max);
 }
 
-static void fatfs_node_fast_jump_cluster(struct fatfs_node_t * node, u32_t pos, u32_t * cl_pos, u32_t * cl_num)
+/*
+ * Get the index'th cluster of the file, optionally growing the chain with zeroed clusters
+ */
+static int fatfs_node_get_cluster(struct fatfs_node_t * node, u32_t index, bool_t alloc, u32_t * clust)
 {
-	struct fatfs_control_t *ctrl = node->ctrl;
+	struct fatfs_control_t * ctrl = node->ctrl;
+	struct fatfs_extent_t * e;
+	u32_t next;
+	int rc;
 
-	node->cur_pos = ctrl->bytes_per_cluster * udiv32(node->cur_pos, ctrl->bytes_per_cluster);
+	if(!fatfs_node_lookup_extent(node, index, clust))
+		return 0;
+	if(!alloc || !node->extent_done || (node->extent_count == 0))
+		return -1;
 
-	/* Jump to current pos if pos >= cur_cluster*/
-	if(pos >= node->cur_pos)
-	{
-		*cl_pos = udiv32(pos - node->cur_pos, ctrl->bytes_per_cluster);
-		*cl_num = node->cur_cluster;
-	}
-	else
+	while(node->extent_clusters <= index)
 	{
-		*cl_pos = udiv32(pos, ctrl->bytes_per_cluster);
-		*cl_num = node->first_cluster;
-		node->cur_cluster = node->first_cluster;
-		node->cur_pos = 0;
+		e = &node->extents[node->extent_count - 1];
+		rc = fatfs_control_append_free_cluster(ctrl, e->clust + e->count - 1, &next);
+		if(rc)
+			return rc;
+
+		rc = fatfs_node_clear_cluster(node, next);
+		if(rc)
+			return rc;
+
+		rc = fatfs_node_append_extent(node, next);
+		if(rc)
+			return rc;
 	}
+	*clust = next;
+	return 0;
 }
 
-u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
+static u32_t __fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
 {
 	u64_t roff, rlen;
-	u32_t r, rstartcl;
+	u32_t r, cl_idx, cl_cnt;
 	u32_t cl_off, cl_num, cl_len;
 	struct fatfs_control_t *ctrl = node->ctrl;
 
@@ -254,45 +318,67 @@ u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * b
 		return block_read(ctrl->bdev, (u8_t *) buf, roff, rlen);
 	}
 
-	fatfs_node_fast_jump_cluster(node, pos, &rstartcl, &cl_num);
-
-	if(fatfs_node_nth_cluster(node, cl_num, rstartcl, &cl_num))
+	cl_idx = udiv32(pos, ctrl->bytes_per_cluster);
+	if(fatfs_node_get_cluster(node, cl_idx, FALSE, &cl_num))
 		return 0;
 
 	r = 0;
-	cl_off = umod32(pos + r, ctrl->bytes_per_cluster);
+	cl_off = umod32(pos, ctrl->bytes_per_cluster);
 	do
 	{
 		/* Current cluster info */
 		cl_len = ctrl->bytes_per_cluster - cl_off;
 		cl_len = (len - r < cl_len) ? len - r : cl_len;
 
-		/* Update current cluster */
-		node->cur_cluster = cl_num;
-		node->cur_pos = pos + r;
-
-		/* Read from cached cluster */
-		rlen = fatfs_node_read_cluster(node, cl_num, buf, cl_off, cl_len);
-
-		if(rlen != cl_len)
+		if((cl_off == 0) && (cl_len == ctrl->bytes_per_cluster))
 		{
-			break;
+			/*
+			 * Whole clusters are read straight into the buffer, one contiguous run at a
+			 * time. The transfer touches no node state, so the lock is dropped meanwhile,
+			 * directory entry accesses never get here as they are shorter than a cluster.
+			 */
+			cl_cnt = fatfs_node_cluster_run(node, cl_idx, udiv32(len - r, ctrl->bytes_per_cluster));
+			if(node->cached_dirty && (node->cached_clust >= cl_num) && (node->cached_clust < cl_num + cl_cnt))
+			{
+				if(fatfs_node_sync_cached_cluster(node))
+					break;
+			}
+			cl_len = cl_cnt * ctrl->bytes_per_cluster;
+			roff = (u64_t) ctrl->first_data_sector * ctrl->bytes_per_sector;
+			roff += (u64_t) (cl_num - 2) * ctrl->bytes_per_cluster;
+			mutex_unlock(&node->lock);
+			rlen = block_read(ctrl->bdev, buf, roff, cl_len);
+			mutex_lock(&node->lock);
+			if(rlen != cl_len)
+			{
+				break;
+			}
+			cl_idx += cl_cnt - 1;
+		}
+		else
+		{
+			/* Partial head and tail clusters go through the cached cluster */
+			rlen = fatfs_node_read_cluster(node, cl_num, buf, cl_off, cl_len);
+			if(rlen != cl_len)
+			{
+				break;
+			}
 		}
 
 		/* Update iteration */
 		r += cl_len;
 		buf += cl_len;
-		cl_off -= cl_off;
-	} while(r < len && !fatfs_node_next_cluster(node, cl_num, &cl_num));
+		cl_off = 0;
+	} while(r < len && !fatfs_node_get_cluster(node, ++cl_idx, FALSE, &cl_num));
 
 	return r;
 }
 
-u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
+static u32_t __fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
 {
 	int rc;
 	u64_t woff, wlen;
-	u32_t w = 0, wstartcl;
+	u32_t w = 0, cl_idx;
 	u32_t cl_off, cl_num, cl_len;
 	struct fatfs_control_t *ctrl = node->ctrl;
 
@@ -311,40 +397,34 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 	/* If first cluster is zero then allocate first cluster */
 	if(node->first_cluster == 0)
 	{
-		rc = fatfs_node_auto_alloc_next_cluster(node, 0, &cl_num);
+		rc = fatfs_control_alloc_first_cluster(ctrl, &cl_num);
+		if(rc)
+			return 0;
+
+		rc = fatfs_node_clear_cluster(node, cl_num);
 		if(rc)
 			return 0;
 
 		node->first_cluster = cl_num;
-		node->cur_cluster = node->first_cluster;
-		node->cur_pos = 0;
+		fatfs_node_reset_extents(node);
 
 		/* Mark node directory entry as dirty */
 		node->parent_dent_dirty = TRUE;
 	}
 
-	fatfs_node_fast_jump_cluster(node, pos, &wstartcl, &cl_num);
-
 	/* Make room for new data by appending free clusters */
-	for(int i = 0; i < wstartcl; i++)
-	{
-		rc = fatfs_node_auto_alloc_next_cluster(node, cl_num, &cl_num);
-		if(rc)
-			return 0;
-	}
+	cl_idx = udiv32(pos, ctrl->bytes_per_cluster);
+	if(fatfs_node_get_cluster(node, cl_idx, TRUE, &cl_num))
+		return 0;
 
 	w = 0;
-	cl_off = umod32(pos + w, ctrl->bytes_per_cluster);
+	cl_off = umod32(pos, ctrl->bytes_per_cluster);
 	do
 	{
 		/* Current cluster info */
 		cl_len = ctrl->bytes_per_cluster - cl_off;
 		cl_len = (len - w < cl_len) ? len - w : cl_len;
 
-		/* Update current cluster */
-		node->cur_cluster = cl_num;
-		node->cur_pos = pos + w;
-
 		/* Write next cluster */
 		wlen = fatfs_node_write_cluster(node, cl_num, buf, cl_off, cl_len);
 
@@ -356,8 +436,8 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 		/* Update iteration */
 		w += cl_len;
 		buf += cl_len;
-		cl_off -= cl_off;
-	} while(w < len && !fatfs_node_auto_alloc_next_cluster(node, cl_num, &cl_num));
+		cl_off = 0;
+	} while(w < len && !fatfs_node_get_cluster(node, ++cl_idx, TRUE, &cl_num));
 
 	/* Mark node directory entry as dirty */
 	node->parent_dent_dirty = TRUE;
@@ -365,10 +445,30 @@ u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t *
 	return w;
 }
 
-int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
+u32_t fatfs_node_read(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
+{
+	u32_t r;
+
+	mutex_lock(&node->lock);
+	r = __fatfs_node_read(node, pos, len, buf);
+	mutex_unlock(&node->lock);
+	return r;
+}
+
+u32_t fatfs_node_write(struct fatfs_node_t * node, u32_t pos, u32_t len, u8_t * buf)
+{
+	u32_t w;
+
+	mutex_lock(&node->lock);
+	w = __fatfs_node_write(node, pos, len, buf);
+	mutex_unlock(&node->lock);
+	return w;
+}
+
+static int __fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 {
 	int rc;
-	u32_t cl_pos, cl_num, t_pos;
+	u32_t keep, cl_num;
 	struct fatfs_control_t * ctrl = node->ctrl;
 
 	if(!node->parent && ctrl->type != FAT_TYPE_32)
@@ -377,32 +477,27 @@ int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 		return 0;
 	}
 
-	/* Determine last cluster after truncation */
-	t_pos = udiv32(pos + ctrl->bytes_per_cluster - 1, ctrl->bytes_per_cluster);
-	fatfs_node_fast_jump_cluster(node, t_pos + ctrl->bytes_per_cluster - 1, &cl_pos, &cl_num);
-
-	rc = fatfs_control_nth_cluster(ctrl, cl_num, cl_pos, &cl_num);
-	if(rc)
-		return rc;
+	/* Number of clusters still needed after truncation */
+	keep = udiv32(pos + ctrl->bytes_per_cluster - 1, ctrl->bytes_per_cluster);
 
 	/* Remove all clusters after last cluster */
-	rc = fatfs_control_truncate_clusters(ctrl, cl_num);
-	if(rc)
-		return rc;
+	if(!fatfs_node_get_cluster(node, keep, FALSE, &cl_num))
+	{
+		rc = fatfs_control_truncate_clusters(ctrl, cl_num);
+		if(rc)
+			return rc;
+	}
 
 	/* If we are removing first cluster then set it to zero
 	 * else set previous cluster as last cluster
 	 */
-	if(cl_pos == 0)
+	if(keep == 0)
 	{
 		node->first_cluster = 0;
 	}
 	else
 	{
-		/* if go here, t_pos >= node->first_cluster */
-		t_pos -= ctrl->bytes_per_cluster;
-		fatfs_node_fast_jump_cluster(node, t_pos, &cl_pos, &cl_num);
-		rc = fatfs_control_nth_cluster(ctrl, cl_num, cl_pos, &cl_num);
+		rc = fatfs_node_get_cluster(node, keep - 1, FALSE, &cl_num);
 		if(rc)
 			return rc;
 		rc = fatfs_control_set_last_cluster(ctrl, cl_num);
@@ -412,28 +507,152 @@ int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 
 	/* Mark node directory entry as dirty */
 	node->parent_dent_dirty = TRUE;
-	node->cur_cluster = node->first_cluster;
-	node->cur_pos = 0;
+	fatfs_node_reset_extents(node);
 	return 0;
 }
 
-int fatfs_node_sync(struct fatfs_node_t * node)
+int fatfs_node_truncate(struct fatfs_node_t * node, u32_t pos)
 {
 	int rc;
 
-	rc = fatfs_node_sync_cached_cluster(node);
-	if(rc)
-		return rc;
+	mutex_lock(&node->lock);
+	rc = __fatfs_node_truncate(node, pos);
+	mutex_unlock(&node->lock);
+	return rc;
+}
+
+static u32_t fatfs_node_dindex_hash(const char * name)
+{
+	u32_t v = 5381;
+
+	while(*name)
+		v = (v << 5) + v + tolower(*name++);
+	return v;
+}
+
+static void fatfs_node_dindex_insert(struct fatfs_node_t * dnode, struct fatfs_dindex_t * e)
+{
+	hlist_add_head(&e->node, &dnode->dindex[fatfs_node_dindex_hash(e->name) & (dnode->dindex_size - 1)]);
+	dnode->dindex_count++;
+}
 
-	rc = fatfs_node_sync_parent_dent(node);
+static void fatfs_node_dindex_grow(struct fatfs_node_t * dnode)
+{
+	struct hlist_head * old = dnode->dindex, * hash;
+	struct fatfs_dindex_t * e;
+	struct hlist_node * n;
+	u32_t size = dnode->dindex_size, i;
+
+	hash = malloc((size << 1) * sizeof(struct hlist_head));
+	if(!hash)
+		return;
+	for(i = 0; i < (size << 1); i++)
+		init_hlist_head(&hash[i]);
+	dnode->dindex = hash;
+	dnode->dindex_size = size << 1;
+	dnode->dindex_count = 0;
+	for(i = 0; i < size; i++)
+	{
+		hlist_for_each_entry_safe(e, n, &old[i], node)
+		{
+			hlist_del(&e->node);
+			fatfs_node_dindex_insert(dnode, e);
+		}
+	}
+	free(old);
+}
+
+static int fatfs_node_dindex_add(struct fatfs_node_t * dnode, const char * name, u32_t off, u32_t len)
+{
+	struct fatfs_dindex_t * e;
+	int l = strlen(name);
+
+	e = malloc(sizeof(struct fatfs_dindex_t) + l + 1);
+	if(!e)
+		return -1;
+	e->off = off;
+	e->len = len;
+	memcpy(e->name, name, l + 1);
+	if(dnode->dindex_count >= (dnode->dindex_size << 1))
+		fatfs_node_dindex_grow(dnode);
+	fatfs_node_dindex_insert(dnode, e);
+	return 0;
+}
+
+static struct fatfs_dindex_t * fatfs_node_dindex_find(struct fatfs_node_t * dnode, const char * name)
+{
+	struct fatfs_dindex_t * e;
+
+	hlist_for_each_entry(e, &dnode->dindex[fatfs_node_dindex_hash(name) & (dnode->dindex_size - 1)], node)
+	{
+		if(!strncmp(e->name, name, VFS_MAX_NAME))
+			return e;
+	}
+	return NULL;
+}
+
+static void fatfs_node_dindex_free(struct fatfs_node_t * dnode)
+{
+	struct fatfs_dindex_t * e;
+	struct hlist_node * n;
+	u32_t i;
+
+	if(dnode->dindex)
+	{
+		for(i = 0; i < dnode->dindex_size; i++)
+		{
+			hlist_for_each_entry_safe(e, n, &dnode->dindex[i], node)
+			{
+				hlist_del(&e->node);
+				free(e);
+			}
+		}
+		free(dnode->dindex);
+		dnode->dindex = NULL;
+		dnode->dindex_size = 0;
+		dnode->dindex_count = 0;
+	}
+}
+
+static int fatfs_node_sync_parent_dent(struct fatfs_node_t * node)
+{
+	int rc;
+	u32_t woff, wlen;
+
+	if(!node->parent || !node->parent_dent_dirty)
+		return 0;
+
+	woff = node->parent_dent_off + node->parent_dent_len - sizeof(node->parent_dent);
+	if(woff < node->parent_dent_off)
+		return -1;
+
+	mutex_lock(&node->parent->lock);
+	wlen = __fatfs_node_write(node->parent, woff, sizeof(node->parent_dent), (u8_t *) &node->parent_dent);
+	rc = (wlen != sizeof(node->parent_dent)) ? -1 : fatfs_node_sync_cached_cluster(node->parent);
+	mutex_unlock(&node->parent->lock);
 	if(rc)
 		return rc;
-
+	node->parent_dent_dirty = FALSE;
 	return 0;
 }
 
+int fatfs_node_sync(struct fatfs_node_t * node)
+{
+	int rc;
+
+	/* Locks are only ever taken from a node towards its parent */
+	mutex_lock(&node->lock);
+	rc = fatfs_node_sync_cached_cluster(node);
+	if(!rc)
+		rc = fatfs_node_sync_parent_dent(node);
+	mutex_unlock(&node->lock);
+
+	return rc;
+}
+
 int fatfs_node_init(struct fatfs_control_t * ctrl, struct fatfs_node_t * node)
 {
+	mutex_init(&node->lock);
 	node->ctrl = ctrl;
 	node->parent = NULL;
 	node->parent_dent_off = 0;
@@ -441,14 +660,20 @@ int fatfs_node_init(struct fatfs_control_t * ctrl, struct fatfs_node_t * node)
 	memset(&node->parent_dent, 0, sizeof(struct fat_dirent_t));
 	node->parent_dent_dirty = FALSE;
 	node->first_cluster = 0;
-	node->cur_cluster = 0;
-	node->cur_pos = 0;
+	node->extents = NULL;
+	node->extent_size = 0;
+	fatfs_node_reset_extents(node);
+
+	node->dindex = NULL;
+	node->dindex_size = 0;
+	node->dindex_count = 0;
+	node->dindex_end = 0;
+	node->dindex_holes = 0;
 
 	node->cached_clust = 0;
 	node->cached_data = NULL;
 	node->cached_dirty = FALSE;
 
-
 	return 0;
 }
 
@@ -462,6 +687,16 @@ int fatfs_node_exit(struct fatfs_node_t * node)
 		node->cached_dirty = FALSE;
 	}
 
+	fatfs_node_dindex_free(node);
+
+	if(node->extents)
+	{
+		free(node->extents);
+		node->extents = NULL;
+		node->extent_size = 0;
+		fatfs_node_reset_extents(node);
+	}
+
 	return 0;
 }
 
@@ -478,7 +713,7 @@ static u8_t fatfs_node_lfn_checksum(const u8_t * name)
 	return sum;
 }
 
-int fatfs_node_read_dirent(struct fatfs_node_t * dnode, s64_t off, struct vfs_dirent_t * d)
+static int __fatfs_node_read_dirent(struct fatfs_node_t * dnode, s64_t off, struct vfs_dirent_t * d)
 {
 	u32_t i, rlen, len;
 	u8_t lcsum = 0, dcsum = 0, check[11];
@@ -498,7 +733,7 @@ int fatfs_node_read_dirent(struct fatfs_node_t * dnode, s64_t off, struct vfs_di
 
 	while(1)
 	{
-		rlen = fatfs_node_read(dnode, fileoff, sizeof(struct fat_dirent_t), (u8_t *) &dent);
+		rlen = __fatfs_node_read(dnode, fileoff, sizeof(struct fat_dirent_t), (u8_t *) &dent);
 		if(rlen != sizeof(struct fat_dirent_t))
 			return -1;
 
@@ -601,30 +836,50 @@ int fatfs_node_read_dirent(struct fatfs_node_t * dnode, s64_t off, struct vfs_di
 	return 0;
 }
 
-int fatfs_node_find_dirent(struct fatfs_node_t * dnode, const char * name, struct fat_dirent_t * dent, u32_t * dent_off, u32_t * dent_len)
+int fatfs_node_read_dirent(struct fatfs_node_t * dnode, s64_t off, struct vfs_dirent_t * d)
+{
+	int rc;
+
+	mutex_lock(&dnode->lock);
+	rc = __fatfs_node_read_dirent(dnode, off, d);
+	mutex_unlock(&dnode->lock);
+	return rc;
+}
+
+/*
+ * Decode the next named entry at or after off and advance off past it. At the end of the
+ * directory -1 is returned with off on the terminating entry, deleted entries are counted.
+ */
+static int fatfs_node_next_dirent(struct fatfs_node_t * dnode, u32_t * poff, struct fat_dirent_t * dent, char * lname, u32_t * dent_off, u32_t * dent_len, u32_t * deleted)
 {
 	u8_t lcsum = 0, dcsum = 0, check[11];
 	u32_t i, off, rlen, len, lfn_off, lfn_len;
 	struct fat_longname_t lfn;
-	char lname[VFS_MAX_NAME];
 
-	lfn_off = 0;
+	off = *poff;
+	lfn_off = off;
 	lfn_len = 0;
-	memset(lname, 0, sizeof(lname));
+	memset(lname, 0, VFS_MAX_NAME);
 
-	off = 0;
 	while(1)
 	{
-		rlen = fatfs_node_read(dnode, off, sizeof(struct fat_dirent_t), (u8_t *) dent);
+		rlen = __fatfs_node_read(dnode, off, sizeof(struct fat_dirent_t), (u8_t *) dent);
 		if(rlen != sizeof(struct fat_dirent_t))
-			return -1;
+			break;
 
 		if(dent->dos_file_name[0] == 0x0)
-			return -1;
+			break;
 
 		off += sizeof(struct fat_dirent_t);
 
-		if((dent->dos_file_name[0] == 0xE5) || (dent->dos_file_name[0] == 0x2E))
+		if(dent->dos_file_name[0] == 0xE5)
+		{
+			if(deleted)
+				(*deleted)++;
+			continue;
+		}
+
+		if(dent->dos_file_name[0] == 0x2E)
 			continue;
 
 		if(dent->file_attributes == FAT_LONGNAME_ATTRIBUTE)
@@ -636,7 +891,7 @@ int fatfs_node_find_dirent(struct fatfs_node_t * dnode, const char * name, struc
 				lfn_off = off - sizeof(struct fat_dirent_t);
 				lfn_len = lfn.seqno * sizeof(struct fat_longname_t);
 				lcsum = lfn.checksum;
-				memset(lname, 0, sizeof(lname));
+				memset(lname, 0, VFS_MAX_NAME);
 			}
 			if((lfn.seqno < FAT_LONGNAME_MINSEQ) || (FAT_LONGNAME_MAXSEQ < lfn.seqno))
 			{
@@ -703,23 +958,103 @@ int fatfs_node_find_dirent(struct fatfs_node_t * dnode, const char * name, struc
 			lcsum = dcsum;
 		}
 
-		if(!strncmp(lname, name, VFS_MAX_NAME) && (lcsum == dcsum))
+		if(lcsum == dcsum)
 		{
 			*dent_off = lfn_off;
 			*dent_len = sizeof(struct fat_dirent_t) + lfn_len;
-
+			*poff = off;
 			return 0;
 		}
 
 		lfn_off = off;
 		lfn_len = 0;
-		memset(lname, 0, sizeof(lname));
+		memset(lname, 0, VFS_MAX_NAME);
 	}
 
+	*poff = off;
 	return -1;
 }
 
-int fatfs_node_add_dirent(struct fatfs_node_t * dnode, const char * name, struct fat_dirent_t * ndent)
+/*
+ * Index every name of a directory with one pass over its entries
+ */
+static int fatfs_node_dindex_build(struct fatfs_node_t * dnode)
+{
+	struct fat_dirent_t dent;
+	char lname[VFS_MAX_NAME];
+	u32_t off = 0, doff, dlen, i;
+
+	dnode->dindex_size = FAT_DINDEX_HASH_SIZE;
+	dnode->dindex = malloc(dnode->dindex_size * sizeof(struct hlist_head));
+	if(!dnode->dindex)
+		return -1;
+	for(i = 0; i < dnode->dindex_size; i++)
+		init_hlist_head(&dnode->dindex[i]);
+	dnode->dindex_count = 0;
+	dnode->dindex_holes = 0;
+
+	while(!fatfs_node_next_dirent(dnode, &off, &dent, lname, &doff, &dlen, &dnode->dindex_holes))
+	{
+		if(fatfs_node_dindex_add(dnode, lname, doff, dlen))
+		{
+			fatfs_node_dindex_free(dnode);
+			return -1;
+		}
+	}
+	dnode->dindex_end = off;
+	return 0;
+}
+
+static int __fatfs_node_find_dirent(struct fatfs_node_t * dnode, const char * name, struct fat_dirent_t * dent, u32_t * dent_off, u32_t * dent_len)
+{
+	struct fatfs_dindex_t * e;
+	char lname[VFS_MAX_NAME];
+	u32_t off, rlen, i;
+
+	if(dnode->dindex || !fatfs_node_dindex_build(dnode))
+	{
+		e = fatfs_node_dindex_find(dnode, name);
+		if(!e)
+			return ENOENT;
+
+		rlen = __fatfs_node_read(dnode, e->off + e->len - sizeof(struct fat_dirent_t), sizeof(struct fat_dirent_t), (u8_t *) dent);
+		if(rlen != sizeof(struct fat_dirent_t))
+			return -1;
+
+		/* Short name only entries come back space trimmed as from a directory scan */
+		if(e->len == sizeof(struct fat_dirent_t))
+		{
+			for(i = 8; i && (dent->dos_file_name[i - 1] == ' '); i--)
+				dent->dos_file_name[i - 1] = '\0';
+			for(i = 3; i && (dent->dos_extension[i - 1] == ' '); i--)
+				dent->dos_extension[i - 1] = '\0';
+		}
+		*dent_off = e->off;
+		*dent_len = e->len;
+		return 0;
+	}
+
+	off = 0;
+	while(!fatfs_node_next_dirent(dnode, &off, dent, lname, dent_off, dent_len, NULL))
+	{
+		if(!strncmp(lname, name, VFS_MAX_NAME))
+			return 0;
+	}
+
+	return -1;
+}
+
+int fatfs_node_find_dirent(struct fatfs_node_t * dnode, const char * name, struct fat_dirent_t * dent, u32_t * dent_off, u32_t * dent_len)
+{
+	int rc;
+
+	mutex_lock(&dnode->lock);
+	rc = __fatfs_node_find_dirent(dnode, name, dent, dent_off, dent_len);
+	mutex_unlock(&dnode->lock);
+	return rc;
+}
+
+static int __fatfs_node_add_dirent(struct fatfs_node_t * dnode, const char * name, struct fat_dirent_t * ndent)
 {
 	bool_t found;
 	u8_t dcsum, check[11];
@@ -736,13 +1071,18 @@ int fatfs_node_add_dirent(struct fatfs_node_t * dnode, const char * name, struct
 	/* Atleast one entry in existing FAT directory entry format */
 	dent_cnt += 1;
 
-	/* Determine offset for directory enteries */
+	/* Determine offset for directory enteries, indexed directories without holes just append */
 	cnt = 0;
 	found = FALSE;
 	dent_off = 0x0;
-	while(1)
+	if(dnode->dindex && (dnode->dindex_holes == 0))
 	{
-		len = fatfs_node_read(dnode, dent_off, sizeof(struct fat_dirent_t), (u8_t *) &dent);
+		dent_off = dnode->dindex_end;
+		found = TRUE;
+	}
+	while(!found)
+	{
+		len = __fatfs_node_read(dnode, dent_off, sizeof(struct fat_dirent_t), (u8_t *) &dent);
 		if(len != sizeof(struct fat_dirent_t))
 		{
 			cnt = 0;
@@ -825,22 +1165,44 @@ int fatfs_node_add_dirent(struct fatfs_node_t * dnode, const char * name, struct
 		}
 
 		off = dent_off + cnt * sizeof(lfn);
-		len = fatfs_node_write(dnode, off, sizeof(lfn), (u8_t *) &lfn);
+		len = __fatfs_node_write(dnode, off, sizeof(lfn), (u8_t *) &lfn);
 		if(len != sizeof(lfn))
 			return -1;
 	}
 
 	/* Write final directory entry */
 	off = dent_off + (dent_cnt - 1) * sizeof(dent);
-	len = fatfs_node_write(dnode, off, sizeof(dent), (u8_t *) &dent);
+	len = __fatfs_node_write(dnode, off, sizeof(dent), (u8_t *) &dent);
 	if(len != sizeof(dent))
 		return -1;
 
+	/* Keep the directory index in step */
+	if(dnode->dindex)
+	{
+		if(dent_off + dent_cnt * sizeof(dent) > dnode->dindex_end)
+			dnode->dindex_end = dent_off + dent_cnt * sizeof(dent);
+		else
+			dnode->dindex_holes -= min(dnode->dindex_holes, dent_cnt);
+		if(fatfs_node_dindex_add(dnode, name, dent_off, dent_cnt * sizeof(dent)))
+			fatfs_node_dindex_free(dnode);
+	}
+
 	return 0;
 }
 
-int fatfs_node_del_dirent(struct fatfs_node_t * dnode, const char * name, u32_t dent_off, u32_t dent_len)
+int fatfs_node_add_dirent(struct fatfs_node_t * dnode, const char * name, struct fat_dirent_t * ndent)
+{
+	int rc;
+
+	mutex_lock(&dnode->lock);
+	rc = __fatfs_node_add_dirent(dnode, name, ndent);
+	mutex_unlock(&dnode->lock);
+	return rc;
+}
+
+static int __fatfs_node_del_dirent(struct fatfs_node_t * dnode, const char * name, u32_t dent_off, u32_t dent_len)
 {
+	struct fatfs_dindex_t * e;
 	u32_t off, len;
 	struct fat_dirent_t dent;
 
@@ -853,9 +1215,31 @@ int fatfs_node_del_dirent(struct fatfs_node_t * dnode, const char * name, u32_t
 		if((dent_len - off) < sizeof(dent))
 			break;
 
-		len = fatfs_node_write(dnode, dent_off + off, sizeof(dent), (u8_t *) &dent);
+		len = __fatfs_node_write(dnode, dent_off + off, sizeof(dent), (u8_t *) &dent);
 		if(len != sizeof(dent))
 			return -1;
 	}
+
+	if(dnode->dindex)
+	{
+		e = fatfs_node_dindex_find(dnode, name);
+		if(e && (e->off == dent_off))
+		{
+			hlist_del(&e->node);
+			dnode->dindex_count--;
+			free(e);
+		}
+		dnode->dindex_holes += udiv32(dent_len, sizeof(dent));
+	}
 	return 0;
 }
+
+int fatfs_node_del_dirent(struct fatfs_node_t * dnode, const char * name, u32_t dent_off, u32_t dent_len)
+{
+	int rc;
+
+	mutex_lock(&dnode->lock);
+	rc = __fatfs_node_del_dirent(dnode, name, dent_off, dent_len);
+	mutex_unlock(&dnode->lock);
+	return rc;
+}
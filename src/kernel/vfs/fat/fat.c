@@ -30,6 +30,17 @@
 #include <vfs/fat/fat-node.h>
 #include <vfs/fat/fat.h>
 
+static ssize_t fatfs_read_stats(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct fatfs_control_t * ctrl = (struct fatfs_control_t *)kobj->priv;
+	int len = 0;
+
+	len += snprintf((char *)buf + len, size - len, "fat hits:   %u\r\n", ctrl->fat_cache_hits);
+	len += snprintf((char *)buf + len, size - len, "fat misses: %u\r\n", ctrl->fat_cache_misses);
+	len += snprintf((char *)buf + len, size - len, "fat dirty:  %u buffers\r\n", ctrl->fat_cache_dirty);
+	return min(len, (int)size);
+}
+
 static int fatfs_mount(struct vfs_mount_t * m, const char * dev)
 {
 	struct fatfs_control_t * ctrl;
@@ -68,8 +79,7 @@ static int fatfs_mount(struct vfs_mount_t * m, const char * dev)
 	{
 		root->first_cluster = 0x0;
 	}
-	root->cur_cluster = root->first_cluster;
-	root->cur_pos = 0;
+	fatfs_node_reset_extents(root);
 	root->parent_dent_dirty = FALSE;
 
 	/* Handcraft the root vfs node */
@@ -82,6 +92,15 @@ static int fatfs_mount(struct vfs_mount_t * m, const char * dev)
 
 	/* Save control as mount point data */
 	m->m_data = ctrl;
+
+	/* Export statistics, a device mounted twice is rejected by the caller anyway */
+	ctrl->kobj = kobj_alloc_directory(ctrl->bdev->name);
+	kobj_add_regular(ctrl->kobj, "stats", fatfs_read_stats, NULL, ctrl);
+	if(!kobj_add(m->m_fs->kobj, ctrl->kobj))
+	{
+		kobj_remove_self(ctrl->kobj);
+		ctrl->kobj = NULL;
+	}
 	return 0;
 
 fail:
@@ -97,6 +116,8 @@ static int fatfs_unmount(struct vfs_mount_t * m)
 	if(!ctrl)
 		return -1;
 
+	if(ctrl->kobj)
+		kobj_remove_self(ctrl->kobj);
 	rc = fatfs_control_exit(ctrl);
 	free(ctrl);
 	return rc;
@@ -291,8 +312,7 @@ static int fatfs_lookup(struct vfs_node_t * dn, const char * name, struct vfs_no
 		node->first_cluster = 0;
 	}
 	node->first_cluster |= le16_to_cpu(dent.first_cluster_lo);
-	node->cur_cluster = node->first_cluster;
-	node->cur_pos = 0;
+	fatfs_node_reset_extents(node);
 
 	n->v_mode = 0;
 
@@ -334,7 +354,7 @@ static int fatfs_create(struct vfs_node_t * dn, const char * name, u32_t mode)
 	struct fatfs_node_t *dnode = dn->v_data;
 
 	rc = fatfs_node_find_dirent(dnode, name, &dent, &off, &len);
-	if(rc != -1)
+	if((rc != -1) && (rc != ENOENT))
 	{
 		if(!rc)
 			return -1;
@@ -421,7 +441,7 @@ static int fatfs_rename(struct vfs_node_t * sv, const char *sname, struct vfs_no
 	struct fatfs_node_t *dnode = dn->v_data;
 
 	rc = fatfs_node_find_dirent(dnode, dname, &dent, &off, &len);
-	if(rc != -1)
+	if((rc != -1) && (rc != ENOENT))
 	{
 		if(!rc)
 			return -1;
@@ -454,7 +474,7 @@ static int fatfs_mkdir(struct vfs_node_t * dn, const char *name, u32_t mode)
 	struct fatfs_node_t *dnode = dn->v_data;
 
 	rc = fatfs_node_find_dirent(dnode, name, &dent, &off, &len);
-	if(rc != -1)
+	if((rc != -1) && (rc != ENOENT))
 	{
 		if(!rc)
 			return -1;
@@ -303,7 +303,7 @@ static int ram_lookup(struct vfs_node_t * dn, const char * name, struct vfs_node
 			return 0;
 		}
 	}
-	return -1;
+	return ENOENT;
 }
 
 static int ram_create(struct vfs_node_t * dn, const char * name, u32_t mode)
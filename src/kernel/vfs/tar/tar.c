@@ -240,6 +240,20 @@ static u64_t tar_read(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 	return sz;
 }
 
+static void * tar_mmap(struct vfs_node_t * n, s64_t off, u64_t len)
+{
+	u64_t toff;
+
+	if(n->v_type != VNT_REG)
+		return NULL;
+
+	if((off < 0) || (off + len > n->v_size))
+		return NULL;
+
+	toff = (u64_t)((unsigned long)(n->v_data));
+	return block_map(n->v_mount->m_dev, toff + off, len);
+}
+
 static u64_t tar_write(struct vfs_node_t * n, s64_t off, void * buf, u64_t len)
 {
 	return 0;
@@ -341,6 +355,9 @@ static int tar_lookup(struct vfs_node_t * dn, const char * name, struct vfs_node
 		if(rd != sizeof(struct tar_header_t))
 			return -1;
 
+		if(header.name[0] == '\0')
+			return ENOENT;
+
 		if(strncmp((const char *)(header.magic), "ustar", 5) != 0)
 			return -1;
 
@@ -473,6 +490,7 @@ static struct filesystem_t tar = {
 
 	.read		= tar_read,
 	.write		= tar_write,
+	.mmap		= tar_mmap,
 	.truncate	= tar_truncate,
 	.sync		= tar_sync,
 	.readdir	= tar_readdir,
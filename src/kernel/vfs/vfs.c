@@ -92,6 +92,19 @@ bool_t unregister_filesystem(struct filesystem_t * fs)
 	return TRUE;
 }
 
+struct vfs_dentry_t {
+	struct list_head d_link;
+	struct list_head d_lru;
+	struct vfs_node_t * d_parent;
+	struct vfs_node_t * d_node;
+	char * d_name;
+};
+
+struct vfs_mmap_copy_t {
+	struct list_head entry;
+	void * addr;
+};
+
 struct vfs_file_t {
 	struct mutex_t f_lock;
 	struct vfs_node_t * f_node;
@@ -100,11 +113,18 @@ struct vfs_file_t {
 };
 
 static struct list_head mnt_list;
-static struct mutex_t mnt_list_lock;
+static struct rwlock_t mnt_list_lock;
 static struct vfs_file_t fd_file[VFS_MAX_FD];
 static struct mutex_t fd_file_lock;
 struct list_head node_list[VFS_NODE_HASH_SIZE];
-static struct mutex_t node_list_lock[VFS_NODE_HASH_SIZE];
+static struct rwlock_t node_list_lock[VFS_NODE_HASH_SIZE];
+static struct kmem_cache_t * node_cache;
+static struct list_head dentry_list[VFS_DENTRY_HASH_SIZE];
+static struct list_head dentry_lru;
+static struct mutex_t dentry_lock;
+static int dentry_count;
+static struct list_head mmap_list;
+static struct mutex_t mmap_lock;
 
 static int count_match(const char * path, char * mount_root)
 {
@@ -139,7 +159,7 @@ static int vfs_findroot(const char * path, struct vfs_mount_t ** mp, char ** roo
 	if(!path || !mp || !root)
 		return -1;
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_read_lock(&mnt_list_lock);
 	list_for_each_entry(pos, &mnt_list, m_link)
 	{
 		len = count_match(path, pos->m_path);
@@ -149,7 +169,7 @@ static int vfs_findroot(const char * path, struct vfs_mount_t ** mp, char ** roo
 			m = pos;
 		}
 	}
-	mutex_unlock(&mnt_list_lock);
+	rwlock_read_unlock(&mnt_list_lock);
 
 	if(!m)
 		return -1;
@@ -222,16 +242,17 @@ static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * pat
 	u32_t hash = vfs_node_hash(m, path);
 	int err;
 
-	if(!(n = calloc(1, sizeof(struct vfs_node_t))))
+	if(!(n = kmem_cache_alloc(node_cache)))
 		return NULL;
+	memset(n, 0, sizeof(struct vfs_node_t));
 
 	init_list_head(&n->v_link);
-	mutex_init(&n->v_lock);
+	rwlock_init(&n->v_lock);
 	n->v_mount = m;
 	atomic_set(&n->v_refcnt, 1);
 	if(strlcpy(n->v_path, path, sizeof(n->v_path)) >= sizeof(n->v_path))
 	{
-		free(n);
+		kmem_cache_free(node_cache, n);
 		return NULL;
 	}
 
@@ -240,14 +261,14 @@ static struct vfs_node_t * vfs_node_get(struct vfs_mount_t * m, const char * pat
 	mutex_unlock(&m->m_lock);
 	if(err)
 	{
-		free(n);
+		kmem_cache_free(node_cache, n);
 		return NULL;
 	}
 
 	atomic_add(&m->m_refcnt, 1);
-	mutex_lock(&node_list_lock[hash]);
+	rwlock_write_lock(&node_list_lock[hash]);
 	list_add(&n->v_link, &node_list[hash]);
-	mutex_unlock(&node_list_lock[hash]);
+	rwlock_write_unlock(&node_list_lock[hash]);
 
 	return n;
 }
@@ -258,21 +279,20 @@ static struct vfs_node_t * vfs_node_lookup(struct vfs_mount_t * m, const char *
 	u32_t hash = vfs_node_hash(m, path);
 	int found = 0;
 
-	mutex_lock(&node_list_lock[hash]);
+	rwlock_read_lock(&node_list_lock[hash]);
 	list_for_each_entry(n, &node_list[hash], v_link)
 	{
 		if((n->v_mount == m) && (!strncmp(n->v_path, path, VFS_MAX_PATH)))
 		{
+			atomic_add(&n->v_refcnt, 1);
 			found = 1;
 			break;
 		}
 	}
-	mutex_unlock(&node_list_lock[hash]);
+	rwlock_read_unlock(&node_list_lock[hash]);
 
 	if(!found)
 		return NULL;
-	atomic_add(&n->v_refcnt, 1);
-
 	return n;
 }
 
@@ -289,16 +309,16 @@ static void vfs_node_put(struct vfs_node_t * n)
 		return;
 
 	hash = vfs_node_hash(n->v_mount, n->v_path);
-	mutex_lock(&node_list_lock[hash]);
+	rwlock_write_lock(&node_list_lock[hash]);
 	list_del(&n->v_link);
-	mutex_unlock(&node_list_lock[hash]);
+	rwlock_write_unlock(&node_list_lock[hash]);
 
 	mutex_lock(&n->v_mount->m_lock);
 	n->v_mount->m_fs->vput(n->v_mount, n);
 	mutex_unlock(&n->v_mount->m_lock);
 
 	atomic_sub(&n->v_mount->m_refcnt, 1);
-	free(n);
+	kmem_cache_free(node_cache, n);
 }
 
 static int vfs_node_stat(struct vfs_node_t * n, struct vfs_stat_t * st)
@@ -308,13 +328,13 @@ static int vfs_node_stat(struct vfs_node_t * n, struct vfs_stat_t * st)
 	memset(st, 0, sizeof(struct vfs_stat_t));
 
 	st->st_ino = (u64_t)((unsigned long)n);
-	mutex_lock(&n->v_lock);
+	rwlock_read_lock(&n->v_lock);
 	st->st_size = n->v_size;
 	mode = n->v_mode & (S_IRWXU | S_IRWXG | S_IRWXO);
 	st->st_ctime = n->v_ctime;
 	st->st_atime = n->v_atime;
 	st->st_mtime = n->v_mtime;
-	mutex_unlock(&n->v_lock);
+	rwlock_read_unlock(&n->v_lock);
 
 	switch(n->v_type)
 	{
@@ -356,9 +376,9 @@ static int vfs_node_access(struct vfs_node_t * n, u32_t mode)
 {
 	u32_t m;
 
-	mutex_lock(&n->v_lock);
+	rwlock_read_lock(&n->v_lock);
 	m = n->v_mode;
-	mutex_unlock(&n->v_lock);
+	rwlock_read_unlock(&n->v_lock);
 
 	if((mode & R_OK) && !(m & (S_IRUSR | S_IRGRP | S_IROTH)))
 		return -1;
@@ -420,6 +440,144 @@ static void vfs_node_release(struct vfs_node_t * n)
 	vfs_node_put(m->m_root);
 }
 
+static u32_t vfs_dentry_hash(struct vfs_node_t * dn, const char * name)
+{
+	u32_t val = 0;
+
+	while(*name)
+		val = ((val << 5) + val) + *name++;
+	return (val ^ (u32_t)((unsigned long)dn >> 4)) & (VFS_DENTRY_HASH_SIZE - 1);
+}
+
+static struct vfs_dentry_t * __vfs_dentry_find(struct vfs_node_t * dn, const char * name)
+{
+	struct vfs_dentry_t * d;
+
+	list_for_each_entry(d, &dentry_list[vfs_dentry_hash(dn, name)], d_link)
+	{
+		if((d->d_parent == dn) && !strcmp(d->d_name, name))
+			return d;
+	}
+	return NULL;
+}
+
+static void __vfs_dentry_del(struct vfs_dentry_t * d)
+{
+	list_del(&d->d_link);
+	list_del_init(&d->d_lru);
+	dentry_count--;
+}
+
+static void vfs_dentry_free(struct vfs_dentry_t * d)
+{
+	if(d->d_node)
+		vfs_node_put(d->d_node);
+	vfs_node_put(d->d_parent);
+	free(d);
+}
+
+/*
+ * Returns non-zero if the name is cached as a missing entry of the directory
+ */
+static int vfs_dentry_lookup(struct vfs_node_t * dn, const char * name)
+{
+	struct vfs_dentry_t * d;
+	int negative = 0;
+
+	mutex_lock(&dentry_lock);
+	d = __vfs_dentry_find(dn, name);
+	if(d)
+	{
+		list_move_tail(&d->d_lru, &dentry_lru);
+		negative = d->d_node ? 0 : 1;
+	}
+	mutex_unlock(&dentry_lock);
+
+	return negative;
+}
+
+/*
+ * Cache the result of a lookup, a null node records a negative entry
+ */
+static void vfs_dentry_add(struct vfs_node_t * dn, const char * name, struct vfs_node_t * n)
+{
+	struct vfs_dentry_t * d, * victim = NULL;
+	int len = strlen(name);
+
+	d = malloc(sizeof(struct vfs_dentry_t) + len + 1);
+	if(!d)
+		return;
+	d->d_parent = dn;
+	d->d_node = n;
+	d->d_name = (char *)(d + 1);
+	memcpy(d->d_name, name, len + 1);
+
+	mutex_lock(&dentry_lock);
+	if(__vfs_dentry_find(dn, name))
+	{
+		mutex_unlock(&dentry_lock);
+		free(d);
+		return;
+	}
+	vfs_node_ref(dn);
+	if(n)
+		vfs_node_ref(n);
+	list_add(&d->d_link, &dentry_list[vfs_dentry_hash(dn, name)]);
+	list_add_tail(&d->d_lru, &dentry_lru);
+	if(++dentry_count > VFS_DENTRY_MAX)
+	{
+		victim = list_first_entry(&dentry_lru, struct vfs_dentry_t, d_lru);
+		__vfs_dentry_del(victim);
+	}
+	mutex_unlock(&dentry_lock);
+
+	if(victim)
+		vfs_dentry_free(victim);
+}
+
+static void vfs_dentry_forget(struct vfs_node_t * dn, const char * name)
+{
+	struct vfs_dentry_t * d;
+
+	mutex_lock(&dentry_lock);
+	d = __vfs_dentry_find(dn, name);
+	if(d)
+		__vfs_dentry_del(d);
+	mutex_unlock(&dentry_lock);
+
+	if(d)
+		vfs_dentry_free(d);
+}
+
+/*
+ * Drop every entry of the mount at or below the path, or the whole mount if path is null
+ */
+static void vfs_dentry_purge(struct vfs_mount_t * m, const char * path)
+{
+	struct vfs_dentry_t * d, * t;
+	struct list_head victims;
+	const char * p;
+	int len = path ? strlen(path) : 0;
+
+	init_list_head(&victims);
+	mutex_lock(&dentry_lock);
+	list_for_each_entry_safe(d, t, &dentry_lru, d_lru)
+	{
+		if(d->d_parent->v_mount != m)
+			continue;
+		p = d->d_parent->v_path;
+		if(!path || (!strncmp(p, path, len) && ((p[len] == '\0') || (p[len] == '/'))) || (d->d_node && !strcmp(d->d_node->v_path, path)))
+		{
+			__vfs_dentry_del(d);
+			list_add_tail(&d->d_lru, &victims);
+		}
+	}
+	mutex_unlock(&dentry_lock);
+
+	list_for_each_entry_safe(d, t, &victims, d_lru)
+		vfs_dentry_free(d);
+}
+
 static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 {
 	struct vfs_mount_t * m;
@@ -457,6 +615,11 @@ static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 		}
 		node[i] = '\0';
 
+		if(vfs_dentry_lookup(dn, &node[j]))
+		{
+			vfs_node_release(dn);
+			return -1;
+		}
 		n = vfs_node_lookup(m, node);
 		if(n == NULL)
 		{
@@ -467,16 +630,20 @@ static int vfs_node_acquire(const char * path, struct vfs_node_t ** np)
 				return -1;
 			}
 
-			mutex_lock(&n->v_lock);
-			mutex_lock(&dn->v_lock);
+			rwlock_write_lock(&n->v_lock);
+			rwlock_read_lock(&dn->v_lock);
 			err = dn->v_mount->m_fs->lookup(dn, &node[j], n);
-			mutex_unlock(&dn->v_lock);
-			mutex_unlock(&n->v_lock);
+			rwlock_read_unlock(&dn->v_lock);
+			rwlock_write_unlock(&n->v_lock);
+			/* Only a name the filesystem reports absent is cached, never an i/o failure */
+			if(err == ENOENT)
+				vfs_dentry_add(dn, &node[j], NULL);
 			if(err || (*p == '/' && n->v_type != VNT_DIR))
 			{
 				vfs_node_release(n);
 				return err;
 			}
+			vfs_dentry_add(dn, &node[j], n);
 		}
 		dn = n;
 	}
@@ -508,6 +675,7 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 		vfs_force_unmount(tm);
 	}
 	list_del(&m->m_link);
+	vfs_dentry_purge(m, NULL);
 
 	mutex_lock(&fd_file_lock);
 	for(i = 0; i < VFS_MAX_FD; i++)
@@ -525,7 +693,7 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 
 	for(i = 0; i < VFS_NODE_HASH_SIZE; i++)
 	{
-		mutex_lock(&node_list_lock[i]);
+		rwlock_write_lock(&node_list_lock[i]);
 		while(1)
 		{
 			found = 0;
@@ -544,9 +712,9 @@ void vfs_force_unmount(struct vfs_mount_t * m)
 			mutex_lock(&n->v_mount->m_lock);
 			n->v_mount->m_fs->vput(n->v_mount, n);
 			mutex_unlock(&n->v_mount->m_lock);
-			free(n);
+			kmem_cache_free(node_cache, n);
 		}
-		mutex_unlock(&node_list_lock[i]);
+		rwlock_write_unlock(&node_list_lock[i]);
 	}
 
 	mutex_lock(&m->m_lock);
@@ -644,12 +812,12 @@ int vfs_mount(const char * dev, const char * dir, const char * fsname, u32_t fla
 	if(m->m_flags & MOUNT_RO)
 		m->m_root->v_mode &= ~(S_IWUSR|S_IWGRP|S_IWOTH);
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_write_lock(&mnt_list_lock);
 	list_for_each_entry(tm, &mnt_list, m_link)
 	{
 		if(!strcmp(tm->m_path, dir) || ((dev != NULL) && (tm->m_dev == bdev)))
 		{
-			mutex_unlock(&mnt_list_lock);
+			rwlock_write_unlock(&mnt_list_lock);
 			mutex_lock(&m->m_lock);
 			m->m_fs->unmount(m);
 			mutex_unlock(&m->m_lock);
@@ -661,7 +829,7 @@ int vfs_mount(const char * dev, const char * dir, const char * fsname, u32_t fla
 		}
 	}
 	list_add(&m->m_link, &mnt_list);
-	mutex_unlock(&mnt_list_lock);
+	rwlock_write_unlock(&mnt_list_lock);
 
 	return 0;
 }
@@ -672,7 +840,7 @@ int vfs_unmount(const char * path)
 	int found;
 	int err;
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_write_lock(&mnt_list_lock);
 	found = 0;
 	list_for_each_entry(m, &mnt_list, m_link)
 	{
@@ -684,16 +852,17 @@ int vfs_unmount(const char * path)
 	}
 	if(!found)
 	{
-		mutex_unlock(&mnt_list_lock);
+		rwlock_write_unlock(&mnt_list_lock);
 		return -1;
 	}
+	vfs_dentry_purge(m, NULL);
 	if(atomic_get(&m->m_refcnt) > 1)
 	{
-		mutex_unlock(&mnt_list_lock);
+		rwlock_write_unlock(&mnt_list_lock);
 		return -1;
 	}
 	list_del(&m->m_link);
-	mutex_unlock(&mnt_list_lock);
+	rwlock_write_unlock(&mnt_list_lock);
 
 	mutex_lock(&m->m_lock);
 	err = m->m_fs->msync(m);
@@ -703,8 +872,8 @@ int vfs_unmount(const char * path)
 	vfs_node_release(m->m_root);
 	if(m->m_covered)
 		vfs_node_release(m->m_covered);
-	if(m->m_dev)
-		block_sync(m->m_dev);
+	if(m->m_dev && (block_sync(m->m_dev) < 0) && !err)
+		err = -1;
 	free(m);
 
 	return err;
@@ -713,17 +882,21 @@ int vfs_unmount(const char * path)
 int vfs_sync(void)
 {
 	struct vfs_mount_t * m;
+	int err = 0;
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_read_lock(&mnt_list_lock);
 	list_for_each_entry(m, &mnt_list, m_link)
 	{
 		mutex_lock(&m->m_lock);
-		m->m_fs->msync(m);
+		if(m->m_fs->msync(m) < 0)
+			err = -1;
 		mutex_unlock(&m->m_lock);
+		if(m->m_dev && (block_sync(m->m_dev) < 0))
+			err = -1;
 	}
-	mutex_unlock(&mnt_list_lock);
+	rwlock_read_unlock(&mnt_list_lock);
 
-	return 0;
+	return err;
 }
 
 struct vfs_mount_t * vfs_mount_get(int index)
@@ -734,7 +907,7 @@ struct vfs_mount_t * vfs_mount_get(int index)
 	if(index < 0)
 		return NULL;
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_read_lock(&mnt_list_lock);
 	list_for_each_entry(m, &mnt_list, m_link)
 	{
 		if(!index)
@@ -744,7 +917,7 @@ struct vfs_mount_t * vfs_mount_get(int index)
 		}
 		index--;
 	}
-	mutex_unlock(&mnt_list_lock);
+	rwlock_read_unlock(&mnt_list_lock);
 
 	if(!found)
 		return NULL;
@@ -756,12 +929,12 @@ int vfs_mount_count(void)
 	struct vfs_mount_t * m;
 	int ret = 0;
 
-	mutex_lock(&mnt_list_lock);
+	rwlock_read_lock(&mnt_list_lock);
 	list_for_each_entry(m, &mnt_list, m_link)
 	{
 		ret++;
 	}
-	mutex_unlock(&mnt_list_lock);
+	rwlock_read_unlock(&mnt_list_lock);
 
 	return ret;
 }
@@ -833,11 +1006,12 @@ int vfs_open(const char * path, u32_t flags, u32_t mode)
 			}
 			mode &= ~S_IFMT;
 			mode |= S_IFREG;
-			mutex_lock(&dn->v_lock);
+			rwlock_write_lock(&dn->v_lock);
 			err = dn->v_mount->m_fs->create(dn, filename, mode);
 			if(!err)
 				err = dn->v_mount->m_fs->sync(dn);
-			mutex_unlock(&dn->v_lock);
+			rwlock_write_unlock(&dn->v_lock);
+			vfs_dentry_forget(dn, filename);
 			vfs_node_release(dn);
 			if(err)
 				return err;
@@ -883,9 +1057,9 @@ int vfs_open(const char * path, u32_t flags, u32_t mode)
 			vfs_node_release(n);
 			return -1;
 		}
-		mutex_lock(&n->v_lock);
+		rwlock_write_lock(&n->v_lock);
 		err = n->v_mount->m_fs->truncate(n, 0);
-		mutex_unlock(&n->v_lock);
+		rwlock_write_unlock(&n->v_lock);
 		if(err)
 		{
 			vfs_node_release(n);
@@ -928,9 +1102,9 @@ int vfs_close(int fd)
 		return -1;
 	}
 
-	mutex_lock(&n->v_lock);
+	rwlock_write_lock(&n->v_lock);
 	err = n->v_mount->m_fs->sync(n);
-	mutex_unlock(&n->v_lock);
+	rwlock_write_unlock(&n->v_lock);
 	if(err)
 	{
 		mutex_unlock(&f->f_lock);
@@ -975,9 +1149,9 @@ u64_t vfs_read(int fd, void * buf, u64_t len)
 		return 0;
 	}
 
-	mutex_lock(&n->v_lock);
+	rwlock_read_lock(&n->v_lock);
 	ret = n->v_mount->m_fs->read(n, f->f_offset, buf, len);
-	mutex_unlock(&n->v_lock);
+	rwlock_read_unlock(&n->v_lock);
 
 	f->f_offset += ret;
 	mutex_unlock(&f->f_lock);
@@ -1017,9 +1191,9 @@ u64_t vfs_write(int fd, void * buf, u64_t len)
 		return 0;
 	}
 
-	mutex_lock(&n->v_lock);
+	rwlock_write_lock(&n->v_lock);
 	ret = n->v_mount->m_fs->write(n, f->f_offset, buf, len);
-	mutex_unlock(&n->v_lock);
+	rwlock_write_unlock(&n->v_lock);
 
 	f->f_offset += ret;
 	mutex_unlock(&f->f_lock);
@@ -1027,6 +1201,240 @@ u64_t vfs_write(int fd, void * buf, u64_t len)
 	return ret;
 }
 
+static struct vfs_node_t * vfs_fd_node_get(int fd, u32_t mode)
+{
+	struct vfs_node_t * n;
+	struct vfs_file_t * f;
+
+	f = vfs_fd_to_file(fd);
+	if(!f)
+		return NULL;
+
+	mutex_lock(&f->f_lock);
+	n = f->f_node;
+	if(n && (n->v_type == VNT_REG) && (f->f_flags & mode))
+		vfs_node_ref(n);
+	else
+		n = NULL;
+	mutex_unlock(&f->f_lock);
+
+	return n;
+}
+
+static u64_t vfs_node_readv(struct vfs_node_t * n, s64_t off, struct vfs_iovec_t * iov, int iovcnt)
+{
+	u64_t ret = 0, r;
+	int i;
+
+	if(n->v_mount->m_fs->readv)
+		return n->v_mount->m_fs->readv(n, off, iov, iovcnt);
+
+	for(i = 0; i < iovcnt; i++)
+	{
+		if(!iov[i].iov_base || !iov[i].iov_len)
+			continue;
+		r = n->v_mount->m_fs->read(n, off + ret, iov[i].iov_base, iov[i].iov_len);
+		ret += r;
+		if(r != iov[i].iov_len)
+			break;
+	}
+	return ret;
+}
+
+static u64_t vfs_node_writev(struct vfs_node_t * n, s64_t off, struct vfs_iovec_t * iov, int iovcnt)
+{
+	u64_t ret = 0, w;
+	int i;
+
+	if(n->v_mount->m_fs->writev)
+		return n->v_mount->m_fs->writev(n, off, iov, iovcnt);
+
+	for(i = 0; i < iovcnt; i++)
+	{
+		if(!iov[i].iov_base || !iov[i].iov_len)
+			continue;
+		w = n->v_mount->m_fs->write(n, off + ret, iov[i].iov_base, iov[i].iov_len);
+		ret += w;
+		if(w != iov[i].iov_len)
+			break;
+	}
+	return ret;
+}
+
+u64_t vfs_pread(int fd, void * buf, u64_t len, s64_t off)
+{
+	struct vfs_node_t * n;
+	u64_t ret;
+
+	if(!buf || !len || (off < 0))
+		return 0;
+
+	n = vfs_fd_node_get(fd, O_RDONLY);
+	if(!n)
+		return 0;
+
+	rwlock_read_lock(&n->v_lock);
+	ret = n->v_mount->m_fs->read(n, off, buf, len);
+	rwlock_read_unlock(&n->v_lock);
+	vfs_node_put(n);
+
+	return ret;
+}
+
+u64_t vfs_pwrite(int fd, void * buf, u64_t len, s64_t off)
+{
+	struct vfs_node_t * n;
+	u64_t ret;
+
+	if(!buf || !len || (off < 0))
+		return 0;
+
+	n = vfs_fd_node_get(fd, O_WRONLY);
+	if(!n)
+		return 0;
+
+	rwlock_write_lock(&n->v_lock);
+	ret = n->v_mount->m_fs->write(n, off, buf, len);
+	rwlock_write_unlock(&n->v_lock);
+	vfs_node_put(n);
+
+	return ret;
+}
+
+u64_t vfs_readv(int fd, struct vfs_iovec_t * iov, int iovcnt)
+{
+	struct vfs_node_t * n;
+	struct vfs_file_t * f;
+	u64_t ret;
+
+	if(!iov || (iovcnt <= 0))
+		return 0;
+
+	f = vfs_fd_to_file(fd);
+	if(!f)
+		return 0;
+
+	mutex_lock(&f->f_lock);
+	n = f->f_node;
+	if(!n || (n->v_type != VNT_REG) || !(f->f_flags & O_RDONLY))
+	{
+		mutex_unlock(&f->f_lock);
+		return 0;
+	}
+
+	rwlock_read_lock(&n->v_lock);
+	ret = vfs_node_readv(n, f->f_offset, iov, iovcnt);
+	rwlock_read_unlock(&n->v_lock);
+
+	f->f_offset += ret;
+	mutex_unlock(&f->f_lock);
+
+	return ret;
+}
+
+u64_t vfs_writev(int fd, struct vfs_iovec_t * iov, int iovcnt)
+{
+	struct vfs_node_t * n;
+	struct vfs_file_t * f;
+	u64_t ret;
+
+	if(!iov || (iovcnt <= 0))
+		return 0;
+
+	f = vfs_fd_to_file(fd);
+	if(!f)
+		return 0;
+
+	mutex_lock(&f->f_lock);
+	n = f->f_node;
+	if(!n || (n->v_type != VNT_REG) || !(f->f_flags & O_WRONLY))
+	{
+		mutex_unlock(&f->f_lock);
+		return 0;
+	}
+
+	rwlock_write_lock(&n->v_lock);
+	ret = vfs_node_writev(n, f->f_offset, iov, iovcnt);
+	rwlock_write_unlock(&n->v_lock);
+
+	f->f_offset += ret;
+	mutex_unlock(&f->f_lock);
+
+	return ret;
+}
+
+/*
+ * Read only mapping of a regular file. Memory backed filesystems hand out a
+ * direct pointer into the device, anything else gets a private cached copy.
+ */
+void * vfs_mmap(int fd, s64_t off, u64_t len)
+{
+	struct vfs_node_t * n;
+	struct vfs_mmap_copy_t * c;
+	void * addr = NULL;
+
+	if((off < 0) || (len == 0))
+		return NULL;
+
+	n = vfs_fd_node_get(fd, O_RDONLY);
+	if(!n)
+		return NULL;
+
+	rwlock_read_lock(&n->v_lock);
+	if(off + len <= n->v_size)
+	{
+		if(n->v_mount->m_fs->mmap)
+			addr = n->v_mount->m_fs->mmap(n, off, len);
+		if(!addr)
+		{
+			c = malloc(sizeof(struct vfs_mmap_copy_t));
+			if(c)
+			{
+				c->addr = malloc(len);
+				if(c->addr && (n->v_mount->m_fs->read(n, off, c->addr, len) == len))
+				{
+					mutex_lock(&mmap_lock);
+					list_add(&c->entry, &mmap_list);
+					mutex_unlock(&mmap_lock);
+					addr = c->addr;
+				}
+				else
+				{
+					if(c->addr)
+						free(c->addr);
+					free(c);
+				}
+			}
+		}
+	}
+	rwlock_read_unlock(&n->v_lock);
+	vfs_node_put(n);
+
+	return addr;
+}
+
+void vfs_munmap(void * addr)
+{
+	struct vfs_mmap_copy_t * pos, * n;
+
+	if(!addr)
+		return;
+
+	mutex_lock(&mmap_lock);
+	list_for_each_entry_safe(pos, n, &mmap_list, entry)
+	{
+		if(pos->addr == addr)
+		{
+			list_del(&pos->entry);
+			mutex_unlock(&mmap_lock);
+			free(pos->addr);
+			free(pos);
+			return;
+		}
+	}
+	mutex_unlock(&mmap_lock);
+}
+
 s64_t vfs_lseek(int fd, s64_t off, int whence)
 {
 	struct vfs_node_t * n;
@@ -1045,7 +1453,7 @@ s64_t vfs_lseek(int fd, s64_t off, int whence)
 		return 0;
 	}
 
-	mutex_lock(&n->v_lock);
+	rwlock_read_lock(&n->v_lock);
 	switch(whence)
 	{
 	case VFS_SEEK_SET:
@@ -1074,7 +1482,7 @@ s64_t vfs_lseek(int fd, s64_t off, int whence)
 		break;
 
 	default:
-		mutex_unlock(&n->v_lock);
+		rwlock_read_unlock(&n->v_lock);
 		ret = f->f_offset;
 		mutex_unlock(&f->f_lock);
 		return ret;
@@ -1082,7 +1490,7 @@ s64_t vfs_lseek(int fd, s64_t off, int whence)
 
 	if(off <= n->v_size)
 		f->f_offset = off;
-	mutex_unlock(&n->v_lock);
+	rwlock_read_unlock(&n->v_lock);
 
 	ret = f->f_offset;
 	mutex_unlock(&f->f_lock);
@@ -1112,9 +1520,21 @@ int vfs_fsync(int fd)
 		mutex_unlock(&f->f_lock);
 		return -1;
 	}
-	mutex_lock(&n->v_lock);
+	rwlock_write_lock(&n->v_lock);
 	err = n->v_mount->m_fs->sync(n);
-	mutex_unlock(&n->v_lock);
+	rwlock_write_unlock(&n->v_lock);
+	if(!err)
+	{
+		/*
+		 * The node data only reached the block cache, push the metadata
+		 * and every dirty sector of the device before reporting success
+		 */
+		mutex_lock(&n->v_mount->m_lock);
+		err = n->v_mount->m_fs->msync(n->v_mount);
+		mutex_unlock(&n->v_mount->m_lock);
+		if(!err && n->v_mount->m_dev)
+			err = block_sync(n->v_mount->m_dev);
+	}
 	mutex_unlock(&f->f_lock);
 
 	return err;
@@ -1138,9 +1558,9 @@ int vfs_fchmod(int fd, u32_t mode)
 		return -1;
 	}
 	mode &= (S_IRWXU | S_IRWXG | S_IRWXO);
-	mutex_lock(&n->v_lock);
+	rwlock_write_lock(&n->v_lock);
 	err = n->v_mount->m_fs->chmod(n, mode);
-	mutex_unlock(&n->v_lock);
+	rwlock_write_unlock(&n->v_lock);
 	mutex_unlock(&f->f_lock);
 
 	return err;
@@ -1259,9 +1679,9 @@ int vfs_readdir(int fd, struct vfs_dirent_t * dir)
 		mutex_unlock(&f->f_lock);
 		return -1;
 	}
-	mutex_lock(&n->v_lock);
+	rwlock_read_lock(&n->v_lock);
 	err = n->v_mount->m_fs->readdir(n, f->f_offset, dir);
-	mutex_unlock(&n->v_lock);
+	rwlock_read_unlock(&n->v_lock);
 	if(!err)
 		f->f_offset += dir->d_reclen;
 	mutex_unlock(&f->f_lock);
@@ -1323,7 +1743,7 @@ int vfs_mkdir(const char * path, u32_t mode)
 	mode &= ~S_IFMT;
 	mode |= S_IFDIR;
 
-	mutex_lock(&dn->v_lock);
+	rwlock_write_lock(&dn->v_lock);
 
 	err = dn->v_mount->m_fs->mkdir(dn, name, mode);
 	if(err)
@@ -1331,7 +1751,8 @@ int vfs_mkdir(const char * path, u32_t mode)
 	err = dn->v_mount->m_fs->sync(dn);
 
 fail:
-	mutex_unlock(&dn->v_lock);
+	rwlock_write_unlock(&dn->v_lock);
+	vfs_dentry_forget(dn, name);
 	vfs_node_release(dn);
 
 	return err;
@@ -1379,6 +1800,7 @@ int vfs_rmdir(const char * path)
 	if((err = vfs_node_acquire(path, &n)))
 		return err;
 
+	vfs_dentry_purge(n->v_mount, n->v_path);
 	if((n->v_flags == VNF_ROOT) || (atomic_get(&n->v_refcnt) >= 2))
 	{
 		vfs_node_release(n);
@@ -1397,8 +1819,8 @@ int vfs_rmdir(const char * path)
 		return err;
 	}
 
-	mutex_lock(&dn->v_lock);
-	mutex_lock(&n->v_lock);
+	rwlock_write_lock(&dn->v_lock);
+	rwlock_write_lock(&n->v_lock);
 
 	err = dn->v_mount->m_fs->rmdir(dn, n, name);
 	if(err)
@@ -1410,8 +1832,8 @@ int vfs_rmdir(const char * path)
 	err = dn->v_mount->m_fs->sync(dn);
 
 fail:
-	mutex_unlock(&n->v_lock);
-	mutex_unlock(&dn->v_lock);
+	rwlock_write_unlock(&n->v_lock);
+	rwlock_write_unlock(&dn->v_lock);
 	vfs_node_release(n);
 	vfs_node_release(dn);
 
@@ -1440,6 +1862,7 @@ int vfs_rename(const char * src, const char * dst)
 	if((err = vfs_node_access(n1, W_OK)))
 		goto fail1;
 
+	vfs_dentry_purge(n1->v_mount, n1->v_path);
 	if(atomic_get(&n1->v_refcnt) >= 2)
 	{
 		err = -1;
@@ -1466,13 +1889,14 @@ int vfs_rename(const char * src, const char * dst)
 		goto fail3;
 	}
 
-	mutex_lock(&n1->v_lock);
-	mutex_lock(&sn->v_lock);
+	rwlock_write_lock(&n1->v_lock);
+	rwlock_write_lock(&sn->v_lock);
 
 	if(dn != sn)
-		mutex_lock(&dn->v_lock);
+		rwlock_write_lock(&dn->v_lock);
 
 	err = sn->v_mount->m_fs->rename(sn, sname, n1, dn, dname);
+	vfs_dentry_forget(dn, dname);
 	if(err)
 		goto fail4;
 
@@ -1485,9 +1909,9 @@ int vfs_rename(const char * src, const char * dst)
 
 fail4:
 	if(dn != sn)
-		mutex_unlock(&dn->v_lock);
-	mutex_unlock(&sn->v_lock);
-	mutex_unlock(&n1->v_lock);
+		rwlock_write_unlock(&dn->v_lock);
+	rwlock_write_unlock(&sn->v_lock);
+	rwlock_write_unlock(&n1->v_lock);
 fail3:
 	vfs_node_release(dn);
 fail2:
@@ -1516,6 +1940,7 @@ int vfs_unlink(const char * path)
 		return -1;
 	}
 
+	vfs_dentry_purge(n->v_mount, n->v_path);
 	if((n->v_flags == VNF_ROOT) || (atomic_get(&n->v_refcnt) >= 2))
 	{
 		vfs_node_release(n);
@@ -1534,7 +1959,7 @@ int vfs_unlink(const char * path)
 		return err;
 	}
 
-	mutex_lock(&n->v_lock);
+	rwlock_write_lock(&n->v_lock);
 	err = n->v_mount->m_fs->truncate(n, 0);
 	if(err)
 		goto fail1;
@@ -1543,16 +1968,16 @@ int vfs_unlink(const char * path)
 	if(err)
 		goto fail1;
 
-	mutex_lock(&dn->v_lock);
+	rwlock_write_lock(&dn->v_lock);
 	err = dn->v_mount->m_fs->remove(dn, n, name);
 	if(err)
 		goto fail2;
 	err = dn->v_mount->m_fs->sync(dn);
 
 fail2:
-	mutex_unlock(&dn->v_lock);
+	rwlock_write_unlock(&dn->v_lock);
 fail1:
-	mutex_unlock(&n->v_lock);
+	rwlock_write_unlock(&n->v_lock);
 	vfs_node_release(dn);
 	vfs_node_release(n);
 
@@ -1589,14 +2014,14 @@ int vfs_chmod(const char * path, u32_t mode)
 
 	mode &= (S_IRWXU | S_IRWXG | S_IRWXO);
 
-	mutex_lock(&n->v_lock);
+	rwlock_write_lock(&n->v_lock);
 	err = n->v_mount->m_fs->chmod(n, mode);
 	if(err)
 		goto fail;
 	err = n->v_mount->m_fs->sync(n);
 
 fail:
-	mutex_unlock(&n->v_lock);
+	rwlock_write_unlock(&n->v_lock);
 	vfs_node_release(n);
 
 	return err;
@@ -1623,7 +2048,7 @@ void do_init_vfs(void)
 	int i;
 
 	init_list_head(&mnt_list);
-	mutex_init(&mnt_list_lock);
+	rwlock_init(&mnt_list_lock);
 
 	for(i = 0; i < VFS_MAX_FD; i++)
 	{
@@ -1637,6 +2062,16 @@ void do_init_vfs(void)
 	for(i = 0; i < VFS_NODE_HASH_SIZE; i++)
 	{
 		init_list_head(&node_list[i]);
-		mutex_init(&node_list_lock[i]);
+		rwlock_init(&node_list_lock[i]);
 	}
+	node_cache = kmem_cache_create("vfs_node", sizeof(struct vfs_node_t), 0);
+
+	for(i = 0; i < VFS_DENTRY_HASH_SIZE; i++)
+		init_list_head(&dentry_list[i]);
+	init_list_head(&dentry_lru);
+	mutex_init(&dentry_lock);
+	dentry_count = 0;
+
+	init_list_head(&mmap_list);
+	mutex_init(&mmap_lock);
 }
@@ -40,10 +40,12 @@ void vision_erode(struct vision_t * v, int times)
 		unsigned char * lt, * rt, * lb, * rb;
 		unsigned char * p, * q;
 		unsigned char gray;
+		struct arena_mark_t mark;
 		void * datas;
 		int m, n;
 
-		datas = malloc(ndata);
+		mark = arena_mark(v->scratch);
+		datas = vision_scratch(v, ndata);
 		if(datas)
 		{
 			while(times-- > 0)
@@ -89,7 +91,7 @@ void vision_erode(struct vision_t * v, int times)
 					}
 				}
 			}
-			free(datas);
+			arena_release(v->scratch, mark);
 		}
 	}
 }
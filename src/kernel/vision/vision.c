@@ -58,6 +58,7 @@ struct vision_t * vision_alloc(enum vision_type_t type, int width, int height)
 	v->npixel = npixel;
 	v->datas = datas;
 	v->ndata = ndata;
+	v->scratch = NULL;
 	return v;
 }
 
@@ -67,6 +68,8 @@ void vision_free(struct vision_t * v)
 	{
 		if(v->datas)
 			free(v->datas);
+		if(v->scratch)
+			arena_free(v->scratch);
 		free(v);
 	}
 }
@@ -341,6 +344,17 @@ void vision_clear(struct vision_t * v)
 		memset(v->datas, 0, v->npixel * vision_type_get_bytes(v->type) * vision_type_get_channels(v->type));
 }
 
+void * vision_scratch(struct vision_t * v, size_t size)
+{
+	if(!v->scratch)
+	{
+		v->scratch = arena_alloc(v->ndata);
+		if(!v->scratch)
+			return NULL;
+	}
+	return arena_malloc(v->scratch, size);
+}
+
 void vision_apply_surface(struct vision_t * v, struct surface_t * s)
 {
 	if(v && s)
@@ -408,6 +408,17 @@ static s64_t tar_length(void * f)
 	return fh->size;
 }
 
+static void * tar_map(void * f)
+{
+	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
+	return vfs_mmap(fh->fd, fh->start, fh->size);
+}
+
+static void tar_unmap(void * f, void * addr)
+{
+	vfs_munmap(addr);
+}
+
 static void tar_close(void * f)
 {
 	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
@@ -429,6 +440,8 @@ static struct xfs_archiver_t archiver_tar = {
 	.seek		= tar_seek,
 	.tell		= tar_tell,
 	.length		= tar_length,
+	.map		= tar_map,
+	.unmap		= tar_unmap,
 	.close		= tar_close,
 };
 
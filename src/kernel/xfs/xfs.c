@@ -243,6 +243,8 @@ struct xfs_file_t * xfs_open_read(struct xfs_context_t * ctx, const char * name)
 			file->ctx = ctx;
 			file->path = pos;
 			file->fhandle = f;
+			file->mapping = NULL;
+			file->mcopy = 0;
 			break;
 		}
 	}
@@ -271,6 +273,8 @@ struct xfs_file_t * xfs_open_write(struct xfs_context_t * ctx, const char * name
 				file->ctx = ctx;
 				file->path = pos;
 				file->fhandle = f;
+				file->mapping = NULL;
+				file->mcopy = 0;
 				break;
 			}
 		}
@@ -300,6 +304,8 @@ struct xfs_file_t * xfs_open_append(struct xfs_context_t * ctx, const char * nam
 				file->ctx = ctx;
 				file->path = pos;
 				file->fhandle = f;
+				file->mapping = NULL;
+				file->mcopy = 0;
 				break;
 			}
 		}
@@ -343,10 +349,61 @@ s64_t xfs_length(struct xfs_file_t * file)
 	return 0;
 }
 
+/*
+ * Read only view of the whole file, valid until xfs_unmap or xfs_close
+ */
+void * xfs_map(struct xfs_file_t * file)
+{
+	s64_t len, pos;
+
+	if(!file)
+		return NULL;
+	if(file->mapping)
+		return file->mapping;
+
+	if(file->path->archiver->map)
+		file->mapping = file->path->archiver->map(file->fhandle);
+	if(!file->mapping)
+	{
+		len = file->path->archiver->length(file->fhandle);
+		if(len <= 0)
+			return NULL;
+		file->mapping = malloc(len);
+		if(!file->mapping)
+			return NULL;
+		pos = file->path->archiver->tell(file->fhandle);
+		file->path->archiver->seek(file->fhandle, 0);
+		if(file->path->archiver->read(file->fhandle, file->mapping, len) != len)
+		{
+			file->path->archiver->seek(file->fhandle, pos);
+			free(file->mapping);
+			file->mapping = NULL;
+			return NULL;
+		}
+		file->path->archiver->seek(file->fhandle, pos);
+		file->mcopy = 1;
+	}
+	return file->mapping;
+}
+
+void xfs_unmap(struct xfs_file_t * file)
+{
+	if(file && file->mapping)
+	{
+		if(file->mcopy)
+			free(file->mapping);
+		else if(file->path->archiver->unmap)
+			file->path->archiver->unmap(file->fhandle, file->mapping);
+		file->mapping = NULL;
+		file->mcopy = 0;
+	}
+}
+
 void xfs_close(struct xfs_file_t * file)
 {
 	if(file)
 	{
+		xfs_unmap(file);
 		file->path->archiver->close(file->fhandle);
 		free(file);
 	}
@@ -7,7 +7,11 @@
 #include <spinlock.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <malloc.h>
+#include <list.h>
+#include <smp.h>
+#include <irqflags.h>
 #include <xboot/kobj.h>
 #include <xboot/module.h>
 
@@ -765,6 +769,38 @@ static inline void tlsf_info(void * tlsf, size_t * mused, size_t * mfree)
 	}
 }
 
+/*
+ * Walk the segregated free lists, collecting the number and bytes of free blocks per
+ * first level class together with the largest free block.
+ */
+static inline void tlsf_free_info(void * tlsf, size_t * count, size_t * bytes, size_t * largest)
+{
+	control_t * control = tlsf_cast(control_t *, tlsf);
+	block_header_t * block;
+	size_t size;
+	int fl, sl;
+
+	*largest = 0;
+	for(fl = 0; fl < FL_INDEX_COUNT; fl++)
+	{
+		count[fl] = 0;
+		bytes[fl] = 0;
+		if(!(control->fl_bitmap & (1U << fl)))
+			continue;
+		for(sl = 0; sl < SL_INDEX_COUNT; sl++)
+		{
+			for(block = control->blocks[fl][sl]; block != &control->block_null; block = block->next_free)
+			{
+				size = block_get_size(block);
+				count[fl]++;
+				bytes[fl] += size;
+				if(size > *largest)
+					*largest = size;
+			}
+		}
+	}
+}
+
 void * mm_create(void * mem, size_t bytes)
 {
 	return tlsf_create_with_pool(mem, bytes);
@@ -819,12 +855,465 @@ void mm_info(void * mm, size_t * mused, size_t * mfree)
 static void * __heap_pool = NULL;
 static spinlock_t __heap_lock = SPIN_LOCK_INIT();
 
-static void * __malloc(size_t size)
+/*
+ * Small objects are served by slab caches in front of the tlsf heap. Every cache keeps
+ * a per cpu magazine of free objects, so the common malloc and free touch neither the
+ * heap nor any lock, only refilling or draining half a magazine takes the cache lock
+ * and only growing or shrinking the cache takes the heap lock. Slab pages are aligned
+ * to their size and marked in a bitmap over the heap, which is how free tells a slab
+ * object from a tlsf block.
+ */
+#define KMEM_SIZE_MIN_SHIFT		(4)
+#define KMEM_SIZE_CLASSES		(6)
+#define KMEM_SIZE_MAX			(1 << (KMEM_SIZE_MIN_SHIFT + KMEM_SIZE_CLASSES - 1))
+
+struct kmem_magazine_t {
+	int count;
+	void * objs[CONFIG_SLAB_MAGAZINE_SIZE];
+};
+
+struct kmem_cache_t {
+	struct list_head list;
+	char name[32];
+	size_t size;
+	size_t offset;
+	unsigned int nobjs;
+	unsigned int nslabs;
+	unsigned int nempty;
+	unsigned int active;
+	struct list_head partial;
+	struct list_head full;
+	struct list_head empty;
+	spinlock_t lock;
+	struct kmem_magazine_t mag[CONFIG_MAX_SMP_CPUS];
+};
+
+struct kmem_slab_t {
+	struct list_head list;
+	struct kmem_cache_t * cache;
+	void * free;
+	unsigned int inuse;
+};
+
+static struct list_head __kmem_cache_list = {
+	.next = &__kmem_cache_list,
+	.prev = &__kmem_cache_list,
+};
+static spinlock_t __kmem_cache_lock = SPIN_LOCK_INIT();
+static struct kmem_cache_t * __kmem_size_cache[KMEM_SIZE_CLASSES];
+static unsigned long __slab_base = 0;
+static unsigned long __slab_npages = 0;
+static u32_t * __slab_map = NULL;
+
+static inline int kmem_size_index(size_t size)
+{
+	if(size <= (1 << KMEM_SIZE_MIN_SHIFT))
+		return 0;
+	return tlsf_fls(size - 1) + 1 - KMEM_SIZE_MIN_SHIFT;
+}
+
+static inline struct kmem_slab_t * kmem_slab_of(const void * ptr)
+{
+	unsigned long addr = (unsigned long)ptr;
+	unsigned long page;
+
+	if(!__slab_map || (addr < __slab_base))
+		return NULL;
+	page = (addr - __slab_base) / CONFIG_SLAB_SIZE;
+	if((page >= __slab_npages) || !(__slab_map[page >> 5] & (1U << (page & 0x1f))))
+		return NULL;
+	return (struct kmem_slab_t *)(__slab_base + page * CONFIG_SLAB_SIZE);
+}
+
+static struct kmem_slab_t * kmem_slab_alloc(struct kmem_cache_t * c)
+{
+	struct kmem_slab_t * s;
+	unsigned long page;
+	char * obj;
+	unsigned int i;
+
+	spin_lock(&__heap_lock);
+	s = tlsf_memalign(__heap_pool, CONFIG_SLAB_SIZE, CONFIG_SLAB_SIZE);
+	if(s)
+	{
+		page = ((unsigned long)s - __slab_base) / CONFIG_SLAB_SIZE;
+		if(((unsigned long)s >= __slab_base) && (page < __slab_npages))
+		{
+			__slab_map[page >> 5] |= (1U << (page & 0x1f));
+		}
+		else
+		{
+			tlsf_free(__heap_pool, s);
+			s = NULL;
+		}
+	}
+	spin_unlock(&__heap_lock);
+	if(!s)
+		return NULL;
+
+	s->cache = c;
+	s->free = NULL;
+	s->inuse = 0;
+	obj = (char *)s + c->offset + (c->nobjs - 1) * c->size;
+	for(i = 0; i < c->nobjs; i++, obj -= c->size)
+	{
+		*(void **)obj = s->free;
+		s->free = obj;
+	}
+	c->nslabs++;
+	return s;
+}
+
+static void kmem_slab_free(struct kmem_cache_t * c, struct kmem_slab_t * s)
+{
+	unsigned long page = ((unsigned long)s - __slab_base) / CONFIG_SLAB_SIZE;
+
+	c->nslabs--;
+	spin_lock(&__heap_lock);
+	__slab_map[page >> 5] &= ~(1U << (page & 0x1f));
+	tlsf_free(__heap_pool, s);
+	spin_unlock(&__heap_lock);
+}
+
+static void kmem_cache_refill(struct kmem_cache_t * c, struct kmem_magazine_t * m)
+{
+	struct kmem_slab_t * s;
+	int n = tlsf_max(CONFIG_SLAB_MAGAZINE_SIZE / 2, 1);
+
+	spin_lock(&c->lock);
+	while(m->count < n)
+	{
+		if(!list_empty(&c->partial))
+		{
+			s = list_first_entry(&c->partial, struct kmem_slab_t, list);
+		}
+		else if(!list_empty(&c->empty))
+		{
+			s = list_first_entry(&c->empty, struct kmem_slab_t, list);
+			list_move(&s->list, &c->partial);
+			c->nempty--;
+		}
+		else
+		{
+			if(!(s = kmem_slab_alloc(c)))
+				break;
+			list_add(&s->list, &c->partial);
+		}
+		while((m->count < n) && s->free)
+		{
+			m->objs[m->count++] = s->free;
+			s->free = *(void **)s->free;
+			s->inuse++;
+			c->active++;
+		}
+		if(!s->free)
+			list_move(&s->list, &c->full);
+	}
+	spin_unlock(&c->lock);
+}
+
+/*
+ * Return objects from the magazine to their slabs, a cache keeps at most one empty
+ * slab around and hands any further ones back to the heap.
+ */
+static void kmem_cache_drain(struct kmem_cache_t * c, struct kmem_magazine_t * m, int n)
+{
+	struct kmem_slab_t * s;
+	void * obj;
+
+	spin_lock(&c->lock);
+	while((n-- > 0) && (m->count > 0))
+	{
+		obj = m->objs[--m->count];
+		s = kmem_slab_of(obj);
+		if(!s->free)
+			list_move(&s->list, &c->partial);
+		*(void **)obj = s->free;
+		s->free = obj;
+		s->inuse--;
+		c->active--;
+		if(s->inuse == 0)
+		{
+			if(c->nempty > 0)
+			{
+				list_del(&s->list);
+				kmem_slab_free(c, s);
+			}
+			else
+			{
+				list_move(&s->list, &c->empty);
+				c->nempty++;
+			}
+		}
+	}
+	spin_unlock(&c->lock);
+}
+
+/*
+ * Without a slab heap, as in the sandbox, a cache just passes through to malloc.
+ */
+struct kmem_cache_t * kmem_cache_create(const char * name, size_t size, size_t align)
+{
+	struct kmem_cache_t * c;
+	irq_flags_t flags;
+	size_t offset;
+	int i;
+
+	if(size <= 0)
+		return NULL;
+	if(align < ALIGN_SIZE)
+		align = ALIGN_SIZE;
+	if(align & (align - 1))
+		return NULL;
+	size = align_up(tlsf_max(size, sizeof(void *)), align);
+	offset = align_up(sizeof(struct kmem_slab_t), align);
+
+	c = malloc(sizeof(struct kmem_cache_t));
+	if(!c)
+		return NULL;
+	memset(c, 0, sizeof(struct kmem_cache_t));
+	strlcpy(c->name, name ? name : "", sizeof(c->name));
+	c->size = size;
+	c->offset = offset;
+	c->nobjs = (__slab_map && (offset + size <= CONFIG_SLAB_SIZE)) ? (CONFIG_SLAB_SIZE - offset) / size : 0;
+	init_list_head(&c->partial);
+	init_list_head(&c->full);
+	init_list_head(&c->empty);
+	spin_lock_init(&c->lock);
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+		c->mag[i].count = 0;
+
+	spin_lock_irqsave(&__kmem_cache_lock, flags);
+	list_add_tail(&c->list, &__kmem_cache_list);
+	spin_unlock_irqrestore(&__kmem_cache_lock, flags);
+
+	return c;
+}
+
+/*
+ * Every object must have been freed, the slabs still in use are leaked otherwise.
+ */
+void kmem_cache_destroy(struct kmem_cache_t * c)
+{
+	struct kmem_slab_t * s, * n;
+	irq_flags_t flags;
+	int i;
+
+	if(c)
+	{
+		spin_lock_irqsave(&__kmem_cache_lock, flags);
+		list_del(&c->list);
+		spin_unlock_irqrestore(&__kmem_cache_lock, flags);
+
+		local_irq_save(flags);
+		for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+			kmem_cache_drain(c, &c->mag[i], CONFIG_SLAB_MAGAZINE_SIZE);
+		spin_lock(&c->lock);
+		list_for_each_entry_safe(s, n, &c->empty, list)
+		{
+			list_del(&s->list);
+			kmem_slab_free(c, s);
+		}
+		spin_unlock(&c->lock);
+		local_irq_restore(flags);
+		free(c);
+	}
+}
+
+void * kmem_cache_alloc(struct kmem_cache_t * c)
+{
+	struct kmem_magazine_t * m;
+	irq_flags_t flags;
+	void * obj = NULL;
+
+	if(!c)
+		return NULL;
+	if(!c->nobjs)
+		return malloc(c->size);
+
+	local_irq_save(flags);
+	m = &c->mag[smp_processor_id()];
+	if(m->count == 0)
+		kmem_cache_refill(c, m);
+	if(m->count > 0)
+		obj = m->objs[--m->count];
+	local_irq_restore(flags);
+
+	return obj;
+}
+
+void kmem_cache_free(struct kmem_cache_t * c, void * obj)
+{
+	struct kmem_magazine_t * m;
+	irq_flags_t flags;
+
+	if(!c || !obj)
+		return;
+	if(!c->nobjs)
+	{
+		free(obj);
+		return;
+	}
+
+	local_irq_save(flags);
+	m = &c->mag[smp_processor_id()];
+	if(m->count >= CONFIG_SLAB_MAGAZINE_SIZE)
+		kmem_cache_drain(c, m, tlsf_max(CONFIG_SLAB_MAGAZINE_SIZE / 2, 1));
+	m->objs[m->count++] = obj;
+	local_irq_restore(flags);
+}
+
+#if defined(CONFIG_HEAP_PROFILE) && (CONFIG_HEAP_PROFILE > 0)
+#if ((CONFIG_HEAP_PROFILE_SITES & (CONFIG_HEAP_PROFILE_SITES - 1)) != 0) || ((CONFIG_HEAP_PROFILE_TRACKS & (CONFIG_HEAP_PROFILE_TRACKS - 1)) != 0)
+#error "CONFIG_HEAP_PROFILE_SITES and CONFIG_HEAP_PROFILE_TRACKS must be powers of two"
+#endif
+
+/*
+ * Optional allocation tracking. Every live block is recorded in an open addressing
+ * table keyed by its address, pointing at the call site that allocated it, so live
+ * bytes can be attributed and leaks found. Blocks that don't fit into the tables are
+ * only counted as untracked.
+ */
+struct heap_site_t {
+	void * caller;
+	unsigned long live;
+	unsigned long bytes;
+	unsigned long peak;
+	unsigned long total;
+};
+
+struct heap_track_t {
+	void * ptr;
+	size_t size;
+	struct heap_site_t * site;
+};
+
+static struct heap_site_t * __heap_site = NULL;
+static struct heap_track_t * __heap_track = NULL;
+static unsigned long __heap_hist_live[32];
+static unsigned long __heap_hist_total[32];
+static unsigned long __heap_untracked = 0;
+static spinlock_t __heap_profile_lock = SPIN_LOCK_INIT();
+
+static inline unsigned int heap_profile_hash(const void * p, unsigned int size)
+{
+	return (((unsigned long)p >> 3) * 2654435761U) & (size - 1);
+}
+
+static struct heap_site_t * heap_profile_site(void * caller)
+{
+	unsigned int i, n;
+
+	for(i = heap_profile_hash(caller, CONFIG_HEAP_PROFILE_SITES), n = 0; n < CONFIG_HEAP_PROFILE_SITES; i = (i + 1) & (CONFIG_HEAP_PROFILE_SITES - 1), n++)
+	{
+		if(__heap_site[i].caller == caller)
+			return &__heap_site[i];
+		if(!__heap_site[i].caller)
+		{
+			__heap_site[i].caller = caller;
+			return &__heap_site[i];
+		}
+	}
+	return NULL;
+}
+
+static void heap_profile_alloc(void * ptr, size_t size, void * caller)
+{
+	struct heap_site_t * site;
+	irq_flags_t flags;
+	unsigned int i, n;
+	int h;
+
+	if(!ptr || !__heap_track)
+		return;
+
+	spin_lock_irqsave(&__heap_profile_lock, flags);
+	h = tlsf_max(tlsf_fls(size), 0);
+	__heap_hist_total[h]++;
+	site = heap_profile_site(caller);
+	for(i = heap_profile_hash(ptr, CONFIG_HEAP_PROFILE_TRACKS), n = 0; site && (n < CONFIG_HEAP_PROFILE_TRACKS); i = (i + 1) & (CONFIG_HEAP_PROFILE_TRACKS - 1), n++)
+	{
+		if(!__heap_track[i].ptr)
+		{
+			__heap_track[i].ptr = ptr;
+			__heap_track[i].size = size;
+			__heap_track[i].site = site;
+			__heap_hist_live[h]++;
+			site->live++;
+			site->bytes += size;
+			site->total++;
+			if(site->bytes > site->peak)
+				site->peak = site->bytes;
+			spin_unlock_irqrestore(&__heap_profile_lock, flags);
+			return;
+		}
+	}
+	__heap_untracked++;
+	spin_unlock_irqrestore(&__heap_profile_lock, flags);
+}
+
+static void heap_profile_free(void * ptr)
+{
+	struct heap_track_t * t;
+	irq_flags_t flags;
+	unsigned int i, j, k, n;
+	int h;
+
+	if(!ptr || !__heap_track)
+		return;
+
+	spin_lock_irqsave(&__heap_profile_lock, flags);
+	for(i = heap_profile_hash(ptr, CONFIG_HEAP_PROFILE_TRACKS), n = 0; n < CONFIG_HEAP_PROFILE_TRACKS; i = (i + 1) & (CONFIG_HEAP_PROFILE_TRACKS - 1), n++)
+	{
+		t = &__heap_track[i];
+		if(!t->ptr)
+			break;
+		if(t->ptr != ptr)
+			continue;
+		h = tlsf_max(tlsf_fls(t->size), 0);
+		__heap_hist_live[h]--;
+		t->site->live--;
+		t->site->bytes -= t->size;
+		/*
+		 * Backward shift deletion, keeps every probe chain intact without tombstones.
+		 */
+		for(j = i;;)
+		{
+			j = (j + 1) & (CONFIG_HEAP_PROFILE_TRACKS - 1);
+			if(!__heap_track[j].ptr)
+				break;
+			k = heap_profile_hash(__heap_track[j].ptr, CONFIG_HEAP_PROFILE_TRACKS);
+			if((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+				continue;
+			__heap_track[i] = __heap_track[j];
+			i = j;
+		}
+		__heap_track[i].ptr = NULL;
+		break;
+	}
+	spin_unlock_irqrestore(&__heap_profile_lock, flags);
+}
+#else
+static inline void heap_profile_alloc(void * ptr, size_t size, void * caller)
+{
+}
+
+static inline void heap_profile_free(void * ptr)
+{
+}
+#endif
+
+static inline void * heap_malloc(size_t size)
 {
 	void * m;
 
 	if(__heap_pool)
 	{
+		if((size > 0) && (size <= KMEM_SIZE_MAX) && __kmem_size_cache[0])
+		{
+			if((m = kmem_cache_alloc(__kmem_size_cache[kmem_size_index(size)])))
+				return m;
+		}
 		spin_lock(&__heap_lock);
 		m = tlsf_malloc(__heap_pool, size);
 		spin_unlock(&__heap_lock);
@@ -832,6 +1321,14 @@ static void * __malloc(size_t size)
 	}
 	return NULL;
 }
+
+static void * __malloc(size_t size)
+{
+	void * m = heap_malloc(size);
+
+	heap_profile_alloc(m, size, __builtin_return_address(0));
+	return m;
+}
 extern __typeof(__malloc) malloc __attribute__((weak, alias("__malloc")));
 
 static void * __memalign(size_t align, size_t size)
@@ -843,18 +1340,36 @@ static void * __memalign(size_t align, size_t size)
 		spin_lock(&__heap_lock);
 		m = tlsf_memalign(__heap_pool, align, size);
 		spin_unlock(&__heap_lock);
+		heap_profile_alloc(m, size, __builtin_return_address(0));
 		return m;
 	}
 	return NULL;
 }
 extern __typeof(__memalign) memalign __attribute__((weak, alias("__memalign")));
 
-static void * __realloc(void * ptr, size_t size)
+static inline void * heap_realloc(void * ptr, size_t size)
 {
+	struct kmem_slab_t * s;
 	void * m;
 
 	if(__heap_pool)
 	{
+		if((s = kmem_slab_of(ptr)))
+		{
+			if(size == 0)
+			{
+				kmem_cache_free(s->cache, ptr);
+				return NULL;
+			}
+			if(size <= s->cache->size)
+				return ptr;
+			if((m = heap_malloc(size)))
+			{
+				memcpy(m, ptr, s->cache->size);
+				kmem_cache_free(s->cache, ptr);
+			}
+			return m;
+		}
 		spin_lock(&__heap_lock);
 		m = tlsf_realloc(__heap_pool, ptr, size);
 		spin_unlock(&__heap_lock);
@@ -862,22 +1377,43 @@ static void * __realloc(void * ptr, size_t size)
 	}
 	return NULL;
 }
+
+static void * __realloc(void * ptr, size_t size)
+{
+	void * m = heap_realloc(ptr, size);
+
+	if(ptr && (m || (size == 0)))
+		heap_profile_free(ptr);
+	heap_profile_alloc(m, size, __builtin_return_address(0));
+	return m;
+}
 extern __typeof(__realloc) realloc __attribute__((weak, alias("__realloc")));
 
 static void * __calloc(size_t nmemb, size_t size)
 {
 	void * m;
 
-	if((m = malloc(nmemb * size)))
+	if((m = heap_malloc(nmemb * size)))
+	{
 		memset(m, 0, nmemb * size);
+		heap_profile_alloc(m, nmemb * size, __builtin_return_address(0));
+	}
 	return m;
 }
 extern __typeof(__calloc) calloc __attribute__((weak, alias("__calloc")));
 
 static void __free(void * ptr)
 {
+	struct kmem_slab_t * s;
+
 	if(__heap_pool)
 	{
+		heap_profile_free(ptr);
+		if((s = kmem_slab_of(ptr)))
+		{
+			kmem_cache_free(s->cache, ptr);
+			return;
+		}
 		spin_lock(&__heap_lock);
 		tlsf_free(__heap_pool, ptr);
 		spin_unlock(&__heap_lock);
@@ -914,6 +1450,170 @@ static ssize_t memory_read_meminfo(struct kobj_t * kobj, void * buf, size_t size
 	return len;
 }
 
+static ssize_t memory_read_slabinfo(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct kmem_cache_t * pos;
+	irq_flags_t flags;
+	char * p = buf;
+	int len = 0;
+
+	spin_lock_irqsave(&__kmem_cache_lock, flags);
+	list_for_each_entry(pos, &__kmem_cache_list, list)
+	{
+		if(len >= size)
+			break;
+		len += snprintf((char *)(p + len), size - len, " %-20s %6ld %8d %8d %6d\r\n",
+			pos->name, (long)pos->size, pos->active, pos->nslabs * pos->nobjs, pos->nslabs);
+	}
+	spin_unlock_irqrestore(&__kmem_cache_lock, flags);
+	return tlsf_min(len, (int)size);
+}
+
+static ssize_t memory_read_fragment(struct kobj_t * kobj, void * buf, size_t size)
+{
+	size_t count[FL_INDEX_COUNT], bytes[FL_INDEX_COUNT];
+	size_t largest, nblocks = 0, nbytes = 0;
+	char * p = buf;
+	int len = 0;
+	int fl;
+
+	if(!__heap_pool)
+		return 0;
+
+	spin_lock(&__heap_lock);
+	tlsf_free_info(__heap_pool, count, bytes, &largest);
+	spin_unlock(&__heap_lock);
+
+	for(fl = 0; fl < FL_INDEX_COUNT; fl++)
+	{
+		nblocks += count[fl];
+		nbytes += bytes[fl];
+	}
+	len += snprintf((char *)(p + len), size - len, " free blocks: %ld\r\n", (long)nblocks);
+	len += snprintf((char *)(p + len), size - len, " free bytes: %ld\r\n", (long)nbytes);
+	len += snprintf((char *)(p + len), size - len, " largest free block: %ld\r\n", (long)largest);
+	len += snprintf((char *)(p + len), size - len, " fragmentation: %ld%%\r\n", nbytes ? (long)(100 - (unsigned long long)largest * 100 / nbytes) : 0L);
+	for(fl = 0; (fl < FL_INDEX_COUNT) && (len < size); fl++)
+	{
+		if(count[fl] == 0)
+			continue;
+		len += snprintf((char *)(p + len), size - len, " [%9ld - %9ld] %8ld %10ld\r\n",
+			fl ? (long)(1UL << (fl + FL_INDEX_SHIFT - 1)) : 0L, fl ? (long)((1UL << (fl + FL_INDEX_SHIFT)) - 1) : (long)(SMALL_BLOCK_SIZE - 1), (long)count[fl], (long)bytes[fl]);
+	}
+	return tlsf_min(len, (int)size);
+}
+
+#if defined(CONFIG_HEAP_PROFILE) && (CONFIG_HEAP_PROFILE > 0)
+static int heap_site_cmp(const void * a, const void * b)
+{
+	const struct heap_site_t * sa = a;
+	const struct heap_site_t * sb = b;
+
+	if(sa->bytes != sb->bytes)
+		return (sa->bytes < sb->bytes) ? 1 : -1;
+	return (sa->total < sb->total) ? 1 : ((sa->total > sb->total) ? -1 : 0);
+}
+
+static ssize_t memory_read_profile(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct heap_site_t * site;
+	irq_flags_t flags;
+	unsigned long untracked;
+	char * p = buf;
+	int len = 0;
+	int i, n;
+
+	site = heap_malloc(sizeof(struct heap_site_t) * CONFIG_HEAP_PROFILE_SITES);
+	if(!site)
+		return 0;
+	spin_lock_irqsave(&__heap_profile_lock, flags);
+	memcpy(site, __heap_site, sizeof(struct heap_site_t) * CONFIG_HEAP_PROFILE_SITES);
+	untracked = __heap_untracked;
+	spin_unlock_irqrestore(&__heap_profile_lock, flags);
+
+	for(i = 0, n = 0; i < CONFIG_HEAP_PROFILE_SITES; i++)
+	{
+		if(site[i].caller)
+			site[n++] = site[i];
+	}
+	qsort(site, n, sizeof(struct heap_site_t), heap_site_cmp);
+	len += snprintf((char *)(p + len), size - len, " %-10s %8s %10s %10s %8s\r\n", "CALLER", "LIVE", "BYTES", "PEAK", "TOTAL");
+	for(i = 0; (i < n) && (len < size); i++)
+	{
+		len += snprintf((char *)(p + len), size - len, " %p %8ld %10ld %10ld %8ld\r\n",
+			site[i].caller, site[i].live, site[i].bytes, site[i].peak, site[i].total);
+	}
+	if(len < size)
+		len += snprintf((char *)(p + len), size - len, " untracked: %ld\r\n", untracked);
+	__free(site);
+	return tlsf_min(len, (int)size);
+}
+
+static ssize_t memory_read_histogram(struct kobj_t * kobj, void * buf, size_t size)
+{
+	irq_flags_t flags;
+	unsigned long live[32], total[32];
+	char * p = buf;
+	int len = 0;
+	int i;
+
+	spin_lock_irqsave(&__heap_profile_lock, flags);
+	memcpy(live, __heap_hist_live, sizeof(live));
+	memcpy(total, __heap_hist_total, sizeof(total));
+	spin_unlock_irqrestore(&__heap_profile_lock, flags);
+
+	for(i = 0; (i < 32) && (len < size); i++)
+	{
+		if(total[i] == 0)
+			continue;
+		len += snprintf((char *)(p + len), size - len, " [%10lu - %10lu] %8ld %10ld\r\n",
+			i ? (1UL << i) : 0UL, (i < 31) ? ((1UL << (i + 1)) - 1) : ~0UL, live[i], total[i]);
+	}
+	return tlsf_min(len, (int)size);
+}
+
+static void heap_profile_init(void)
+{
+	__heap_site = tlsf_malloc(__heap_pool, sizeof(struct heap_site_t) * CONFIG_HEAP_PROFILE_SITES);
+	__heap_track = tlsf_malloc(__heap_pool, sizeof(struct heap_track_t) * CONFIG_HEAP_PROFILE_TRACKS);
+	if(!__heap_site || !__heap_track)
+	{
+		if(__heap_site)
+			tlsf_free(__heap_pool, __heap_site);
+		if(__heap_track)
+			tlsf_free(__heap_pool, __heap_track);
+		__heap_site = NULL;
+		__heap_track = NULL;
+		return;
+	}
+	memset(__heap_site, 0, sizeof(struct heap_site_t) * CONFIG_HEAP_PROFILE_SITES);
+	memset(__heap_track, 0, sizeof(struct heap_track_t) * CONFIG_HEAP_PROFILE_TRACKS);
+	kobj_add_regular(search_class_memory_kobj(), "profile", memory_read_profile, NULL, NULL);
+	kobj_add_regular(search_class_memory_kobj(), "histogram", memory_read_histogram, NULL, NULL);
+}
+#endif
+
+static void kmem_init(void * start, void * end)
+{
+	char name[32];
+	size_t bytes;
+	int i;
+
+	__slab_base = align_down((size_t)start, CONFIG_SLAB_SIZE);
+	__slab_npages = ((unsigned long)end - __slab_base + CONFIG_SLAB_SIZE - 1) / CONFIG_SLAB_SIZE;
+	bytes = ((__slab_npages + 31) / 32) * sizeof(u32_t);
+	__slab_map = tlsf_malloc(__heap_pool, bytes);
+	if(!__slab_map)
+		return;
+	memset(__slab_map, 0, bytes);
+
+	for(i = 0; i < KMEM_SIZE_CLASSES; i++)
+	{
+		snprintf(name, sizeof(name), "kmalloc-%d", 1 << (KMEM_SIZE_MIN_SHIFT + i));
+		__kmem_size_cache[i] = kmem_cache_create(name, 1 << (KMEM_SIZE_MIN_SHIFT + i), 0);
+	}
+}
+
 void do_init_mem(void)
 {
 #ifndef __SANDBOX__
@@ -921,6 +1621,14 @@ void do_init_mem(void)
 	extern unsigned char __heap_end[];
 	spin_lock_init(&__heap_lock);
 	__heap_pool = mm_create((void *)__heap_start, (size_t)(__heap_end - __heap_start));
+	if(__heap_pool)
+		kmem_init(__heap_start, __heap_end);
+#if defined(CONFIG_HEAP_PROFILE) && (CONFIG_HEAP_PROFILE > 0)
+	if(__heap_pool)
+		heap_profile_init();
+#endif
 #endif
 	kobj_add_regular(search_class_memory_kobj(), "meminfo", memory_read_meminfo, NULL, NULL);
+	kobj_add_regular(search_class_memory_kobj(), "slabinfo", memory_read_slabinfo, NULL, NULL);
+	kobj_add_regular(search_class_memory_kobj(), "fragment", memory_read_fragment, NULL, NULL);
 }
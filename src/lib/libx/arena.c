@@ -0,0 +1,150 @@
+/*
+ * libx/arena.c
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <malloc.h>
+#include <arena.h>
+#include <xboot/module.h>
+
+#define ARENA_ALIGN		(8)
+#define ARENA_HDRSZ		((sizeof(struct arena_chunk_t) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+static inline void * arena_chunk_data(struct arena_chunk_t * c)
+{
+	return (char *)c + ARENA_HDRSZ;
+}
+
+static void arena_trim(struct arena_t * a, struct arena_chunk_t * keep)
+{
+	struct arena_chunk_t * c;
+
+	while((c = a->chunk) && (c != keep))
+	{
+		a->chunk = c->prev;
+		free(c);
+	}
+}
+
+struct arena_t * arena_alloc(size_t chunksz)
+{
+	struct arena_t * a;
+
+	a = malloc(sizeof(struct arena_t));
+	if(!a)
+		return NULL;
+
+	if(chunksz < 256)
+		chunksz = 256;
+	a->chunk = NULL;
+	a->chunksz = (chunksz + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	return a;
+}
+EXPORT_SYMBOL(arena_alloc);
+
+void arena_free(struct arena_t * a)
+{
+	if(a)
+	{
+		arena_trim(a, NULL);
+		free(a);
+	}
+}
+EXPORT_SYMBOL(arena_free);
+
+void * arena_malloc(struct arena_t * a, size_t size)
+{
+	struct arena_chunk_t * c;
+	size_t sz;
+	void * p;
+
+	if(!a)
+		return NULL;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	c = a->chunk;
+	if(!c || (c->size - c->used < size))
+	{
+		sz = (size > a->chunksz) ? size : a->chunksz;
+		c = malloc(ARENA_HDRSZ + sz);
+		if(!c)
+			return NULL;
+		c->prev = a->chunk;
+		c->size = sz;
+		c->used = 0;
+		a->chunk = c;
+	}
+	p = (char *)arena_chunk_data(c) + c->used;
+	c->used += size;
+
+	return p;
+}
+EXPORT_SYMBOL(arena_malloc);
+
+void * arena_zalloc(struct arena_t * a, size_t size)
+{
+	void * p;
+
+	p = arena_malloc(a, size);
+	if(p)
+		memset(p, 0, size);
+	return p;
+}
+EXPORT_SYMBOL(arena_zalloc);
+
+void arena_reset(struct arena_t * a)
+{
+	struct arena_chunk_t * c, * keep;
+
+	if(a && a->chunk)
+	{
+		for(keep = c = a->chunk; c; c = c->prev)
+		{
+			if(c->size > keep->size)
+				keep = c;
+		}
+		for(c = a->chunk; c; c = a->chunk)
+		{
+			a->chunk = c->prev;
+			if(c != keep)
+				free(c);
+		}
+		keep->prev = NULL;
+		keep->used = 0;
+		a->chunk = keep;
+	}
+}
+EXPORT_SYMBOL(arena_reset);
+
+struct arena_mark_t arena_mark(struct arena_t * a)
+{
+	struct arena_mark_t m = { NULL, 0 };
+
+	if(a && a->chunk)
+	{
+		m.chunk = a->chunk;
+		m.used = a->chunk->used;
+	}
+	return m;
+}
+EXPORT_SYMBOL(arena_mark);
+
+void arena_release(struct arena_t * a, struct arena_mark_t m)
+{
+	if(a)
+	{
+		if(m.chunk)
+		{
+			arena_trim(a, m.chunk);
+			if(a->chunk)
+				a->chunk->used = m.used;
+		}
+		else
+		{
+			arena_reset(a);
+		}
+	}
+}
+EXPORT_SYMBOL(arena_release);
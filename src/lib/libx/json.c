@@ -7,6 +7,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <malloc.h>
+#include <arena.h>
 #include <json.h>
 
 enum {
@@ -30,6 +31,7 @@ enum {
 
 struct json_state_t
 {
+	struct arena_t * arena;
 	unsigned long used_memory;
 	unsigned int uint_max;
 	unsigned long ulong_max;
@@ -73,7 +75,7 @@ static void * json_alloc(struct json_state_t * state, unsigned long size, int ze
 {
 	if((state->ulong_max - state->used_memory) < size)
 		return 0;
-	return zero ? calloc(1, size) : malloc(size);
+	return zero ? arena_zalloc(state->arena, size) : arena_malloc(state->arena, size);
 }
 
 static int new_value(struct json_state_t * state, struct json_value_t ** top, struct json_value_t ** root, struct json_value_t ** alloc, enum json_type_t type)
@@ -161,6 +163,13 @@ struct json_value_t * json_parse(const char * json, size_t length, char * errbuf
 	memset(&state.ulong_max, 0xff, sizeof(state.ulong_max));
 	state.uint_max -= 8;
 	state.ulong_max -= 8;
+	state.arena = arena_alloc(length);
+	if(!state.arena)
+	{
+		if(errbuf)
+			strcpy(errbuf, "Memory allocation failure");
+		return 0;
+	}
 
    for(state.first_pass = 1; state.first_pass >= 0; --state.first_pass)
    {
@@ -798,6 +807,12 @@ struct json_value_t * json_parse(const char * json, size_t length, char * errbuf
 		}
 		alloc = root;
 	}
+	if(!root)
+	{
+		arena_free(state.arena);
+		return 0;
+	}
+	root->reserved.arena = state.arena;
 	return root;
 
 e_unknown_value:
@@ -820,59 +835,12 @@ e_failed:
 		else
 			strcpy(errbuf, "Unknown error");
 	}
-	if(state.first_pass)
-		alloc = root;
-	while(alloc)
-	{
-		top = alloc->reserved.next_alloc;
-		free(alloc);
-		alloc = top;
-	}
-	if(!state.first_pass)
-		json_free(root);
+	arena_free(state.arena);
 	return 0;
 }
 
 void json_free(struct json_value_t * value)
 {
-	struct json_value_t * v;
-
-	if(!value)
-		return;
-
-	value->parent = 0;
-	while(value)
-	{
-		switch(value->type)
-		{
-		case JSON_ARRAY:
-			if(!value->u.array.length)
-			{
-				free(value->u.array.values);
-				break;
-			}
-			value = value->u.array.values[--value->u.array.length];
-			continue;
-
-		case JSON_OBJECT:
-			if(!value->u.object.length)
-			{
-				free(value->u.object.values);
-				break;
-			}
-			value = value->u.object.values[--value->u.object.length].value;
-			continue;
-
-		case JSON_STRING:
-			free(value->u.string.ptr);
-			break;
-
-		default:
-			break;
-		};
-
-		v = value;
-		value = value->parent;
-		free(v);
-	}
+	if(value)
+		arena_free(value->reserved.arena);
 }